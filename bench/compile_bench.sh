@@ -0,0 +1,91 @@
+#!/bin/bash
+
+# コンパイル速度のベンチマーク
+# 合成プログラムの形ごとに入力サイズを倍々にしてコンパイルし、
+# プロセス全体とフェーズごとの時間、メモリの最大使用量を計測します。
+# 単位あたりの時間が最小サイズの時のLIMIT倍を超えた場合は非線形とみなして失敗します。
+
+# 実行は下記のコマンドで行ないます。
+# $ make bench
+
+cd `dirname $0`
+
+SHCC=../bin/shcc
+GEN=../bin/gen_program
+WORK=`mktemp -d`
+trap 'rm -rf "$WORK"' EXIT
+
+# 計測の繰り返し回数（最小値を採用）
+RUNS=3
+# 許容する単位あたりの時間の増加率
+LIMIT=2.5
+
+# 形と最小サイズ
+SHAPES="funcs:1000 nesting:500 chain:4000 globals:1000 locals:1000"
+# 最小サイズに対する倍率
+SCALES="1 2 4 8"
+
+# JSONから数値を一つ取り出す
+# Arg 1: JSON
+# Arg 2: キーの前に付く文字列（"name":"parse"など）
+# Arg 3: キー
+json_value() {
+	echo "$1" | grep -o "$2[^}]*\"$3\":[0-9.]*" | head -1 | sed "s/.*\"$3\"://"
+}
+
+printf "%-8s %8s %10s %10s %10s %10s %10s %10s %12s %10s\n" \
+	shape n e2e_ms tokenize parse codegen emit total peak_kb us_per_n
+
+failed=0
+for entry in $SHAPES; do
+	shape=${entry%%:*}
+	base=${entry#*:}
+	first_rate=''
+
+	for scale in $SCALES; do
+		n=$((base * scale))
+		src="$WORK/$shape-$n.c"
+		$GEN $shape $n > "$src"
+
+		best_e2e=''
+		best_report=''
+		best_total=''
+		for run in $(seq $RUNS); do
+			start=`date +%s%N`
+			$SHCC -f "$src" -ftime-report=json -fmem-report=json -o /dev/null 2> "$WORK/report.json" || exit 1
+			end=`date +%s%N`
+
+			e2e=$(((end - start) / 1000))
+			report=`cat "$WORK/report.json"`
+			total=`json_value "$report" '"total":{' wall_ms`
+			if [ -z "$best_total" ] || awk "BEGIN{exit !($total < $best_total)}"; then
+				best_total=$total
+				best_report=$report
+			fi
+			if [ -z "$best_e2e" ] || [ $e2e -lt $best_e2e ]; then
+				best_e2e=$e2e
+			fi
+		done
+
+		tokenize=`json_value "$best_report" '"name":"tokenize"' wall_ms`
+		parse=`json_value "$best_report" '"name":"parse"' wall_ms`
+		codegen=`json_value "$best_report" '"name":"codegen"' wall_ms`
+		emit=`json_value "$best_report" '"name":"emit"' wall_ms`
+		peak=`json_value "$best_report" '' peak`
+		rate=`awk "BEGIN{printf \"%.3f\", $best_total * 1000 / $n}"`
+
+		printf "%-8s %8d %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %12d %10.3f\n" \
+			$shape $n `awk "BEGIN{print $best_e2e / 1000}"` \
+			$tokenize $parse $codegen $emit $best_total $((peak / 1024)) $rate
+
+		# 単位あたりの時間が最小サイズの時から大きく増えていないこと
+		if [ -z "$first_rate" ]; then
+			first_rate=$rate
+		elif awk "BEGIN{exit !($rate > $first_rate * $LIMIT)}"; then
+			echo "*** $shape: $rate us/n at n=$n is more than $LIMIT times $first_rate us/n at n=$base"
+			failed=1
+		fi
+	done
+done
+
+exit $failed
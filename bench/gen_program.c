@@ -0,0 +1,124 @@
+// コンパイル速度ベンチマーク用の合成プログラム生成器
+// 指定した形の大きなプログラムを標準出力へ出力します。
+
+// $ gen_program <shape> <n>
+//   funcs    n個の関数定義
+//   nesting  深さnのif文とブロックの入れ子
+//   chain    n項の長い式
+//   globals  n個のグローバル変数
+//   locals   n個のローカル変数を持つ関数
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// n個の関数定義
+static void gen_funcs(int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        printf("int f%d(int a){int b; b=a+%d; if(b>100) b=b-100; return b;}\n", i, i % 97);
+    }
+    printf("int main(){return f%d(1);}\n", n - 1);
+}
+
+// 深さnの入れ子
+static void gen_nesting(int n)
+{
+    printf("int main(){int a; a=0;\n");
+    for (int i = 0; i < n; i++)
+    {
+        printf("if(a<%d){a=a+1;\n", n);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        printf("}");
+    }
+    printf("\nreturn a;}\n");
+}
+
+// n項の式
+// 加減と乗算を混ぜて、左結合の長い連鎖にする
+static void gen_chain(int n)
+{
+    printf("int main(){int a; a=1; return a");
+    for (int i = 1; i < n; i++)
+    {
+        switch (i % 3)
+        {
+        case 0:
+            printf("+a*%d", i % 7);
+            break;
+        case 1:
+            printf("+%d", i % 11);
+            break;
+        default:
+            printf("-a");
+            break;
+        }
+        if (i % 16 == 0)
+        {
+            printf("\n");
+        }
+    }
+    printf(";}\n");
+}
+
+// n個のグローバル変数
+static void gen_globals(int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        printf("int g%d;\n", i);
+    }
+    printf("int main(){\n");
+    for (int i = 0; i < n; i++)
+    {
+        printf("g%d=%d;\n", i, i % 100);
+    }
+    printf("return g%d;}\n", n - 1);
+}
+
+// n個のローカル変数
+static void gen_locals(int n)
+{
+    printf("int main(){\n");
+    for (int i = 0; i < n; i++)
+    {
+        printf("int v%d; v%d=%d;\n", i, i, i % 100);
+    }
+    printf("return v%d;}\n", n - 1);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct
+    {
+        const char *name;
+        void (*gen)(int n);
+    } shapes[] = {
+        {"funcs", gen_funcs},
+        {"nesting", gen_nesting},
+        {"chain", gen_chain},
+        {"globals", gen_globals},
+        {"locals", gen_locals},
+    };
+
+    if (argc != 3 || atoi(argv[2]) <= 0)
+    {
+        fprintf(stderr, "usage: %s <funcs|nesting|chain|globals|locals> <n>\n", argv[0]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+    {
+        if (strcmp(argv[1], shapes[i].name) == 0)
+        {
+            shapes[i].gen(atoi(argv[2]));
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "unknown shape: %s\n", argv[1]);
+    return 1;
+}
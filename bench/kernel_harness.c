@@ -0,0 +1,139 @@
+// 生成コードの実行速度を計測するハーネスです。
+// bench/kernels以下のカーネル（bench_kernel関数）をコンパイルしたオブジェクトファイルとリンクして使用します。
+// カーネルが呼び出す、本コンパイラではまだ書けない処理（配列の確保など）もここで提供します。
+
+// 本ファイルのリンクは下記のコマンドで実行します。
+// $ gcc -O2 -o kernel kernel_harness.c kernel.o
+
+// 使い方: kernel <n> [<runs>]
+// bench_kernel(n)を<runs>回実行し、1回あたりのサイクル数と命令数をJSONで標準出力へ出力します。
+// 命令数はperf_event_openが使用できない環境ではnullになります。
+
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#define BUFFER_LEN 4096
+#define DEFAULT_RUNS 5
+
+long bench_kernel(long n);
+
+static long buffer[BUFFER_LEN];
+
+// ポインタをたどるカーネル用の配列の先頭アドレス
+long bench_buffer(void)
+{
+    return (long)buffer;
+}
+
+// ポインタをたどるカーネル用の配列の要素数
+long bench_buffer_len(void)
+{
+    return BUFFER_LEN;
+}
+
+// ユーザー空間の命令数を数えるカウンタを開く
+// 使用できない場合は-1を返す
+static int open_instruction_counter(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// 値の昇順比較
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "使い方: %s <n> [<runs>]\n", argv[0]);
+        return 1;
+    }
+    long n = atol(argv[1]);
+    int runs = argc > 2 ? atoi(argv[2]) : DEFAULT_RUNS;
+    if (runs <= 0)
+    {
+        fprintf(stderr, "実行回数が不正です: %s\n", argv[2]);
+        return 1;
+    }
+
+    for (int i = 0; i < BUFFER_LEN; i++)
+    {
+        buffer[i] = i % 17;
+    }
+
+    uint64_t *cycles = malloc(sizeof(uint64_t) * runs);
+    uint64_t *instructions = malloc(sizeof(uint64_t) * runs);
+    int counter = open_instruction_counter();
+
+    // 1回目はキャッシュなどを温めるためのもので計測しない
+    long result = bench_kernel(n);
+
+    for (int i = 0; i < runs; i++)
+    {
+        if (counter >= 0)
+        {
+            ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+
+        uint64_t start = __rdtsc();
+        long r = bench_kernel(n);
+        cycles[i] = __rdtsc() - start;
+
+        if (counter >= 0)
+        {
+            ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter, &instructions[i], sizeof(uint64_t)) != sizeof(uint64_t))
+            {
+                close(counter);
+                counter = -1;
+            }
+        }
+
+        if (r != result)
+        {
+            fprintf(stderr, "実行ごとに結果が異なります: %ld, %ld\n", result, r);
+            return 1;
+        }
+    }
+
+    qsort(cycles, runs, sizeof(uint64_t), compare_u64);
+    printf("{\"n\":%ld,\"result\":%ld,\"runs\":%d,\"cycles_min\":%llu,\"cycles_median\":%llu,\"instructions\":",
+           n, result, runs, (unsigned long long)cycles[0], (unsigned long long)cycles[runs / 2]);
+    if (counter >= 0)
+    {
+        qsort(instructions, runs, sizeof(uint64_t), compare_u64);
+        printf("%llu}\n", (unsigned long long)instructions[0]);
+        close(counter);
+    }
+    else
+    {
+        printf("null}\n");
+    }
+
+    free(cycles);
+    free(instructions);
+    return 0;
+}
@@ -0,0 +1,26 @@
+int add(int a, int b)
+{
+    return a + b;
+}
+
+int mix(int a, int b, int c)
+{
+    return add(add(a, b), c) % 1000003;
+}
+
+int step(int x)
+{
+    return mix(x, add(x, 1), 7);
+}
+
+int bench_kernel(int n)
+{
+    int sum;
+    sum = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1)
+    {
+        sum = step(sum + i);
+    }
+    return sum;
+}
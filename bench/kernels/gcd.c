@@ -0,0 +1,27 @@
+int gcd(int a, int b)
+{
+    while (b != 0)
+    {
+        int t;
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int bench_kernel(int n)
+{
+    int sum;
+    sum = 0;
+    int i;
+    for (i = 1; i <= n; i = i + 1)
+    {
+        int j;
+        for (j = 1; j <= n; j = j + 1)
+        {
+            sum = sum + gcd(i, j);
+        }
+    }
+    return sum;
+}
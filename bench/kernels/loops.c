@@ -0,0 +1,15 @@
+int bench_kernel(int n)
+{
+    int sum;
+    sum = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1)
+    {
+        int j;
+        for (j = 0; j < n; j = j + 1)
+        {
+            sum = sum + (i * j) % 7 + i - j;
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,7 @@
+// gccでベンチマークのカーネルをコンパイルする際に-includeで読み込むヘッダです。
+// カーネルは本コンパイラの対応範囲で書かれているため、
+// 宣言なしで呼び出しているハーネスの関数をここで宣言します。
+// intは-Dint=longで64bitに揃えてください。
+
+long bench_buffer(void);
+long bench_buffer_len(void);
@@ -0,0 +1,19 @@
+int bench_kernel(int n)
+{
+    int sum;
+    sum = 0;
+    int r;
+    for (r = 0; r < n; r = r + 1)
+    {
+        int p;
+        p = bench_buffer();
+        int end;
+        end = p + bench_buffer_len() * 8;
+        while (p < end)
+        {
+            sum = sum + *p;
+            p = p + 8;
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,23 @@
+// ptrwalk.cのgcc用の版です。
+// 本コンパイラでは変数に型の区別がなくアドレスも整数として扱うため、
+// そのままではgccでコンパイルできません。処理内容はptrwalk.cと同じにしてください。
+
+long bench_kernel(long n)
+{
+    long sum;
+    sum = 0;
+    long r;
+    for (r = 0; r < n; r = r + 1)
+    {
+        long *p;
+        p = (long *)bench_buffer();
+        long *end;
+        end = p + bench_buffer_len();
+        while (p < end)
+        {
+            sum = sum + *p;
+            p = p + 1;
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,126 @@
+// Mapのマイクロベンチマーク
+// 旧実装（キーを末尾から線形探索するMap）とハッシュテーブル版のMapを比較します。
+
+// 実行は下記のコマンドで行ないます。
+// $ make bench-map
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/shcc.h"
+
+// 旧実装のMap
+typedef struct
+{
+    Vector *keys;
+    Vector *vals;
+} LinearMap;
+
+static LinearMap *new_linear_map(void)
+{
+    LinearMap *map = calloc(1, sizeof(LinearMap));
+
+    map->keys = new_vector();
+    map->vals = new_vector();
+
+    return map;
+}
+
+static void linear_map_put(LinearMap *map, const char *key, void *val)
+{
+    vec_push(map->keys, (char *)key);
+    vec_push(map->vals, val);
+}
+
+static void *linear_map_get(const LinearMap *map, const char *key)
+{
+    for (int i = map->keys->len - 1; i >= 0; i--)
+    {
+        if (strcmp(map->keys->data[i], key) == 0)
+        {
+            return map->vals->data[i];
+        }
+    }
+
+    return NULL;
+}
+
+// 経過時間[ns]
+static double elapsed_ns(const struct timespec *begin, const struct timespec *end)
+{
+    return (end->tv_sec - begin->tv_sec) * 1e9 + (end->tv_nsec - begin->tv_nsec);
+}
+
+// キー数nで、登録とn*lookups_per_key回の参照にかかる時間を計測する
+static void bench(int n, int lookups_per_key)
+{
+    char **keys = calloc(n, sizeof(char *));
+    for (int i = 0; i < n; i++)
+    {
+        keys[i] = calloc(16, sizeof(char));
+        snprintf(keys[i], 16, "var%d", i);
+    }
+
+    struct timespec t0, t1, t2, t3;
+    intptr_t sum_linear = 0;
+    intptr_t sum_hash = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    LinearMap *linear = new_linear_map();
+    for (int i = 0; i < n; i++)
+    {
+        linear_map_put(linear, keys[i], (void *)(intptr_t)i);
+    }
+    for (int r = 0; r < lookups_per_key; r++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            sum_linear += (intptr_t)linear_map_get(linear, keys[(i * 7 + r) % n]);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    Map *map = new_map();
+    for (int i = 0; i < n; i++)
+    {
+        map_put(map, keys[i], (void *)(intptr_t)i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    for (int r = 0; r < lookups_per_key; r++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            sum_hash += (intptr_t)map_get(map, keys[(i * 7 + r) % n]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t3);
+
+    if (sum_linear != sum_hash)
+    {
+        fprintf(stderr, "結果が一致しません: %ld != %ld\n", (long)sum_linear, (long)sum_hash);
+        exit(1);
+    }
+
+    double lookups = (double)n * lookups_per_key;
+    double linear_ns = elapsed_ns(&t0, &t1);
+    double hash_ns = elapsed_ns(&t1, &t3);
+    printf("keys=%-6d lookups=%-8.0f linear=%10.1f ns/op  hash=%8.1f ns/op  speedup=%7.1fx  (insert %.1f ns/key)\n",
+           n, lookups, linear_ns / lookups, hash_ns / lookups, linear_ns / hash_ns,
+           elapsed_ns(&t1, &t2) / n);
+}
+
+int main(void)
+{
+    bench(10, 10000);
+    bench(100, 1000);
+    bench(1000, 100);
+    bench(10000, 10);
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#!/bin/bash
+
+# 生成コードの実行速度のベンチマーク
+# kernels以下の各カーネルを本コンパイラとgcc -O0, gcc -O2でコンパイルし、
+# kernel_harness.cとリンクして1回あたりのサイクル数と命令数を計測します。
+# 結果はカーネル・コンパイラごとに1行のJSONとして標準出力へ、
+# 比較用の表は標準エラー出力へ出力します。
+# コンパイラ間で計算結果が異なる場合は失敗します。
+
+# 本コンパイラはスタックマシン（shcc）とレジスタ割り当て（shcc-O1）の両方を計測します。
+
+# 実行は下記のコマンドで行ないます。
+# $ make bench-run
+
+# カーネル
+#   fib     再帰呼び出しによるフィボナッチ数
+#   loops   二重ループでの積和
+#   gcd     ユークリッドの互除法（剰余とループ）
+#   ptrwalk ポインタをたどる配列の合計
+#   calls   小さな関数の呼び出しの繰り返し
+# gccでコンパイルする場合は-Dint=longで本コンパイラと同じ64bitのintに揃え、
+# <name>_gcc.cがあればそちらを使用します。
+
+cd `dirname $0`
+
+SHCC=../bin/shcc
+WORK=`mktemp -d`
+trap 'rm -rf "$WORK"' EXIT
+
+# 計測の繰り返し回数
+RUNS=${RUNS:-5}
+
+# カーネルと引数
+KERNELS="fib:27 loops:1000 gcd:300 ptrwalk:500 calls:1000000"
+# 比較するコンパイラ（基準のgccを先に計測する）
+COMPILERS="gcc-O0 gcc-O2 shcc shcc-O1"
+
+# サイクル数の比を求める（基準が未計測ならnull）
+# Arg 1: サイクル数
+# Arg 2: 基準のサイクル数
+ratio() {
+	if [ -z "$2" ]; then
+		echo null
+	else
+		awk "BEGIN{printf \"%.2f\", $1 / $2}"
+	fi
+}
+
+# JSONから数値を一つ取り出す
+# Arg 1: JSON
+# Arg 2: キー
+json_value() {
+	echo "$1" | grep -o "\"$2\":[0-9a-z]*" | head -1 | sed "s/.*\"$2\"://"
+}
+
+# カーネルをコンパイルしてオブジェクトファイルを作成する
+# Arg 1: カーネル名
+# Arg 2: コンパイラ
+# Arg 3: 出力ファイル
+compile_kernel() {
+	src=kernels/$1.c
+	case $2 in
+	shcc)
+		$SHCC -c -j 1 -f $src -o $3
+		;;
+	shcc-*)
+		$SHCC ${2#shcc} -c -j 1 -f $src -o $3
+		;;
+	gcc-*)
+		if [ -f kernels/$1_gcc.c ]; then
+			src=kernels/$1_gcc.c
+		fi
+		gcc ${2#gcc} -Dint=long -include kernels/prelude.h -c -o $3 $src
+		;;
+	esac
+}
+
+>&2 printf "%-8s %-8s %14s %14s %14s %10s %10s\n" \
+	kernel compiler result cycles instructions vs_O0 vs_O2
+
+failed=0
+for entry in $KERNELS; do
+	kernel=${entry%%:*}
+	n=${entry#*:}
+	expected=''
+	declare -A cycles
+
+	for compiler in $COMPILERS; do
+		obj="$WORK/$kernel-$compiler.o"
+		exe="$WORK/$kernel-$compiler"
+		compile_kernel $kernel $compiler $obj || exit 1
+		gcc -O2 -o $exe kernel_harness.c $obj || exit 1
+
+		report=`$exe $n $RUNS` || exit 1
+		result=`json_value "$report" result`
+		cycles[$compiler]=`json_value "$report" cycles_min`
+		vs_O0=`ratio ${cycles[$compiler]} ${cycles[gcc-O0]}`
+		vs_O2=`ratio ${cycles[$compiler]} ${cycles[gcc-O2]}`
+		fields=${report#\{}
+		echo "{\"kernel\":\"$kernel\",\"compiler\":\"$compiler\",${fields%\}},\"vs_gcc_O0\":$vs_O0,\"vs_gcc_O2\":$vs_O2}"
+
+		if [ -z "$expected" ]; then
+			expected=$result
+		elif [ "$result" != "$expected" ]; then
+			echo "*** $kernel: $compiler computed $result, but gcc-O0 computed $expected" >&2
+			failed=1
+		fi
+
+		>&2 printf "%-8s %-8s %14s %14s %14s %10s %10s\n" \
+			$kernel $compiler $result ${cycles[$compiler]} `json_value "$report" instructions` $vs_O0 $vs_O2
+	done
+	unset cycles
+done
+
+exit $failed
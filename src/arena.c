@@ -0,0 +1,247 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "shcc.h"
+
+// アリーナのブロックサイズ
+// これより大きな要求はその要求専用のブロックを割り当てる
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// 割り当てのアライメント
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+// アリーナを構成するメモリブロック
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next; // 一つ前に確保したブロック
+    size_t size;             // dataのサイズ
+    size_t used;             // dataの使用済みサイズ
+    char data[];
+} ArenaBlock;
+
+// アリーナ本体
+typedef struct
+{
+    ArenaBlock *head; // 現在割り当て中のブロック
+    void *last;       // 直前に割り当てた領域（その場での拡張用）
+} Arena;
+
+// フェーズごとのアリーナ
+// スレッドごとに持つので、ロックせずに割り当てられる
+static _Thread_local Arena arenas[NUM_ARENAS];
+
+// ブロック列が確保しているメモリ量
+static size_t blocks_size(ArenaBlock *blocks)
+{
+    size_t size = 0;
+
+    for (ArenaBlock *block = blocks; block != NULL; block = block->next)
+    {
+        size += sizeof(ArenaBlock) + block->size;
+    }
+
+    return size;
+}
+
+// アライメントに合わせて切り上げる
+static size_t align_up(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+// 新しいブロックを確保してアリーナの先頭につなぐ
+static ArenaBlock *arena_new_block(Arena *arena, size_t min_size)
+{
+    size_t size = min_size > ARENA_BLOCK_SIZE ? min_size : ARENA_BLOCK_SIZE;
+
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL)
+    {
+        fprintf(stderr, "メモリを確保できません\n");
+        exit(1);
+    }
+
+    block->next = arena->head;
+    block->size = size;
+    block->used = 0;
+    arena->head = block;
+
+    mem_footprint(sizeof(ArenaBlock) + size);
+
+    return block;
+}
+
+// アリーナからの領域確保
+// callocと同じくゼロクリアされた領域を返す
+void *arena_alloc(ArenaKind_t kind, size_t size)
+{
+    Arena *arena = &arenas[kind];
+    size = align_up(size);
+
+    ArenaBlock *block = arena->head;
+    if (block == NULL || block->size - block->used < size)
+    {
+        block = arena_new_block(arena, size);
+    }
+
+    void *p = block->data + block->used;
+    block->used += size;
+    arena->last = p;
+
+    memset(p, 0, size);
+    return p;
+}
+
+// アリーナ上の領域の拡張
+// 直前に確保した領域でブロックに空きがあればその場で伸ばし、なければ新しい領域へコピーする
+void *arena_realloc(ArenaKind_t kind, void *ptr, size_t old_size, size_t new_size)
+{
+    Arena *arena = &arenas[kind];
+
+    if (ptr != NULL && ptr == arena->last)
+    {
+        ArenaBlock *block = arena->head;
+        size_t offset = (char *)ptr - block->data;
+        size_t aligned = align_up(new_size);
+        if (block->size - offset >= aligned)
+        {
+            memset((char *)ptr + old_size, 0, aligned - old_size);
+            block->used = offset + aligned;
+            return ptr;
+        }
+    }
+
+    void *p = arena_alloc(kind, new_size);
+    if (ptr != NULL)
+    {
+        memcpy(p, ptr, old_size);
+    }
+
+    return p;
+}
+
+// アリーナの文字列複製
+char *arena_strndup(ArenaKind_t kind, const char *str, int len)
+{
+    char *p = arena_alloc(kind, len + 1);
+    memcpy(p, str, len);
+    mem_count(MEM_STRINGS, len + 1, 1);
+
+    return p;
+}
+
+// アリーナを丸ごと解放する
+// 先頭の一ブロックは次回の割り当て用に残しておく
+void arena_reset(ArenaKind_t kind)
+{
+    Arena *arena = &arenas[kind];
+    ArenaBlock *block = arena->head;
+
+    if (block == NULL)
+    {
+        return;
+    }
+
+    ArenaBlock *next = block->next;
+    while (next != NULL)
+    {
+        ArenaBlock *prev = next->next;
+        mem_footprint(-(long)(sizeof(ArenaBlock) + next->size));
+        free(next);
+        next = prev;
+    }
+
+    block->next = NULL;
+    block->used = 0;
+    arena->last = NULL;
+}
+
+// アリーナのブロックをすべて解放する
+// スレッドの終了時に使う
+void arena_release_all(void)
+{
+    arena_reset_all();
+
+    for (int i = 0; i < NUM_ARENAS; i++)
+    {
+        if (arenas[i].head != NULL)
+        {
+            mem_footprint(-(long)(sizeof(ArenaBlock) + arenas[i].head->size));
+            free(arenas[i].head);
+        }
+        arenas[i] = (Arena){0};
+    }
+}
+
+// アリーナのブロックを切り離す
+// 他のスレッドでarena_attachするまで、割り当て済みの領域はそのまま使える
+ArenaBlocks arena_detach(ArenaKind_t kind)
+{
+    Arena *arena = &arenas[kind];
+    ArenaBlock *blocks = arena->head;
+
+    *arena = (Arena){0};
+    mem_footprint(-(long)blocks_size(blocks));
+
+    return blocks;
+}
+
+// 切り離されたブロックをこのスレッドのアリーナにつなぐ
+// 以降はこのアリーナと一緒に解放される
+void arena_attach(ArenaKind_t kind, ArenaBlocks blocks)
+{
+    Arena *arena = &arenas[kind];
+
+    if (blocks == NULL)
+    {
+        return;
+    }
+
+    mem_footprint(blocks_size(blocks));
+
+    if (arena->head == NULL)
+    {
+        arena->head = blocks;
+        return;
+    }
+
+    // 割り当て中のブロックは先頭のままにしておく
+    ArenaBlock *tail = blocks;
+    while (tail->next != NULL)
+    {
+        tail = tail->next;
+    }
+    tail->next = arena->head->next;
+    arena->head->next = blocks;
+}
+
+// アリーナの使用量（バイト）
+size_t arena_used(ArenaKind_t kind)
+{
+    size_t used = 0;
+
+    for (ArenaBlock *block = arenas[kind].head; block != NULL; block = block->next)
+    {
+        used += block->used;
+    }
+
+    return used;
+}
+
+// コンパイラ全体の状態を破棄する
+// 全アリーナを解放し、アリーナ上にある識別子テーブルと出力バッファも捨てる
+void arena_reset_all(void)
+{
+    for (int i = 0; i < NUM_ARENAS; i++)
+    {
+        arena_reset((ArenaKind_t)i);
+    }
+
+    intern_reset();
+    emit_reset();
+}
@@ -0,0 +1,271 @@
+#include <errno.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "shcc.h"
+
+// 一括コンパイルの作業キュー
+typedef struct
+{
+    const Vector *inputs; // 入力ファイルのパス
+    bool needs_object;    // オブジェクトファイルを出力するか
+    int opt_level;        // 最適化レベル
+    atomic_int next;      // 次に処理する入力
+    atomic_int failures;  // コンパイルに失敗した入力の数
+} BatchQueue;
+
+// コンパイル中の入力ファイルのパスと、エラー時の復帰先（一括コンパイル中のみ）
+static _Thread_local const char *unit_path = NULL;
+static _Thread_local jmp_buf *unit_recover = NULL;
+
+// コンパイルエラー
+// 一括コンパイル中なら入力ファイルのパスを前置して、その翻訳単位のコンパイルだけを中断する
+// それ以外ではプロセスを終了する
+_Noreturn void compile_error(const char *fmt, ...)
+{
+    // 並列に出力しても行が混ざらないよう、一回で書き出す
+    char msg[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    if (unit_path != NULL)
+    {
+        fprintf(stderr, "%s: %s\n", unit_path, msg);
+    }
+    else
+    {
+        fprintf(stderr, "%s\n", msg);
+    }
+
+    if (unit_recover != NULL)
+    {
+        longjmp(*unit_recover, 1);
+    }
+    exit(1);
+}
+
+// ファイル読み込みエラー
+// 一括コンパイル中の入力ファイルなら、パスはcompile_errorが前置する
+static void error(const char *path)
+{
+    if (path == unit_path)
+    {
+        compile_error("%s", strerror(errno));
+    }
+    perror(path);
+
+    exit(1);
+}
+
+// ファイル全体を読み込む
+// 返した領域は呼び出し元でfreeする
+char *read_file(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        error(path);
+    }
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+    {
+        error(path);
+    }
+    long size = ftell(fp);
+    if (size < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        error(path);
+    }
+
+    char *buf = malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, fp) != (size_t)size)
+    {
+        error(path);
+    }
+    buf[size] = '\0';
+
+    fclose(fp);
+
+    return buf;
+}
+
+// 出力ファイル名の作成
+// 入力ファイルの拡張子をextに置き換える(foo.c -> foo.s)
+static char *output_path_of(const char *input, const char *ext)
+{
+    const char *slash = strrchr(input, '/');
+    const char *dot = strrchr(input, '.');
+    size_t len = (dot != NULL && (slash == NULL || dot > slash)) ? (size_t)(dot - input) : strlen(input);
+
+    char *path = malloc(len + strlen(ext) + 1);
+    memcpy(path, input, len);
+    strcpy(path + len, ext);
+
+    return path;
+}
+
+// 読み込んだソースコード一つのコンパイル
+static void compile_source(const char *input, const char *source, const char *output, bool needs_object,
+                           int opt_level)
+{
+    const char *ext = needs_object ? ".o" : ".s";
+
+    // 同じソースコード・オプションのコンパイル結果があればそれを使う
+    char options[16];
+    snprintf(options, sizeof(options), "%s-O%d", needs_object ? "-c " : "", opt_level);
+    uint64_t key = cache_enabled() ? cache_unit_key(source, options) : 0;
+    if (cache_load_unit(key, ext, output))
+    {
+        return;
+    }
+
+    phase_begin(PHASE_TOKENIZE);
+    TokenList *tokens = tokenize(source);
+    phase_end(PHASE_TOKENIZE);
+    phase_begin(PHASE_PARSE);
+    Ast *ast = program(tokens);
+    phase_end(PHASE_PARSE);
+    report_count(COUNT_TOKENS, tokens->len);
+    report_count(COUNT_NODES, ast->num_nodes);
+    arena_reset(ARENA_TOKEN);
+    phase_begin(PHASE_FOLD);
+    fold_constants(ast);
+    phase_end(PHASE_FOLD);
+
+    // 翻訳単位ごとに並列化しているので、コード生成は逐次でよい
+    cache_set_unit(input);
+    phase_begin(PHASE_CODEGEN);
+    gen_asm(ast, 1, opt_level);
+    phase_end(PHASE_CODEGEN);
+    phase_begin(PHASE_EMIT);
+    if (needs_object)
+    {
+        emit_write_object(output);
+    }
+    else
+    {
+        emit_write(output);
+    }
+    cache_store_unit(key, ext);
+    phase_end(PHASE_EMIT);
+}
+
+// 翻訳単位一つのコンパイル
+// 状態はすべてこのスレッドのアリーナ上にあり、終わったら破棄する
+// エラーになったらその入力の出力は作らずに中断し、falseを返す
+static bool compile_file(const char *input, bool needs_object, int opt_level)
+{
+    char *output = output_path_of(input, needs_object ? ".o" : ".s");
+    // setjmpの後で書き換えるのでvolatileにする
+    char *volatile source = NULL;
+    volatile bool ok = false;
+
+    jmp_buf recover;
+    unit_path = input;
+    unit_recover = &recover;
+    if (setjmp(recover) == 0)
+    {
+        source = read_file(input);
+        compile_source(input, source, output, needs_object, opt_level);
+        ok = true;
+    }
+    unit_path = NULL;
+    unit_recover = NULL;
+
+    arena_reset_all();
+    free(output);
+    free(source);
+
+    return ok;
+}
+
+// ワーカースレッド
+// キューから入力を取り出してなくなるまでコンパイルする
+static void *batch_worker(void *arg)
+{
+    BatchQueue *queue = arg;
+
+    for (;;)
+    {
+        int i = atomic_fetch_add(&queue->next, 1);
+        if (i >= queue->inputs->len)
+        {
+            break;
+        }
+        if (!compile_file(queue->inputs->data[i], queue->needs_object, queue->opt_level))
+        {
+            atomic_fetch_add(&queue->failures, 1);
+        }
+    }
+
+    arena_release_all();
+    mem_report_merge_thread();
+    time_report_merge_thread();
+
+    return NULL;
+}
+
+// マニフェストの読み込み
+// 1行に1ファイルのパスを書いたファイルから入力を追加する
+// パスはマニフェストの内容を直接指すので、読み込んだ内容は解放しない
+void batch_read_manifest(Vector *inputs, const char *path)
+{
+    char *p = read_file(path);
+
+    while (*p != '\0')
+    {
+        char *line = p;
+        p += strcspn(p, "\r\n");
+        if (*p != '\0')
+        {
+            *p++ = '\0';
+        }
+
+        if (*line != '\0')
+        {
+            vec_push(inputs, line);
+        }
+    }
+}
+
+// 複数ファイルの一括コンパイル
+// 最大jobs個のスレッドで、入力ファイルごとに並列にコンパイルする
+// エラーになった入力があっても残りの入力はコンパイルし、失敗した入力の数を返す
+int compile_batch(const Vector *inputs, int jobs, bool needs_object, int opt_level)
+{
+    BatchQueue queue = {.inputs = inputs, .needs_object = needs_object, .opt_level = opt_level};
+
+    int num_threads = jobs < inputs->len ? jobs : inputs->len;
+    if (num_threads <= 1)
+    {
+        batch_worker(&queue);
+        return atomic_load(&queue.failures);
+    }
+
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    for (int i = 0; i < num_threads; i++)
+    {
+        if (pthread_create(&threads[i], NULL, batch_worker, &queue) != 0)
+        {
+            fprintf(stderr, "スレッドを作成できません\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+
+    return atomic_load(&queue.failures);
+}
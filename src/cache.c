@@ -0,0 +1,533 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shcc.h"
+
+// 関数のキャッシュファイルの先頭に置く識別子
+#define FUNC_PACK_MAGIC "SHCP"
+
+// キャッシュの形式・コード生成の版
+// 生成する命令列が変わる変更をしたら上げること
+#define CACHE_VERSION 3
+
+// 索引の一項目のバイト数（キー8 + 位置4 + 長さ4）
+#define INDEX_ENTRY_SIZE 16
+
+// 関数一つ分の先頭部分のバイト数（関数名4 + 命令数4）
+#define RECORD_HEADER_SIZE 8
+
+// キャッシュを置くディレクトリ（NULLならキャッシュしない）
+// コンパイル開始前に一度だけ設定し、以降は各スレッドから読むだけ
+static const char *cache_dir = NULL;
+
+// コンパイラ自身を識別するハッシュ（版と実行ファイルの大きさ・更新時刻）
+// コンパイラを作り直したら翻訳単位・関数のキャッシュは使わない
+static uint64_t compiler_hash = 0;
+
+// キャッシュの利用状況
+// 一括コンパイルでは複数のスレッドから数える
+static atomic_long unit_hits = 0;
+static atomic_long unit_misses = 0;
+static atomic_long func_hits = 0;
+static atomic_long func_misses = 0;
+
+// コンパイル中の翻訳単位の名前（関数のキャッシュファイルを選ぶのに使う）
+// 複数の翻訳単位を並列にコンパイルできるよう、スレッドごとに持つ
+static _Thread_local const char *cache_unit = NULL;
+
+// 関数のキャッシュの一項目
+typedef struct
+{
+    uint64_t key;
+    uint32_t offset;     // 読み込んだキャッシュファイル上の位置
+    uint32_t size;       // 読み込んだキャッシュファイル上の長さ
+    const AsmFunc *func; // 書き出す関数（今回のコンパイル結果の場合）
+} FuncEntry;
+
+// 翻訳単位一つ分の関数のキャッシュ
+// 前回のコンパイル結果を読み込んで引き、今回の結果で置き換える
+//
+// キャッシュファイルの形式（整数はリトルエンディアン）
+//   "SHCP" 版 sizeof(Ins) 関数の数 文字列表の位置
+//   索引: (キー 位置 長さ) * 関数の数（キーの昇順）
+//   関数: 関数名 命令数 Ins * 命令数（8バイト境界に置く）
+//   文字列表: NUL終端の文字列を並べたもの
+// 命令列はメモリ上の形のまま置き、文字列へのポインタの代わりに文字列表上の位置+1（0はNULL）を入れる
+// 読み込み時にポインタへ直すだけで、命令列はコピーせずそのまま使う
+struct FuncCache
+{
+    char path[4096];  // キャッシュファイルのパス
+    uint8_t *data;    // 読み込んだキャッシュファイル（コード生成用のアリーナ上）
+    size_t len;
+    FuncEntry *index; // dataの索引（キーの昇順）
+    uint32_t num_index;
+
+    FuncEntry *entries; // 今回のコンパイル結果
+    int num_entries;
+    int capacity;
+    int num_misses; // キャッシュになかった関数の数
+};
+
+// FNV-1aでハッシュ値を更新する
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// キャッシュの有効化
+// ディレクトリがなければ作成する
+void cache_init(const char *dir)
+{
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        perror(dir);
+        exit(1);
+    }
+
+    cache_dir = dir;
+
+    uint32_t version = CACHE_VERSION;
+    compiler_hash = hash_bytes(HASH_INIT, &version, sizeof(version));
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0)
+    {
+        compiler_hash = hash_bytes(compiler_hash, &st.st_size, sizeof(st.st_size));
+        compiler_hash = hash_bytes(compiler_hash, &st.st_mtim, sizeof(st.st_mtim));
+    }
+}
+
+// キャッシュが有効か
+bool cache_enabled(void)
+{
+    return cache_dir != NULL;
+}
+
+// 翻訳単位の名前を設定する
+// 入力ファイルのパスなど、再コンパイルで同じになる名前を与える
+void cache_set_unit(const char *unit)
+{
+    cache_unit = unit;
+}
+
+// ファイル全体をコード生成用のアリーナへ読み込む
+// 読み込んだ命令列を出力まで使うので、アリーナと一緒に解放する
+// 存在しない場合はNULLを返す
+static uint8_t *read_cache_file(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    uint8_t *buf = NULL;
+    long size = -1;
+    if (fseek(fp, 0, SEEK_END) == 0)
+    {
+        size = ftell(fp);
+    }
+    if (size > 0 && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        buf = arena_alloc(ARENA_CODEGEN, size);
+        mem_count(MEM_CODEGEN, size, 1);
+        if (fread(buf, 1, size, fp) != (size_t)size)
+        {
+            buf = NULL;
+        }
+    }
+    fclose(fp);
+
+    *len = size;
+    return buf;
+}
+
+// バッファの内容をキャッシュファイルへ書き出す
+// 同じファイルを並行して書いても壊れないよう、一時ファイルに書いてから置き換える
+// キャッシュは必須ではないので、書けなかった場合は何もしない
+static void write_cache_file(const char *path, const Buffer *buf)
+{
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s/tmp.XXXXXX", cache_dir);
+
+    int fd = mkstemp(tmp);
+    if (fd < 0)
+    {
+        return;
+    }
+    fchmod(fd, 0644);
+
+    bool ok = write(fd, buf->data, buf->len) == (ssize_t)buf->len;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0)
+    {
+        unlink(tmp);
+    }
+}
+
+// 指定した位置の整数を読む（リトルエンディアン）
+static uint64_t read_uint(const uint8_t *p, int size)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        value |= (uint64_t)p[i] << (i * 8);
+    }
+
+    return value;
+}
+
+// 索引の項目のキーの比較
+static int compare_entry(const void *a, const void *b)
+{
+    uint64_t x = ((const FuncEntry *)a)->key;
+    uint64_t y = ((const FuncEntry *)b)->key;
+    return (x > y) - (x < y);
+}
+
+// 文字列表上の位置をポインタへ直す
+// 範囲外ならfalseを返す
+static bool resolve_sym(const FuncCache *cache, size_t strtab, const char **sym)
+{
+    uintptr_t pos = (uintptr_t)*sym;
+    if (pos == 0)
+    {
+        return true;
+    }
+    if (pos - 1 >= cache->len - strtab)
+    {
+        return false;
+    }
+
+    *sym = (const char *)cache->data + strtab + pos - 1;
+    return true;
+}
+
+// オペランドを検査し、文字列をポインタへ直す
+static bool resolve_operand(const FuncCache *cache, size_t strtab, Operand *opd)
+{
+    return opd->kind <= OPD_LABEL && opd->reg < NUM_REGS && resolve_sym(cache, strtab, &opd->sym);
+}
+
+// 関数一つ分を検査し、文字列をポインタへ直す
+static bool resolve_record(const FuncCache *cache, size_t strtab, const FuncEntry *e)
+{
+    uint8_t *p = cache->data + e->offset;
+    if (e->offset % 8 != 0 || e->size < RECORD_HEADER_SIZE || e->offset + e->size > strtab)
+    {
+        return false;
+    }
+
+    uint32_t name = read_uint(p, 4);
+    uint32_t count = read_uint(p + 4, 4);
+    if (name == 0 || name - 1 >= cache->len - strtab || (e->size - RECORD_HEADER_SIZE) / sizeof(Ins) != count)
+    {
+        return false;
+    }
+
+    Ins *ins = (Ins *)(p + RECORD_HEADER_SIZE);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (ins[i].op >= NUM_OPS ||
+            !resolve_operand(cache, strtab, &ins[i].dst) ||
+            !resolve_operand(cache, strtab, &ins[i].src))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// キャッシュファイルの索引を読み、命令列の文字列をポインタへ直す
+// 壊れている場合はfalseを返す
+static bool read_index(FuncCache *cache)
+{
+    const uint8_t *p = cache->data;
+    // 文字列表は末尾がNUL終端になっていること
+    if (cache->len < 20 || memcmp(p, FUNC_PACK_MAGIC, 4) != 0 || cache->data[cache->len - 1] != '\0')
+    {
+        return false;
+    }
+    if (read_uint(p + 4, 4) != CACHE_VERSION || read_uint(p + 8, 4) != sizeof(Ins))
+    {
+        return false;
+    }
+
+    uint32_t n = read_uint(p + 12, 4);
+    size_t strtab = read_uint(p + 16, 4);
+    if (strtab > cache->len || n > (strtab - 20) / INDEX_ENTRY_SIZE)
+    {
+        return false;
+    }
+
+    cache->index = malloc((n + 1) * sizeof(FuncEntry));
+    cache->num_index = n;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const uint8_t *q = p + 20 + i * INDEX_ENTRY_SIZE;
+        FuncEntry *e = &cache->index[i];
+        e->key = read_uint(q, 8);
+        e->offset = read_uint(q + 8, 4);
+        e->size = read_uint(q + 12, 4);
+        if (!resolve_record(cache, strtab, e))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// 関数のキャッシュを開く
+// 前回のコンパイル結果があれば読み込む。キャッシュが無効ならNULLを返す
+FuncCache *cache_open_funcs(void)
+{
+    if (cache_dir == NULL)
+    {
+        return NULL;
+    }
+
+    FuncCache *cache = calloc(1, sizeof(FuncCache));
+    const char *unit = cache_unit != NULL ? cache_unit : "-";
+    uint64_t unit_key = hash_bytes(HASH_INIT, unit, strlen(unit));
+    snprintf(cache->path, sizeof(cache->path), "%s/%016llx.fn", cache_dir, (unsigned long long)unit_key);
+
+    cache->data = read_cache_file(cache->path, &cache->len);
+    if (cache->data != NULL && !read_index(cache))
+    {
+        // 壊れているキャッシュは使わない
+        cache->num_index = 0;
+    }
+
+    return cache;
+}
+
+// 関数の命令列をキャッシュから取り出し、作成中の関数の命令列とする
+// キャッシュにない場合はfalseを返す
+// 複数のスレッドから同時に呼んでよい
+bool cache_load_func(const FuncCache *cache, uint64_t key, const char *name)
+{
+    if (cache == NULL || cache->num_index == 0)
+    {
+        return false;
+    }
+
+    FuncEntry target = {.key = key};
+    const FuncEntry *e = bsearch(&target, cache->index, cache->num_index, sizeof(FuncEntry), compare_entry);
+    if (e == NULL)
+    {
+        return false;
+    }
+
+    // ハッシュの衝突に備えて関数名も確かめる
+    const uint8_t *p = cache->data + e->offset;
+    size_t strtab = read_uint(cache->data + 16, 4);
+    if (strcmp((const char *)cache->data + strtab + read_uint(p, 4) - 1, name) != 0)
+    {
+        return false;
+    }
+
+    emit_use_instructions((Ins *)(p + RECORD_HEADER_SIZE), read_uint(p + 4, 4));
+    return true;
+}
+
+// 今回のコンパイル結果の関数を登録する
+// hitはその関数をキャッシュから取り出したか
+void cache_add_func(FuncCache *cache, uint64_t key, const AsmFunc *func, bool hit)
+{
+    if (cache->num_entries == cache->capacity)
+    {
+        cache->capacity = cache->capacity == 0 ? 64 : cache->capacity * 2;
+        cache->entries = realloc(cache->entries, cache->capacity * sizeof(FuncEntry));
+    }
+
+    cache->entries[cache->num_entries++] = (FuncEntry){.key = key, .func = func};
+    if (!hit)
+    {
+        cache->num_misses++;
+    }
+    atomic_fetch_add(hit ? &func_hits : &func_misses, 1);
+}
+
+// 文字列を文字列表へ登録し、位置+1を返す（NULLなら0）
+static uintptr_t intern_sym(Map *syms, Buffer *strtab, const char *sym)
+{
+    if (sym == NULL)
+    {
+        return 0;
+    }
+
+    int pos = map_geti(syms, sym);
+    if (pos == 0)
+    {
+        pos = strtab->len + 1;
+        buf_push(strtab, sym, strlen(sym) + 1);
+        map_puti(syms, sym, pos);
+    }
+
+    return pos;
+}
+
+// オペランドを書き出す形にする
+// 構造体の詰め物に不定な値が残らないよう、項目ごとに設定する
+static void pack_operand(Operand *dst, const Operand *src, Map *syms, Buffer *strtab)
+{
+    memset(dst, 0, sizeof(Operand));
+    dst->kind = src->kind;
+    dst->reg = src->reg;
+    dst->imm = src->imm;
+    dst->sym = (const char *)intern_sym(syms, strtab, src->sym);
+}
+
+// 関数のキャッシュを閉じる
+// 前回から変わった関数があれば、今回のコンパイル結果でキャッシュファイルを置き換える
+void cache_close_funcs(FuncCache *cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    if (cache->num_misses > 0 || (uint32_t)cache->num_entries != cache->num_index)
+    {
+        qsort(cache->entries, cache->num_entries, sizeof(FuncEntry), compare_entry);
+
+        Buffer *buf = new_buffer_in(ARENA_CODEGEN);
+        Buffer *strtab = new_buffer_in(ARENA_CODEGEN);
+        Map *syms = new_map_in(ARENA_CODEGEN);
+
+        buf_push(buf, FUNC_PACK_MAGIC, 4);
+        buf_push_u32(buf, CACHE_VERSION);
+        buf_push_u32(buf, sizeof(Ins));
+        buf_push_u32(buf, cache->num_entries);
+        buf_push_u32(buf, 0); // 文字列表の位置は最後に埋める
+        size_t index_pos = buf->len;
+        for (int i = 0; i < cache->num_entries; i++)
+        {
+            buf_push_u64(buf, cache->entries[i].key);
+            buf_push_u64(buf, 0);
+        }
+
+        for (int i = 0; i < cache->num_entries; i++)
+        {
+            const AsmFunc *func = cache->entries[i].func;
+
+            buf_align(buf, 8, 0);
+            uint32_t pos[2] = {buf->len, RECORD_HEADER_SIZE + func->len * sizeof(Ins)};
+            buf_push_u32(buf, intern_sym(syms, strtab, func->name));
+            buf_push_u32(buf, func->len);
+            for (int j = 0; j < func->len; j++)
+            {
+                Ins ins;
+                memset(&ins, 0, sizeof(Ins));
+                ins.op = func->ins[j].op;
+                pack_operand(&ins.dst, &func->ins[j].dst, syms, strtab);
+                pack_operand(&ins.src, &func->ins[j].src, syms, strtab);
+                buf_push(buf, &ins, sizeof(Ins));
+            }
+
+            // 索引の位置と長さを埋める
+            memcpy(buf->data + index_pos + i * INDEX_ENTRY_SIZE + 8, pos, sizeof(pos));
+        }
+
+        uint32_t strtab_pos = buf->len;
+        memcpy(buf->data + 16, &strtab_pos, sizeof(strtab_pos));
+        buf_push(buf, strtab->data, strtab->len);
+        // 関数がなくても末尾はNUL終端にしておく
+        buf_push_byte(buf, '\0');
+
+        write_cache_file(cache->path, buf);
+    }
+
+    free(cache->entries);
+    free(cache->index);
+    free(cache);
+}
+
+// 関数のキャッシュのキー
+// 定義のハッシュに、コンパイラ自身と最適化レベル（違えば命令列も違う）を加えて作る
+uint64_t cache_func_key(uint64_t func_hash, int opt_level)
+{
+    uint64_t hash = hash_bytes(compiler_hash, &func_hash, sizeof(func_hash));
+    return hash_bytes(hash, &opt_level, sizeof(opt_level));
+}
+
+// 翻訳単位のキャッシュのキー
+// ソースコードと、出力に影響するオプション（-cなど）から作る
+uint64_t cache_unit_key(const char *source, const char *options)
+{
+    uint64_t hash = hash_bytes(compiler_hash, options, strlen(options) + 1);
+    return hash_bytes(hash, source, strlen(source));
+}
+
+// 翻訳単位のコンパイル結果をキャッシュから取り出し、pathへ書き出す
+// extは出力の拡張子（.sか.o）。キャッシュにない場合はfalseを返す
+bool cache_load_unit(uint64_t key, const char *ext, const char *path)
+{
+    if (cache_dir == NULL)
+    {
+        return false;
+    }
+
+    char file[4096];
+    snprintf(file, sizeof(file), "%s/%016llx%s", cache_dir, (unsigned long long)key, ext);
+
+    size_t len;
+    uint8_t *data = read_cache_file(file, &len);
+    if (data == NULL)
+    {
+        atomic_fetch_add(&unit_misses, 1);
+        return false;
+    }
+
+    atomic_fetch_add(&unit_hits, 1);
+    emit_write_bytes(path, data, len);
+    return true;
+}
+
+// 直前に書き出したコンパイル結果を翻訳単位のキャッシュへ保存する
+void cache_store_unit(uint64_t key, const char *ext)
+{
+    if (cache_dir == NULL)
+    {
+        return;
+    }
+
+    char file[4096];
+    snprintf(file, sizeof(file), "%s/%016llx%s", cache_dir, (unsigned long long)key, ext);
+    write_cache_file(file, emit_output());
+}
+
+// キャッシュの利用状況の表示
+// 出力は標準エラー出力
+void cache_stats_print(void)
+{
+    long hits = atomic_load(&unit_hits);
+    long misses = atomic_load(&unit_misses);
+    long fhits = atomic_load(&func_hits);
+    long fmisses = atomic_load(&func_misses);
+
+    fprintf(stderr, "Cache stats:\n");
+    fprintf(stderr, "  %-16s %10s %10s %10s\n", "", "hits", "misses", "hit rate");
+    fprintf(stderr, "  %-16s %10ld %10ld %9.1f%%\n", "translation unit", hits, misses,
+            hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+    fprintf(stderr, "  %-16s %10ld %10ld %9.1f%%\n", "function", fhits, fmisses,
+            fhits + fmisses > 0 ? 100.0 * fhits / (fhits + fmisses) : 0.0);
+}
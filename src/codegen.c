@@ -5,63 +5,80 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "shcc.h"
 
-static void gen_asm_expr(Node *node);
-static void gen_asm_stmt(Node *node);
+static void gen_asm_expr(const Ast *ast, NodeId id);
+static bool gen_asm_stmt(const Ast *ast, NodeId id);
 
 // 条件分岐などで連番を作成するために使用する
-static int global_label_no = 0;
+// ラベルは関数ごとの名前空間なので、関数の先頭で0に戻す
+static _Thread_local int func_label_no = 0;
 
-// スタックのpush/popで移動する量
-static const int STACK_UNIT = 8;
+// 関数内で値を読むローカル変数（オフセット/STACK_UNITで引く）
+// 読まれない変数への格納は出力しない
+static _Thread_local bool *read_slots = NULL;
+static _Thread_local int num_read_slots = 0;
 
-// 引数に使うレジスタ
-static const char *arg_regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+// 一つのワーカースレッドが受け持つ最小の関数の数
+// これより関数が少なければスレッドを起動するよりも逐次処理した方が速い
+#define MIN_FUNCS_PER_JOB 16
 
-// プロローグアセンブリ出力
-void gen_asm_prologue(void)
+// 関数一つ分のコード生成
+typedef struct
 {
-    // アセンブリ 前半出力
-    printf(".intel_syntax noprefix\n");
-    printf("# body start\n");
-}
-
-// エピローグアセンブリ出力
-void gen_asm_epilog(void)
+    FuncInfo *func; // 対象の関数
+    AsmFunc *out;   // 出力先
+    uint64_t key;   // キャッシュのキー（キャッシュしないなら0）
+    bool cached;    // キャッシュの命令列を使ったか
+} FuncJob;
+
+// 並列コード生成の作業キュー
+typedef struct
 {
-    printf("# body end\n");
-}
+    const Ast *ast;
+    const FuncCache *cache; // 関数のキャッシュ（無効ならNULL）
+    int opt_level;          // 最適化レベル（0ならスタックマシン、1以上ならレジスタ割り当て）
+    FuncJob *jobs;
+    int num_jobs;
+    atomic_int next; // 次に処理するジョブ
+} JobQueue;
+
+// スタックのpush/popで移動する量
+static const int STACK_UNIT = 8;
+
+// 引数に使うレジスタ
+static const Register_t arg_regs[] = {REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9};
 
 // 関数プロローグ
 static void gen_asm_func_head(FuncInfo *func)
 {
-    puts("");
-    printf(".text\n");
-    printf(".global %s\n", func->name);
-    printf("%s:\n", func->name);
+    func_label_no = 0;
 
     // 呼び出し元のベースポインタを保存
-    printf("  # function prologue begin\n");
-    printf("  push rbp\n");
-    printf("  mov rbp, rsp\n");
+    emit_comment("function prologue begin");
+    emit_ins_r(OP_PUSH, REG_RBP);
+    emit_ins_rr(OP_MOV, REG_RBP, REG_RSP);
 
     // 引数の個数チェック
-    assert(func->args->len <= NUMOF(arg_regs));
+    assert(func->num_args <= NUMOF(arg_regs));
 
     // 引数をスタックに展開
     int args_stack = STACK_UNIT;
-    for (int i = 0; i < func->args->len; i++)
+    for (int i = 0; i < func->num_args; i++, args_stack += STACK_UNIT)
     {
-        // map_puti(vars, func->args->data[i], stack_offset);
+        // 読まれない引数は格納しない
+        if (!read_slots[i])
+        {
+            continue;
+        }
 
         // ベースポインタとのオフセットを算出し、引数レジスタの値をオフセット位置へ格納する
-        printf("  mov rax, rbp\n");
-        printf("  sub rax, %d\n", args_stack);
-        printf("  mov [rax], %s\n", arg_regs[i]);
-
-        args_stack += STACK_UNIT;
+        emit_ins_rr(OP_MOV, REG_RAX, REG_RBP);
+        emit_ins_ri(OP_SUB, REG_RAX, args_stack);
+        emit_ins_mr(OP_MOV, REG_RAX, 0, arg_regs[i]);
     }
 
     // ここですでにこの関数が使用する最大のスタックサイズが分かるようになった(はず)ので
@@ -73,31 +90,27 @@ static void gen_asm_func_head(FuncInfo *func)
     // 関数呼び出し時は16Bアラインされている必要があるので、ここで合わせておく
     shift_stack_size = ((shift_stack_size + (16 - 1)) / 16) * 16;
 
-    printf("  sub rsp, %d\t\t# stack evacuation\n", shift_stack_size); // スタック待避
-    printf("  # function prologue end\n");
-    puts("");
+    emit_ins_ri(OP_SUB, REG_RSP, shift_stack_size); // スタック待避
+    emit_comment("function prologue end");
 }
 
 // 関数エピローグ
 static void gen_asm_func_tail(void)
 {
     // 呼び出し元のベースポインタを復帰
-    printf("  # function epilog begin\n");
-    printf("  leave\n");
+    emit_comment("function epilog begin");
+    emit_ins(OP_LEAVE);
     // 下記はleaveと等価なコード
-    // printf("  mov rsp, rbp\n");
-    // printf("  pop rbp\n");
-    printf("  ret\n");
-    printf("  # function epilog end\n");
-    puts("");
+    // mov rsp, rbp
+    // pop rbp
+    emit_ins(OP_RET);
+    emit_comment("function epilog end");
 }
 
 // ノード解析失敗エラー
 static void error(const char *msg)
 {
-    fprintf(stderr, "%s\n", msg);
-
-    exit(1);
+    compile_error("%s", msg);
 }
 
 // 左辺値のアセンブリ出力
@@ -106,14 +119,14 @@ static void gen_asm_lval(VariableInfo *variable)
 {
     if (variable->is_global)
     {
-        printf("  lea rax, %s[rip]\n", variable->name);
-        printf("  push rax\t\t# Address('%s')\n", variable->name);
+        emit_ins_rsym(OP_LEA, REG_RAX, variable->name);
+        emit_ins_r(OP_PUSH, REG_RAX);
     }
     else
     {
-        printf("  mov rax, rbp\n");
-        printf("  sub rax, %d\n", variable->offset + STACK_UNIT);
-        printf("  push rax\t\t# Address('%s') = [RBP-%d]\n", variable->name, variable->offset + STACK_UNIT);
+        emit_ins_rr(OP_MOV, REG_RAX, REG_RBP);
+        emit_ins_ri(OP_SUB, REG_RAX, variable->offset + STACK_UNIT);
+        emit_ins_r(OP_PUSH, REG_RAX);
     }
 }
 
@@ -122,7 +135,7 @@ static void gen_asm_lval(VariableInfo *variable)
 static void gen_asm_lvardef(VariableInfo *variable)
 {
     assert(!variable->is_global);
-    printf("  # New variable '%s' = [RBP-%d]\n", variable->name, variable->offset + STACK_UNIT);
+    emit_comment_var(variable->name, variable->offset + STACK_UNIT);
     // 関数の先頭で一括スタック待避しているのでここでは実際の操作は行なわない
 }
 
@@ -131,97 +144,108 @@ static void gen_asm_gvardef(VariableInfo *variable)
 {
     assert(variable->is_global);
 
-    printf(".global %s\n", variable->name);
-    // 今は明示的な初期化のない変数しかないので
-    printf(".data\n");
-    printf(".align %d\n", STACK_UNIT);
-    printf(".size %s, %d\n", variable->name, STACK_UNIT);
-    printf("%s:\n", variable->name);
-    // とりあえずスタックサイズを確保してゼロクリア
-    printf("  .zero %d\n", STACK_UNIT);
-    puts("");
+    // 実際の領域確保は出力時に行う
+    emit_global_variable(variable->name);
 }
 
 // 関数呼び出しのアセンブリ出力
-static void gen_asm_func_call(FuncInfo *func)
+static void gen_asm_func_call(const Ast *ast, const FuncInfo *func)
 {
     // 関数呼び出し
     // 今はとりあえず上限までレジスタ格納しておく
 
     // 引数の個数チェック
-    assert(func->args->len <= NUMOF(arg_regs));
+    assert(func->num_args <= NUMOF(arg_regs));
 
     // 引数の数
-    if (func->args->len > 0)
+    if (func->num_args > 0)
     {
-        printf("  mov rax, %d\n", func->args->len);
+        emit_ins_ri(OP_MOV, REG_RAX, func->num_args);
     }
 
     // 一度すべての計算結果をスタックに積む
-    for (int i = (int)func->args->len - 1; i >= 0; i--)
+    const NodeId *args = ast_list(ast, func->args);
+    for (int i = func->num_args - 1; i >= 0; i--)
     {
-        gen_asm_expr(func->args->data[i]);
+        gen_asm_expr(ast, args[i]);
     }
     // スタックから取り出しながら引数レジスタに格納する
-    for (int i = 0; i < func->args->len; i++)
+    for (int i = 0; i < func->num_args; i++)
     {
-        printf("  pop %s\n", arg_regs[i]);
+        emit_ins_r(OP_POP, arg_regs[i]);
     }
 
-    printf("  call %s\n", func->name);
+    emit_ins_sym(OP_CALL, func->name);
 
     // 戻り値
-    printf("  push rax\n");
+    emit_ins_r(OP_PUSH, REG_RAX);
 }
 
 // 式のアセンブリ出力
 // 式の結果をpush
-static void gen_asm_expr(Node *node)
+static void gen_asm_expr(const Ast *ast, NodeId id)
 {
+    const Node *node = ast_node(ast, id);
+
     switch (node->ty)
     {
     case ND_NUM:
     {
-        printf("  push %d\n", node->value);
+        emit_ins_i(OP_PUSH, node->value);
         return;
     }
     case ND_CALL:
     {
-        gen_asm_func_call(node->func);
+        gen_asm_func_call(ast, ast_func(ast, node->func));
         return;
     }
     case ND_ASSIGN:
     {
         // 代入式なら、必ず左辺は変数
-        gen_asm_lval(node->lhs->variable);
-        gen_asm_expr(node->rhs);
-        printf("  pop rdi\n");
-        printf("  pop rax\n");
-        printf("  mov [rax], rdi\n");
-        printf("  push rdi\n");
+        VariableInfo *variable = ast_variable(ast, ast_node(ast, node->lhs)->variable);
+        if (!variable->is_global && !read_slots[variable->offset / STACK_UNIT])
+        {
+            // 読まれない変数なので右辺の値を式の結果とするだけ
+            gen_asm_expr(ast, node->rhs);
+            return;
+        }
+        gen_asm_lval(variable);
+        gen_asm_expr(ast, node->rhs);
+        emit_ins_r(OP_POP, REG_RDI);
+        emit_ins_r(OP_POP, REG_RAX);
+        emit_ins_mr(OP_MOV, REG_RAX, 0, REG_RDI);
+        emit_ins_r(OP_PUSH, REG_RDI);
         return;
     }
     case ND_VARIABLE:
     {
         // ここは右辺値の識別子
         // 一度左辺値としてpushした値をpopして使う
-        gen_asm_lval(node->variable);
-        printf("  pop rax\n");
-        printf("  mov rax, [rax]\n");
-        printf("  push rax\n");
+        gen_asm_lval(ast_variable(ast, node->variable));
+        emit_ins_r(OP_POP, REG_RAX);
+        emit_ins_rm(OP_MOV, REG_RAX, REG_RAX, 0);
+        emit_ins_r(OP_PUSH, REG_RAX);
         return;
     }
     case ND_ADDR:
     {
-        gen_asm_lval(node->lhs->variable);
+        gen_asm_lval(ast_variable(ast, ast_node(ast, node->lhs)->variable));
         return;
     }
     case ND_DEREF:
     {
-        gen_asm_expr(node->lhs);
-        printf("  pop rax\n");
-        printf("  mov rax, [rax]\n");
-        printf("  push rax\n");
+        gen_asm_expr(ast, node->lhs);
+        emit_ins_r(OP_POP, REG_RAX);
+        emit_ins_rm(OP_MOV, REG_RAX, REG_RAX, 0);
+        emit_ins_r(OP_PUSH, REG_RAX);
+        return;
+    }
+    case ND_NEG:
+    {
+        gen_asm_expr(ast, node->lhs);
+        emit_ins_r(OP_POP, REG_RAX);
+        emit_ins_r(OP_NEG, REG_RAX);
+        emit_ins_r(OP_PUSH, REG_RAX);
         return;
     }
     default:
@@ -230,85 +254,85 @@ static void gen_asm_expr(Node *node)
     }
     }
 
-    gen_asm_expr(node->lhs);
-    gen_asm_expr(node->rhs);
+    gen_asm_expr(ast, node->lhs);
+    gen_asm_expr(ast, node->rhs);
 
-    printf("  pop rdi\n"); // 右辺の値
-    printf("  pop rax\n"); // 左辺の値
+    emit_ins_r(OP_POP, REG_RDI); // 右辺の値
+    emit_ins_r(OP_POP, REG_RAX); // 左辺の値
 
     switch (node->ty)
     {
     case ND_PLUS:
     {
-        printf("  add rax, rdi\n");
+        emit_ins_rr(OP_ADD, REG_RAX, REG_RDI);
         break;
     }
     case ND_MINUS:
     {
-        printf("  sub rax, rdi\n");
+        emit_ins_rr(OP_SUB, REG_RAX, REG_RDI);
         break;
     }
     case ND_MUL:
     {
-        printf("  mul rdi\n");
+        emit_ins_r(OP_MUL, REG_RDI);
         break;
     }
     case ND_DIV:
     {
         // div命令は rax =  ((rdx << 64) | rax) / rdi
-        printf("  mov rdx, 0\n");
-        printf("  div rdi\n");
+        emit_ins_ri(OP_MOV, REG_RDX, 0);
+        emit_ins_r(OP_DIV, REG_RDI);
         break;
     }
     case ND_MOD:
     {
         // div命令は rax =  ((rdx << 64) | rax) / rdi
-        printf("  mov rdx, 0\n");
-        printf("  div rdi\n");
-        printf("  mov rax, rdx\n");
+        emit_ins_ri(OP_MOV, REG_RDX, 0);
+        emit_ins_r(OP_DIV, REG_RDI);
+        emit_ins_rr(OP_MOV, REG_RAX, REG_RDX);
         break;
     }
 
     case ND_EQ:
     {
-        printf("  cmp rax, rdi\n");
-        printf("  sete al\n");
-        printf("  movzb rax, al\n");
+        emit_ins_rr(OP_CMP, REG_RAX, REG_RDI);
+        emit_ins_r(OP_SETE, REG_AL);
+        emit_ins_rr(OP_MOVZB, REG_RAX, REG_AL);
         break;
     }
     case ND_NEQ:
     {
-        printf("  cmp rax, rdi\n");
-        printf("  setne al\n");
-        printf("  movzb rax, al\n");
+        emit_ins_rr(OP_CMP, REG_RAX, REG_RDI);
+        emit_ins_r(OP_SETNE, REG_AL);
+        emit_ins_rr(OP_MOVZB, REG_RAX, REG_AL);
         break;
     }
     case ND_LESS:
     {
-        printf("  cmp rax, rdi\n");
-        printf("  setl al\n");
-        printf("  movzb rax, al\n");
+        emit_ins_rr(OP_CMP, REG_RAX, REG_RDI);
+        emit_ins_r(OP_SETL, REG_AL);
+        emit_ins_rr(OP_MOVZB, REG_RAX, REG_AL);
         break;
     }
     case ND_LESS_EQ:
     {
-        printf("  cmp rax, rdi\n");
-        printf("  setle al\n");
-        printf("  movzb rax, al\n");
+        emit_ins_rr(OP_CMP, REG_RAX, REG_RDI);
+        emit_ins_r(OP_SETLE, REG_AL);
+        emit_ins_rr(OP_MOVZB, REG_RAX, REG_AL);
         break;
     }
     case ND_GREATER:
     {
-        printf("  cmp rax, rdi\n");
-        printf("  setg al\n");
-        printf("  movzb rax, al\n");
+        emit_ins_rr(OP_CMP, REG_RAX, REG_RDI);
+        emit_ins_r(OP_SETG, REG_AL);
+        emit_ins_rr(OP_MOVZB, REG_RAX, REG_AL);
         break;
     }
     case ND_GREATER_EQ:
     {
-        printf("  cmp rax, rdi\n");
-        printf("  setge al\n");
-        printf("  movzb rax, al\n");
+        emit_ins_rr(OP_CMP, REG_RAX, REG_RDI);
+        emit_ins_r(OP_SETGE, REG_AL);
+        emit_ins_rr(OP_MOVZB, REG_RAX, REG_AL);
         break;
     }
     default:
@@ -318,136 +342,317 @@ static void gen_asm_expr(Node *node)
     }
     }
 
-    printf("  push rax\n");
+    emit_ins_r(OP_PUSH, REG_RAX);
+}
+
+// 条件式が0以外の定数か
+static bool is_const_true(const Ast *ast, NodeId id)
+{
+    const Node *node = ast_node(ast, id);
+    return node->ty == ND_NUM && node->value != 0;
 }
 
 // 文のアセンブリ出力
-static void gen_asm_stmt(Node *node)
+// 文の後へ制御が進む（returnや無限ループで終わらない）ならtrueを返す
+// 制御が進まない文の後の文は出力しない
+static bool gen_asm_stmt(const Ast *ast, NodeId id)
 {
+    const Node *node = ast_node(ast, id);
+
     switch (node->ty)
     {
     case ND_BLOCK:
     {
-        for (int j = 0; node->block_stmts->data[j]; j++)
+        const NodeId *stmts = ast_list(ast, node->stmts);
+        for (int j = 0; j < node->num_stmts; j++)
         {
-            Node *stmt = (Node *)node->block_stmts->data[j];
-            gen_asm_stmt(stmt);
+            if (!gen_asm_stmt(ast, stmts[j]))
+            {
+                return false;
+            }
         }
-        return;
+        return true;
     }
     case ND_RETURN:
     {
-        gen_asm_expr(node->lhs);
-        printf("  pop rax\n");
+        gen_asm_expr(ast, node->lhs);
+        emit_ins_r(OP_POP, REG_RAX);
         gen_asm_func_tail();
-        return;
+        return false;
     }
     case ND_IF:
     {
-        int label_no = global_label_no++;
-        gen_asm_expr(node->condition);
-        printf("  pop rax\n");
-        printf("  cmp rax, 0\n");
-
-        // elseが無くてもラベルを作っている
-        // こちらの方がコードはスマートになる
-        printf("  je .Lelse%d\n", label_no);
-        gen_asm_stmt(node->then);
-        printf("  jmp .Lend%d\n", label_no);
-        printf(".Lelse%d:\n", label_no);
-        if (node->elsethen)
+        int label_no = func_label_no++;
+        gen_asm_expr(ast, node->condition);
+        emit_ins_r(OP_POP, REG_RAX);
+        emit_ins_ri(OP_CMP, REG_RAX, 0);
+
+        // elseが無ければ条件を満たさないときは後ろへ飛ぶだけ
+        if (!node->elsethen)
         {
-            gen_asm_stmt(node->elsethen);
+            emit_ins_label(OP_JE, "end", label_no);
+            gen_asm_stmt(ast, node->then);
+            emit_label("end", label_no);
+            return true;
         }
-        printf(".Lend%d:\n", label_no);
-        return;
+
+        emit_ins_label(OP_JE, "else", label_no);
+        bool then_reaches = gen_asm_stmt(ast, node->then);
+        if (then_reaches)
+        {
+            emit_ins_label(OP_JMP, "end", label_no);
+        }
+        emit_label("else", label_no);
+        bool else_reaches = gen_asm_stmt(ast, node->elsethen);
+        if (!then_reaches && !else_reaches)
+        {
+            return false;
+        }
+        emit_label("end", label_no);
+        return true;
     }
     case ND_FOR:
     {
-        int label_no = global_label_no++;
-        if (node->initializer)
+        int label_no = func_label_no++;
+        NodeId initializer = ast_list(ast, node->for_exprs)[0];
+        NodeId loopexpr = ast_list(ast, node->for_exprs)[1];
+        if (initializer)
         {
-            gen_asm_expr(node->initializer);
+            gen_asm_expr(ast, initializer);
             // 式の評価結果としてpushされた値が一つあるが、使わないのでここでpopする
-            printf("  pop rax\t\t# remove before expr result\n");
+            emit_ins_r(OP_POP, REG_RAX);
         }
-        printf(".Lbegin%d:\n", label_no);
-        if (node->condition)
+        emit_label("begin", label_no);
+        // 条件が無いか定数の真ならループを抜けない（breakは未対応）
+        bool exits = node->condition && !is_const_true(ast, node->condition);
+        if (exits)
         {
-            gen_asm_expr(node->condition);
-            printf("  pop rax\n");
-            printf("  cmp rax, 0\n");
-            printf("  je .Lend%d\n", label_no);
+            gen_asm_expr(ast, node->condition);
+            emit_ins_r(OP_POP, REG_RAX);
+            emit_ins_ri(OP_CMP, REG_RAX, 0);
+            emit_ins_label(OP_JE, "end", label_no);
         }
         // thenが無いとパースで失敗しているはず
-        gen_asm_stmt(node->then);
-        if (node->loopexpr)
+        if (gen_asm_stmt(ast, node->then))
         {
-            gen_asm_expr(node->loopexpr);
-            // 式の評価結果としてpushされた値が一つあるが、使わないのでここでpopする
-            printf("  pop rax\t\t# remove before expr result\n");
+            if (loopexpr)
+            {
+                gen_asm_expr(ast, loopexpr);
+                // 式の評価結果としてpushされた値が一つあるが、使わないのでここでpopする
+                emit_ins_r(OP_POP, REG_RAX);
+            }
+            emit_ins_label(OP_JMP, "begin", label_no);
         }
-        printf("  jmp .Lbegin%d\n", label_no);
-        printf(".Lend%d:\n", label_no);
-        return;
+        if (!exits)
+        {
+            return false;
+        }
+        emit_label("end", label_no);
+        return true;
     }
     case ND_WHILE:
     {
-        int label_no = global_label_no++;
-        printf(".Lbegin%d:\n", label_no);
-        gen_asm_expr(node->condition);
-        printf("  pop rax\n");
-        printf("  cmp rax, 0\n");
-        printf("  je .Lend%d\n", label_no);
-        gen_asm_stmt(node->then);
-        printf("  jmp .Lbegin%d\n", label_no);
-        printf(".Lend%d:\n", label_no);
-        return;
+        int label_no = func_label_no++;
+        emit_label("begin", label_no);
+        bool exits = !is_const_true(ast, node->condition);
+        if (exits)
+        {
+            gen_asm_expr(ast, node->condition);
+            emit_ins_r(OP_POP, REG_RAX);
+            emit_ins_ri(OP_CMP, REG_RAX, 0);
+            emit_ins_label(OP_JE, "end", label_no);
+        }
+        if (gen_asm_stmt(ast, node->then))
+        {
+            emit_ins_label(OP_JMP, "begin", label_no);
+        }
+        if (!exits)
+        {
+            return false;
+        }
+        emit_label("end", label_no);
+        return true;
     }
     case ND_VARDEF:
     {
         // 変数の領域確保
-        gen_asm_lvardef(node->variable);
+        gen_asm_lvardef(ast_variable(ast, node->variable));
+        return true;
+    }
+    case ND_STMT:
+    {
+        // 空文なので何も出力しない
+        return true;
+    }
+    default:
+    {
+        gen_asm_expr(ast, id);
+        // 式の評価結果としてpushされた値が一つあるが、使わないのでここでpopする
+        emit_ins_r(OP_POP, REG_RAX);
+        return true;
+    }
+    }
+}
+
+// 値を読むローカル変数をread_slotsに記録する
+// ローカル変数のアドレスを取る関数では、ポインタ経由でどの変数も読めるのですべて読まれるものとみなす
+static void mark_read_slots(const Ast *ast, NodeId id)
+{
+    if (id == NODE_NONE)
+    {
         return;
     }
+
+    const Node *node = ast_node(ast, id);
+    switch (node->ty)
+    {
+    case ND_NUM:
+    case ND_VARDEF:
     case ND_STMT:
+        return;
+    case ND_VARIABLE:
     {
-        // 空文なので何もしなくて良いはずだが、何もしないとここがきちんと処理されているか分からないので
-        // nopを出力する
-        printf("  nop\n");
+        const VariableInfo *variable = ast_variable(ast, node->variable);
+        if (!variable->is_global)
+        {
+            read_slots[variable->offset / STACK_UNIT] = true;
+        }
         return;
     }
+    case ND_ADDR:
+        if (!ast_variable(ast, ast_node(ast, node->lhs)->variable)->is_global)
+        {
+            memset(read_slots, true, num_read_slots * sizeof(bool));
+        }
+        return;
+    case ND_ASSIGN:
+        // 左辺の変数は読まない
+        mark_read_slots(ast, node->rhs);
+        return;
+    case ND_CALL:
+    {
+        const FuncInfo *func = ast_func(ast, node->func);
+        const NodeId *args = ast_list(ast, func->args);
+        for (int i = 0; i < func->num_args; i++)
+        {
+            mark_read_slots(ast, args[i]);
+        }
+        return;
+    }
+    case ND_BLOCK:
+    {
+        const NodeId *stmts = ast_list(ast, node->stmts);
+        for (int i = 0; i < node->num_stmts; i++)
+        {
+            mark_read_slots(ast, stmts[i]);
+        }
+        return;
+    }
+    case ND_IF:
+        mark_read_slots(ast, node->condition);
+        mark_read_slots(ast, node->then);
+        mark_read_slots(ast, node->elsethen);
+        return;
+    case ND_FOR:
+        mark_read_slots(ast, ast_list(ast, node->for_exprs)[0]);
+        mark_read_slots(ast, ast_list(ast, node->for_exprs)[1]);
+        mark_read_slots(ast, node->condition);
+        mark_read_slots(ast, node->then);
+        return;
+    case ND_WHILE:
+        mark_read_slots(ast, node->condition);
+        mark_read_slots(ast, node->then);
+        return;
     default:
+        mark_read_slots(ast, node->lhs);
+        mark_read_slots(ast, node->rhs);
+        return;
+    }
+}
+
+// 関数一つ分のアセンブリ出力
+// キャッシュが有効なら、定義が変わっていない関数はキャッシュの命令列を使う
+// ハッシュがない関数（キャッシュなしで作ったスナップショットなど）はキャッシュしない
+static void gen_asm_func(const JobQueue *queue, FuncJob *job)
+{
+    emit_select_function(job->out);
+    job->cached = job->key != 0 && cache_load_func(queue->cache, job->key, job->func->name);
+    if (job->cached)
     {
-        gen_asm_expr(node);
-        // 式の評価結果としてpushされた値が一つあるが、使わないのでここでpopする
-        printf("  pop rax\t\t# remove before expr result\n");
-        break;
+        return;
     }
+
+    if (queue->opt_level > 0)
+    {
+        IrFunc *ir = ir_build(queue->ast, job->func);
+        ir_optimize(ir);
+        regalloc_emit(lower_func(ir));
     }
+    else
+    {
+        num_read_slots = job->func->stack_size / STACK_UNIT + 1;
+        read_slots = arena_alloc(ARENA_CODEGEN, num_read_slots * sizeof(bool));
+        mem_count(MEM_CODEGEN, num_read_slots * sizeof(bool), 0);
+        memset(read_slots, false, num_read_slots * sizeof(bool));
+        mark_read_slots(queue->ast, job->func->body);
+
+        gen_asm_func_head(job->func);
+        // 末尾がreturnでなければ、最後に評価した値を戻り値として復帰する
+        if (gen_asm_stmt(queue->ast, job->func->body))
+        {
+            gen_asm_func_tail();
+        }
+    }
+    peephole_optimize(job->out);
+}
+
+// ワーカースレッド
+// キューから関数を取り出してなくなるまでコード生成する
+static void *gen_asm_worker(void *arg)
+{
+    JobQueue *queue = arg;
+
+    for (;;)
+    {
+        int i = atomic_fetch_add(&queue->next, 1);
+        if (i >= queue->num_jobs)
+        {
+            break;
+        }
+        gen_asm_func(queue, &queue->jobs[i]);
+    }
+
+    // 作成した命令列はメインスレッドのアリーナへ引き継ぐ
+    ArenaBlocks blocks = arena_detach(ARENA_CODEGEN);
+    mem_report_merge_thread();
+
+    return blocks;
 }
 
 // アセンブリ出力
-void gen_asm(Vector *code)
+// 関数ごとに最大jobs個のスレッドで並列にコード生成する
+// opt_levelが1以上なら、スタックマシンではなくIRを作ってレジスタ割り当てでコード生成する
+void gen_asm(const Ast *ast, int jobs, int opt_level)
 {
-    // プロローグ
-    gen_asm_prologue();
+    JobQueue queue = {.ast = ast, .opt_level = opt_level};
+    queue.jobs = arena_alloc(ARENA_CODEGEN, (ast->num_decls + 1) * sizeof(FuncJob));
+    mem_count(MEM_CODEGEN, (ast->num_decls + 1) * sizeof(FuncJob), 1);
 
-    // 先にdataセクションだけ書き出してもよいのだけれど、
-    // まあ不都合が出てきたら考える
-    for (int i = 0; code->data[i]; i++)
+    // 出力先は宣言順にここで作っておくので、どの順で生成しても出力は変わらない
+    const NodeId *decls = ast_list(ast, ast->decls);
+    for (int i = 0; i < ast->num_decls; i++)
     {
-        Node *node = code->data[i];
+        const Node *node = ast_node(ast, decls[i]);
 
         if (node->ty == ND_FUNCDEF)
         {
-            gen_asm_func_head(node->func);
-            gen_asm_stmt(node->func->body);
-            gen_asm_func_tail();
+            FuncInfo *func = ast_func(ast, node->func);
+            uint64_t key = func->hash != 0 ? cache_func_key(func->hash, opt_level) : 0;
+            queue.jobs[queue.num_jobs++] = (FuncJob){func, emit_new_function(func->name), key};
         }
         else if (node->ty == ND_VARDEF)
         {
-            gen_asm_gvardef(node->variable);
+            gen_asm_gvardef(ast_variable(ast, node->variable));
         }
         else
         {
@@ -455,6 +660,50 @@ void gen_asm(Vector *code)
         }
     }
 
-    // エピローグ
-    gen_asm_epilog();
+    int num_threads = queue.num_jobs / MIN_FUNCS_PER_JOB;
+    if (num_threads > jobs)
+    {
+        num_threads = jobs;
+    }
+
+    FuncCache *cache = cache_open_funcs();
+    queue.cache = cache;
+
+    if (num_threads <= 1)
+    {
+        for (int i = 0; i < queue.num_jobs; i++)
+        {
+            gen_asm_func(&queue, &queue.jobs[i]);
+        }
+    }
+    else
+    {
+        pthread_t *threads = arena_alloc(ARENA_CODEGEN, num_threads * sizeof(pthread_t));
+        for (int i = 0; i < num_threads; i++)
+        {
+            if (pthread_create(&threads[i], NULL, gen_asm_worker, &queue) != 0)
+            {
+                error("スレッドを作成できません");
+            }
+        }
+        for (int i = 0; i < num_threads; i++)
+        {
+            void *blocks;
+            pthread_join(threads[i], &blocks);
+            arena_attach(ARENA_CODEGEN, blocks);
+        }
+    }
+
+    // 今回の結果で関数のキャッシュを更新する
+    if (cache != NULL)
+    {
+        for (int i = 0; i < queue.num_jobs; i++)
+        {
+            if (queue.jobs[i].key != 0)
+            {
+                cache_add_func(cache, queue.jobs[i].key, queue.jobs[i].out, queue.jobs[i].cached);
+            }
+        }
+        cache_close_funcs(cache);
+    }
 }
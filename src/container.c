@@ -7,14 +7,35 @@
 
 #include "shcc.h"
 
+// 指定アリーナ（ARENA_NONEならヒープ）からの領域確保
+static void *container_alloc(ArenaKind_t arena, MemCategory_t category, size_t count, size_t size)
+{
+    mem_count(category, count * size, 1);
+
+    if (arena == ARENA_NONE)
+    {
+        return calloc(count, size);
+    }
+
+    return arena_alloc(arena, count * size);
+}
+
 // 新規vector作成
 Vector *new_vector(void)
 {
-    Vector *vec = calloc(1, sizeof(Vector));
+    return new_vector_in(ARENA_NONE);
+}
+
+// 新規vector作成
+// 要素の領域も含めて指定アリーナから確保する
+Vector *new_vector_in(ArenaKind_t arena)
+{
+    Vector *vec = container_alloc(arena, MEM_VECTORS, 1, sizeof(Vector));
 
-    vec->data = calloc(16, sizeof(void *));
+    vec->data = container_alloc(arena, MEM_VECTORS, 16, sizeof(void *));
     vec->capacity = 16;
     vec->len = 0;
+    vec->arena = arena;
 
     return vec;
 }
@@ -25,36 +46,204 @@ void vec_push(Vector *vec, void *elem)
 {
     if (vec->capacity == vec->len)
     {
+        size_t old_size = sizeof(void *) * vec->capacity;
         vec->capacity *= 2;
-        vec->data = realloc(vec->data, sizeof(void *) * vec->capacity);
+        mem_count(MEM_VECTORS, old_size, 0);
+
+        if (vec->arena == ARENA_NONE)
+        {
+            vec->data = realloc(vec->data, sizeof(void *) * vec->capacity);
+        }
+        else
+        {
+            vec->data = arena_realloc(vec->arena, vec->data, old_size, sizeof(void *) * vec->capacity);
+        }
     }
 
     vec->data[vec->len++] = elem;
 }
 
+// マップの初期容量（2のべき乗であること）
+#define MAP_INITIAL_CAPACITY 16
+
+// 文字列のハッシュ値（FNV-1a）
+static uint32_t hash_string(const char *key, int len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// 長さlenのkeyが格納されている、または格納すべきスロットを探す
+// オープンアドレス法（線形探査）なので、空きスロットに当たれば未登録
+static int map_find_slot(const Map *map, const char *key, int len)
+{
+    uint32_t mask = (uint32_t)map->capacity - 1;
+
+    for (uint32_t i = hash_string(key, len) & mask;; i = (i + 1) & mask)
+    {
+        const char *k = map->keys[i];
+        if (k == NULL || (strncmp(k, key, len) == 0 && k[len] == '\0'))
+        {
+            return (int)i;
+        }
+    }
+}
+
+// テーブルを2倍に拡張して再配置する
+static void map_grow(Map *map)
+{
+    const char **old_keys = map->keys;
+    void **old_vals = map->vals;
+    int old_capacity = map->capacity;
+
+    map->capacity *= 2;
+    map->keys = container_alloc(map->arena, MEM_MAPS, map->capacity, sizeof(char *));
+    map->vals = container_alloc(map->arena, MEM_MAPS, map->capacity, sizeof(void *));
+
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (old_keys[i] != NULL)
+        {
+            int slot = map_find_slot(map, old_keys[i], strlen(old_keys[i]));
+            map->keys[slot] = old_keys[i];
+            map->vals[slot] = old_vals[i];
+        }
+    }
+
+    // アリーナ上の古い領域はアリーナごと解放される
+    if (map->arena == ARENA_NONE)
+    {
+        free(old_keys);
+        free(old_vals);
+    }
+}
+
+// 新規バイト列作成
+Buffer *new_buffer_in(ArenaKind_t arena)
+{
+    Buffer *buf = container_alloc(arena, MEM_CODEGEN, 1, sizeof(Buffer));
+    buf->arena = arena;
+
+    return buf;
+}
+
+// バイト列への追加
+// 空きがなければ2倍に拡張する
+void buf_push(Buffer *buf, const void *data, size_t len)
+{
+    if (buf->len + len > buf->capacity)
+    {
+        size_t capacity = buf->capacity == 0 ? 256 : buf->capacity;
+        while (buf->len + len > capacity)
+        {
+            capacity *= 2;
+        }
+        mem_count(MEM_CODEGEN, capacity - buf->capacity, 0);
+
+        if (buf->arena == ARENA_NONE)
+        {
+            buf->data = realloc(buf->data, capacity);
+        }
+        else
+        {
+            buf->data = arena_realloc(buf->arena, buf->data, buf->capacity, capacity);
+        }
+        buf->capacity = capacity;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+// バイト列への1バイト追加
+void buf_push_byte(Buffer *buf, uint8_t value)
+{
+    buf_push(buf, &value, 1);
+}
+
+// バイト列への2バイト追加（リトルエンディアン）
+void buf_push_u16(Buffer *buf, uint16_t value)
+{
+    uint8_t bytes[2] = {value, value >> 8};
+    buf_push(buf, bytes, sizeof(bytes));
+}
+
+// バイト列への4バイト追加（リトルエンディアン）
+void buf_push_u32(Buffer *buf, uint32_t value)
+{
+    buf_push_u16(buf, value);
+    buf_push_u16(buf, value >> 16);
+}
+
+// バイト列への8バイト追加（リトルエンディアン）
+void buf_push_u64(Buffer *buf, uint64_t value)
+{
+    buf_push_u32(buf, value);
+    buf_push_u32(buf, value >> 32);
+}
+
+// バイト列の長さをalignの倍数までfillで埋める
+void buf_align(Buffer *buf, size_t align, uint8_t fill)
+{
+    while (buf->len % align != 0)
+    {
+        buf_push_byte(buf, fill);
+    }
+}
+
 // 新しいマップの作成
 Map *new_map(void)
 {
-    Map *map = calloc(1, sizeof(Map));
+    return new_map_in(ARENA_NONE);
+}
+
+// 新しいマップの作成
+// テーブルも含めて指定アリーナから確保する
+Map *new_map_in(ArenaKind_t arena)
+{
+    Map *map = container_alloc(arena, MEM_MAPS, 1, sizeof(Map));
 
-    map->keys = new_vector();
-    map->vals = new_vector();
+    map->keys = container_alloc(arena, MEM_MAPS, MAP_INITIAL_CAPACITY, sizeof(char *));
+    map->vals = container_alloc(arena, MEM_MAPS, MAP_INITIAL_CAPACITY, sizeof(void *));
+    map->capacity = MAP_INITIAL_CAPACITY;
+    map->len = 0;
+    map->arena = arena;
 
     return map;
 }
 
 // マップへの値追加
+// 同じキーが既にあれば値を上書きするので、後から追加した値が見える
 void map_put(Map *map, const char *key, void *val)
 {
-    vec_push(map->keys, (char *)key);
-    vec_push(map->vals, val);
+    // 負荷率が3/4を超えないように拡張しておく
+    if ((map->len + 1) * 4 > map->capacity * 3)
+    {
+        map_grow(map);
+    }
+
+    int slot = map_find_slot(map, key, strlen(key));
+    if (map->keys[slot] == NULL)
+    {
+        map->keys[slot] = key;
+        map->len++;
+    }
+
+    map->vals[slot] = val;
 }
 
 // マップへの整数値追加
 // 一応メモリを割り当てる
 void map_puti(Map *map, const char *key, int val)
 {
-    int *v = (int *)calloc(1, sizeof(int));
+    int *v = (int *)container_alloc(map->arena, MEM_MAPS, 1, sizeof(int));
 
     *v = val;
     map_put(map, key, v);
@@ -63,16 +252,16 @@ void map_puti(Map *map, const char *key, int val)
 // マップからの値取得
 void *map_get(const Map *map, const char *key)
 {
-    // 末尾から探すので、古いデータを上書きする必要が無い
-    for (int i = map->keys->len - 1; i >= 0; i--)
-    {
-        if (strcmp(map->keys->data[i], key) == 0)
-        {
-            return map->vals->data[i];
-        }
-    }
+    return map_getn(map, key, strlen(key));
+}
+
+// マップからの値取得
+// keyは終端されていなくてもよく、先頭len文字をキーとして扱う
+void *map_getn(const Map *map, const char *key, int len)
+{
+    int slot = map_find_slot(map, key, len);
 
-    return NULL;
+    return map->vals[slot];
 }
 
 // マップからの値取得
@@ -88,6 +277,64 @@ int map_geti(const Map *map, const char *key)
     return 0;
 }
 
+// インターン済みの識別子一覧
+// Map<Key:識別子名, Value:Symbol>
+// 識別子は構文木から参照されるので、構文木と同じアリーナに置く
+// アリーナと同じくスレッドごとに持つ
+static _Thread_local Map *symbol_table = NULL;
+
+// インターン済みの識別子を通し番号順に並べたもの
+static _Thread_local Vector *symbol_list = NULL;
+
+// 識別子のインターン
+// 同じ綴りの識別子には常に同じSymbolを返すので、ポインタ比較で同一性を判定できる
+Symbol *intern(const char *str, int len)
+{
+    if (symbol_table == NULL)
+    {
+        symbol_table = new_map_in(ARENA_NODE);
+        symbol_list = new_vector_in(ARENA_NODE);
+    }
+
+    Symbol *sym = map_getn(symbol_table, str, len);
+    if (sym != NULL)
+    {
+        return sym;
+    }
+
+    char *name = arena_strndup(ARENA_NODE, str, len);
+
+    sym = arena_alloc(ARENA_NODE, sizeof(Symbol));
+    mem_count(MEM_SYMBOLS, sizeof(Symbol), 1);
+    sym->name = name;
+    sym->len = len;
+    sym->id = symbol_list->len;
+    map_put(symbol_table, name, sym);
+    vec_push(symbol_list, sym);
+
+    return sym;
+}
+
+// 通し番号からの識別子取得
+Symbol *symbol_at(int id)
+{
+    return symbol_list->data[id];
+}
+
+// インターン済みの識別子の数
+int symbol_count(void)
+{
+    return symbol_list == NULL ? 0 : symbol_list->len;
+}
+
+// 識別子テーブルの破棄
+// 実体はARENA_NODE上にあるので、参照を捨てるだけ
+void intern_reset(void)
+{
+    symbol_table = NULL;
+    symbol_list = NULL;
+}
+
 // 簡易テスト用
 static int expect(int line, int expected, int actual)
 {
@@ -139,13 +386,220 @@ static void test_map(void)
 
     map_puti(map, "foobar", 8);
     EXPECT(8, map_geti(map, "foobar"));
+    EXPECT(3, map->len);
+
+    // 拡張をまたいでも値が引けること
+    char keys[1000][8];
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+        map_put(map, keys[i], (void *)(intptr_t)i);
+    }
+    EXPECT(1003, map->len);
+    EXPECT(0, (intptr_t)map_get(map, "k0"));
+    EXPECT(500, (intptr_t)map_get(map, "k500"));
+    EXPECT(999, (intptr_t)map_get(map, "k999"));
+    EXPECT(6, (intptr_t)map_get(map, "foo"));
+    EXPECT(0, (intptr_t)map_get(map, "k1000"));
+}
+
+// intern関係のテスト
+static void test_intern(void)
+{
+    const char *src = "foo foobar foo";
+
+    Symbol *foo1 = intern(src, 3);
+    Symbol *foobar = intern(src + 4, 6);
+    Symbol *foo2 = intern(src + 11, 3);
+
+    EXPECT(1, foo1 == foo2);
+    EXPECT(0, foo1 == foobar);
+    EXPECT(0, strcmp("foo", foo1->name));
+    EXPECT(0, strcmp("foobar", foobar->name));
+    EXPECT(6, foobar->len);
+    EXPECT(1, symbol_at(foobar->id) == foobar);
+
+    // 新しい識別子のSymbolは1オブジェクトとして数え、合計にも含まれる
+    size_t symbol_bytes, total_bytes;
+    long symbol_objects, total_objects;
+    mem_report_totals(MEM_SYMBOLS, &symbol_bytes, &symbol_objects);
+    mem_report_totals(NUM_MEM_CATEGORIES, &total_bytes, &total_objects);
+    intern("foobaz", 6);
+    intern("foobaz", 6);
+    size_t bytes;
+    long objects;
+    mem_report_totals(MEM_SYMBOLS, &bytes, &objects);
+    EXPECT((int)sizeof(Symbol), (int)(bytes - symbol_bytes));
+    EXPECT(1, (int)(objects - symbol_objects));
+    mem_report_totals(NUM_MEM_CATEGORIES, &bytes, &objects);
+    EXPECT(1, bytes - total_bytes >= sizeof(Symbol) + 7);
+    EXPECT(1, objects - total_objects >= 2);
 }
 
-// vector用テスト
-void runtest(void)
+// arena関係のテスト
+static void test_arena(void)
+{
+    arena_reset(ARENA_CODEGEN);
+    EXPECT(0, (int)arena_used(ARENA_CODEGEN));
+
+    int *a = arena_alloc(ARENA_CODEGEN, sizeof(int) * 4);
+    EXPECT(0, a[3]);
+    a[3] = 42;
+
+    // 直前の割り当てはその場で拡張される
+    int *b = arena_realloc(ARENA_CODEGEN, a, sizeof(int) * 4, sizeof(int) * 8);
+    EXPECT(1, a == b);
+    EXPECT(42, b[3]);
+    EXPECT(0, b[7]);
+
+    // ブロックをまたぐ大きな割り当て
+    char *big = arena_alloc(ARENA_CODEGEN, 1024 * 1024);
+    EXPECT(0, big[1024 * 1024 - 1]);
+
+    Vector *vec = new_vector_in(ARENA_CODEGEN);
+    for (int i = 0; i < 100; i++)
+    {
+        vec_push(vec, (void *)(intptr_t)i);
+    }
+    EXPECT(99, (intptr_t)vec->data[99]);
+
+    Map *map = new_map_in(ARENA_CODEGEN);
+    map_puti(map, "foo", 3);
+    EXPECT(3, map_geti(map, "foo"));
+
+    arena_reset(ARENA_CODEGEN);
+    EXPECT(0, (int)arena_used(ARENA_CODEGEN));
+}
+
+// tokenize関係のテスト
+static void test_tokenize(void)
+{
+    static const TokenType_t expected[] = {
+        TK_INT, TK_RETURN, TK_IF, TK_ELSE, TK_FOR, TK_WHILE,
+        TK_IDENT, TK_IDENT, TK_IDENT, TK_NUM,
+        TK_EQ, TK_NEQ, TK_LESS_EQ, TK_GREATER_EQ,
+        TK_ADD_ASSIGN, TK_SUB_ASSIGN, TK_MUL_ASSIGN, TK_DIV_ASSIGN, TK_MOD_ASSIGN,
+        TK_PLUS, TK_MINUS, TK_MUL, TK_DIV, TK_MOD, TK_PROPEN, TK_PRCLOSE,
+        TK_ASSIGN, TK_LESS, TK_GREATER, TK_BRACE_OPEN, TK_BRACE_CLOSE, TK_ADDR, TK_STMT,
+        TK_COMMA, TK_EOF};
+
+    TokenList *tokens = tokenize("int return if else for while "
+                                 "iff returns _int 42 "
+                                 "== != <= >= += -= *= /= %= "
+                                 "+ - * / % ( ) = < > { } & ; ,");
+
+    EXPECT(NUMOF(expected), tokens->len);
+    for (int i = 0; i < tokens->len; i++)
+    {
+        EXPECT(expected[i], tokens->types[i]);
+    }
+
+    // トークン文字列はソースコードを参照している
+    EXPECT(33, tokens->offsets[7]);
+    EXPECT(7, tokens->lengths[7]);
+    EXPECT(0, strcmp("returns", symbol_at(tokens->values[7])->name));
+    EXPECT(42, tokens->values[9]);
+
+    arena_reset(ARENA_TOKEN);
+}
+
+// 機械語エンコードのテスト
+static void test_encode(void)
+{
+    static const uint8_t expected[] = {
+        0x55,                               // push rbp
+        0x48, 0x89, 0xE5,                   // mov rbp, rsp
+        0x48, 0x89, 0x7D, 0xF8,             // mov [rbp-8], rdi
+        0x49, 0x8B, 0x04, 0x24,             // mov rax, [r12]
+        0x4C, 0x8D, 0x6D, 0xF0,             // lea r13, [rbp-16]
+        0x0F, 0x84, 0x05, 0x00, 0x00, 0x00, // je .Lend0
+        0xE8, 0x00, 0x00, 0x00, 0x00,       // call g
+        0xC3,                               // .Lend0: ret
+    };
+
+    emit_function("f");
+    emit_ins_r(OP_PUSH, REG_RBP);
+    emit_ins_rr(OP_MOV, REG_RBP, REG_RSP);
+    emit_ins_mr(OP_MOV, REG_RBP, -8, REG_RDI);
+    emit_ins_rm(OP_MOV, REG_RAX, REG_R12, 0);
+    emit_ins_rm(OP_LEA, REG_R13, REG_RBP, -16);
+    emit_ins_label(OP_JE, "end", 0);
+    emit_ins_sym(OP_CALL, "g");
+    emit_label("end", 0);
+    emit_ins(OP_RET);
+
+    Buffer *code = new_buffer_in(ARENA_CODEGEN);
+    Vector *relocs = new_vector_in(ARENA_CODEGEN);
+    encode_func(emit_program()->funcs->data[0], code, relocs);
+
+    EXPECT((int)sizeof(expected), (int)code->len);
+    EXPECT(0, memcmp(expected, code->data, sizeof(expected)));
+
+    EXPECT(1, relocs->len);
+    Reloc *reloc = relocs->data[0];
+    EXPECT(23, (int)reloc->offset);
+    EXPECT(RELOC_PLT32, reloc->type);
+    EXPECT(0, strcmp("g", reloc->sym));
+
+    emit_reset();
+    arena_reset(ARENA_CODEGEN);
+}
+
+// 覗き穴最適化のテスト
+static void test_peephole(void)
+{
+    // push 3; pop rdi; mov rax, rdi => mov rax, 3
+    emit_function("f");
+    emit_ins_i(OP_PUSH, 3);
+    emit_ins_r(OP_POP, REG_RDI);
+    emit_ins_rr(OP_MOV, REG_RAX, REG_RDI);
+    emit_ins(OP_RET);
+
+    // 間のsetccがpushしたレジスタを書き換えるので、pushとpopはまとめられない
+    emit_function("g");
+    emit_ins_r(OP_PUSH, REG_RAX);
+    emit_ins_rr(OP_CMP, REG_RAX, REG_RDI);
+    emit_ins_r(OP_SETE, REG_AL);
+    emit_ins_r(OP_POP, REG_RDI);
+    emit_ins_rr(OP_MOV, REG_RAX, REG_RDI);
+    emit_ins(OP_RET);
+
+    AsmFunc *f = emit_program()->funcs->data[0];
+    peephole_optimize(f);
+    EXPECT(2, f->len);
+    EXPECT(OP_MOV, f->ins[0].op);
+    EXPECT(REG_RAX, f->ins[0].dst.reg);
+    EXPECT(OPD_IMM, f->ins[0].src.kind);
+    EXPECT(3, f->ins[0].src.imm);
+
+    AsmFunc *g = emit_program()->funcs->data[1];
+    peephole_optimize(g);
+    EXPECT(OP_PUSH, g->ins[0].op);
+    EXPECT(OP_POP, g->ins[3].op);
+
+    emit_reset();
+    arena_reset(ARENA_CODEGEN);
+}
+
+// 内部機能のテスト
+// cases_pathが指定されていれば、続けてケース表のテストを実行する
+// 失敗したケースの数を返す
+int runtest(const char *cases_path, int jobs)
 {
     test_vector();
     test_map();
+    test_intern();
+    test_arena();
+    test_tokenize();
+    test_encode();
+    test_peephole();
 
     printf("    runtest OK\n");
+
+    if (cases_path == NULL)
+    {
+        return 0;
+    }
+
+    return run_test_cases(cases_path, jobs);
 }
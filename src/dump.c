@@ -12,20 +12,26 @@
 static char *token_map[0x200] = {0};
 
 // トークン一覧の出力
-void dump_token_list(Vector *token_list)
+void dump_token_list(TokenList *token_list)
 {
     printf("# tokens: ");
     for (int i = 0; i < token_list->len; i++)
     {
-        Token *tk = token_list->data[i];
+        int ty = token_list->types[i];
 
-        if (token_map[tk->ty] != 0)
+        if (token_map[ty] != 0)
         {
-            printf("%s", token_map[tk->ty]);
+            printf("%s", token_map[ty]);
         }
         else
         {
-            printf("%c", tk->ty);
+            printf("%c", ty);
+        }
+
+        // 数値と識別子は元の文字列も併せて出力する
+        if (ty == TK_NUM || ty == TK_IDENT)
+        {
+            printf("(%.*s)", token_list->lengths[i], token_list->source + token_list->offsets[i]);
         }
 
         printf(" ");
@@ -51,15 +57,16 @@ static void dump_node_type(NodeType_t ty)
 }
 
 // block内のアセンブリ出力
-static void dump_node_block(Vector *block_stmts)
+static void dump_node_block(const Ast *ast, const Node *block)
 {
-    for (int j = 0; block_stmts->data[j]; j++)
+    const NodeId *stmts = ast_list(ast, block->stmts);
+    for (int j = 0; j < block->num_stmts; j++)
     {
-        Node *node = (Node *)block_stmts->data[j];
+        const Node *node = ast_node(ast, stmts[j]);
 
         if (node->ty == ND_BLOCK)
         {
-            dump_node_block((Vector *)node->block_stmts);
+            dump_node_block(ast, node);
         }
         else
         {
@@ -69,24 +76,151 @@ static void dump_node_block(Vector *block_stmts)
 }
 
 // ノードの関数とその1改装下のノード一覧
-void dump_node_list(Vector *code)
+void dump_node_list(const Ast *ast)
 {
     printf("# nodes: ");
     // 1ループ1関数定義
-    for (int i = 0; code->data[i]; i++)
+    const NodeId *decls = ast_list(ast, ast->decls);
+    for (int i = 0; i < ast->num_decls; i++)
     {
-        Node *node = code->data[i];
+        const Node *node = ast_node(ast, decls[i]);
         dump_node_type(node->ty);
 
         if (node->ty == ND_FUNCDEF)
         {
-            dump_node_block(node->func->body->block_stmts);
+            dump_node_block(ast, ast_node(ast, ast_func(ast, node->func)->body));
         }
     }
 
     puts("");
 }
 
+// IR命令の名前
+static const char *const ir_op_names[NUM_IR_OPS] = {
+    [IR_IMM] = "imm",
+    [IR_COPY] = "copy",
+    [IR_PHI] = "phi",
+    [IR_PARAM] = "param",
+    [IR_ADD] = "add",
+    [IR_SUB] = "sub",
+    [IR_MUL] = "mul",
+    [IR_DIV] = "div",
+    [IR_MOD] = "mod",
+    [IR_NEG] = "neg",
+    [IR_EQ] = "eq",
+    [IR_NE] = "ne",
+    [IR_LT] = "lt",
+    [IR_LE] = "le",
+    [IR_GT] = "gt",
+    [IR_GE] = "ge",
+    [IR_LOCAL] = "local",
+    [IR_GLOBAL] = "global",
+    [IR_LOAD] = "load",
+    [IR_STORE] = "store",
+    [IR_CALL] = "call",
+    [IR_JMP] = "jmp",
+    [IR_BR] = "br",
+    [IR_RET] = "ret",
+};
+
+// IRの型の名前
+static const char *const ir_type_names[] = {"void", "i64", "bool", "ptr"};
+
+// IR命令一つの出力
+static void dump_ir_ins(const IrBlock *block, const IrIns *ins)
+{
+    printf("#   ");
+    if (ins->dst != IR_NONE)
+    {
+        printf("v%d:%s = ", ins->dst, ir_type_names[ins->type]);
+    }
+    printf("%s", ir_op_names[ins->op]);
+
+    switch (ins->op)
+    {
+    case IR_IMM:
+    case IR_PARAM:
+    case IR_LOCAL:
+        printf(" %d", ins->imm);
+        break;
+    case IR_GLOBAL:
+        printf(" %s", ins->sym);
+        break;
+    case IR_CALL:
+        printf(" %s", ins->sym);
+        for (int i = 0; i < ins->num_args; i++)
+        {
+            printf("%s v%d", i == 0 ? "" : ",", ins->args[i]);
+        }
+        break;
+    case IR_PHI:
+        for (int i = 0; i < ins->num_args; i++)
+        {
+            printf("%s [v%d, bb%d]", i == 0 ? "" : ",", ins->args[i], block->preds[i]->id);
+        }
+        break;
+    case IR_JMP:
+        printf(" bb%d", block->succs[0]->id);
+        break;
+    case IR_BR:
+        printf(" v%d, bb%d, bb%d", ins->a, block->succs[0]->id, block->succs[1]->id);
+        break;
+    default:
+        if (ins->a != IR_NONE)
+        {
+            printf(" v%d", ins->a);
+        }
+        if (ins->b != IR_NONE)
+        {
+            printf(", v%d", ins->b);
+        }
+        break;
+    }
+
+    printf("\n");
+}
+
+// 関数ごとのIRの出力
+// 行頭を"#"にして、アセンブリのコメントとして読めるようにする
+// opt_levelが1以上なら、コード生成に使う最適化後（SSA形式）のIRを出力する
+void dump_ir(const Ast *ast, int opt_level)
+{
+    const NodeId *decls = ast_list(ast, ast->decls);
+    for (int i = 0; i < ast->num_decls; i++)
+    {
+        const Node *node = ast_node(ast, decls[i]);
+        if (node->ty != ND_FUNCDEF)
+        {
+            continue;
+        }
+
+        IrFunc *ir = ir_build(ast, ast_func(ast, node->func));
+        if (opt_level > 0)
+        {
+            ir_optimize(ir);
+        }
+        printf("# ir %s: args=%d vars=%d vregs=%d\n", ir->name, ir->num_args, ir->num_vars, ir->num_vregs);
+        for (int j = 0; j < ir->num_blocks; j++)
+        {
+            const IrBlock *block = ir->blocks[j];
+            printf("# bb%d:", block->id);
+            if (block->num_preds > 0)
+            {
+                printf(" ; preds");
+                for (int k = 0; k < block->num_preds; k++)
+                {
+                    printf(" bb%d", block->preds[k]->id);
+                }
+            }
+            printf("\n");
+            for (int k = 0; k < block->len; k++)
+            {
+                dump_ir_ins(block, &block->ins[k]);
+            }
+        }
+    }
+}
+
 // ダンプ用の環境初期化
 void initialize_dump_env(void)
 {
@@ -132,6 +266,7 @@ void initialize_dump_env(void)
         node_map[ND_ASSIGN] = "ASGN";
         node_map[ND_ADDR] = "&";
         node_map[ND_DEREF] = "*";
+        node_map[ND_NEG] = "neg";
         node_map[ND_EQ] = "==";
         node_map[ND_NEQ] = "!=";
         node_map[ND_LESS_EQ] = "<=";
@@ -0,0 +1,590 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "shcc.h"
+
+// 出力バッファの初期サイズ
+#define OUTBUF_INITIAL_CAPACITY (1024 * 1024)
+
+// 作成中のプログラム
+// 複数の翻訳単位を並列にコンパイルできるよう、スレッドごとに持つ
+static _Thread_local AsmProgram asm_program = {0};
+
+// 命令を追加中の関数
+// 関数ごとに別スレッドでコード生成できるよう、スレッドごとに持つ
+static _Thread_local AsmFunc *current_func = NULL;
+
+// 出力バッファ
+static _Thread_local Buffer *out = NULL;
+
+// レジスタ名
+static const char *register_names[NUM_REGS] = {
+    [REG_RAX] = "rax",
+    [REG_RCX] = "rcx",
+    [REG_RDX] = "rdx",
+    [REG_RBX] = "rbx",
+    [REG_RSP] = "rsp",
+    [REG_RBP] = "rbp",
+    [REG_RSI] = "rsi",
+    [REG_RDI] = "rdi",
+    [REG_R8] = "r8",
+    [REG_R9] = "r9",
+    [REG_R10] = "r10",
+    [REG_R11] = "r11",
+    [REG_R12] = "r12",
+    [REG_R13] = "r13",
+    [REG_R14] = "r14",
+    [REG_R15] = "r15",
+    [REG_AL] = "al",
+};
+
+// 命令名
+// 行頭のインデントと後続の空白も含めておく
+static const char *opcode_names[NUM_OPS] = {
+    [OP_PUSH] = "  push ",
+    [OP_POP] = "  pop ",
+    [OP_MOV] = "  mov ",
+    [OP_MOVZB] = "  movzb ",
+    [OP_LEA] = "  lea ",
+    [OP_ADD] = "  add ",
+    [OP_SUB] = "  sub ",
+    [OP_MUL] = "  mul ",
+    [OP_DIV] = "  div ",
+    [OP_NEG] = "  neg ",
+    [OP_CMP] = "  cmp ",
+    [OP_SETE] = "  sete ",
+    [OP_SETNE] = "  setne ",
+    [OP_SETL] = "  setl ",
+    [OP_SETLE] = "  setle ",
+    [OP_SETG] = "  setg ",
+    [OP_SETGE] = "  setge ",
+    [OP_JMP] = "  jmp ",
+    [OP_JE] = "  je ",
+    [OP_JNE] = "  jne ",
+    [OP_JL] = "  jl ",
+    [OP_JLE] = "  jle ",
+    [OP_JG] = "  jg ",
+    [OP_JGE] = "  jge ",
+    [OP_CALL] = "  call ",
+    [OP_LEAVE] = "  leave",
+    [OP_RET] = "  ret",
+    [OP_NOP] = "  nop",
+    [OP_LABEL] = "",
+    [OP_COMMENT] = "  # ",
+};
+
+// レジスタオペランド
+static Operand reg_operand(Register_t reg)
+{
+    return (Operand){.kind = OPD_REG, .reg = reg};
+}
+
+// 即値オペランド
+static Operand imm_operand(int imm)
+{
+    return (Operand){.kind = OPD_IMM, .imm = imm};
+}
+
+// メモリオペランド
+static Operand mem_operand(Register_t base, int disp)
+{
+    return (Operand){.kind = OPD_MEM, .reg = base, .imm = disp};
+}
+
+// シンボルオペランド
+static Operand sym_operand(const char *sym)
+{
+    return (Operand){.kind = OPD_SYM, .sym = sym};
+}
+
+// ラベルオペランド
+static Operand label_operand(const char *prefix, int no)
+{
+    return (Operand){.kind = OPD_LABEL, .sym = prefix, .imm = no};
+}
+
+// ラベルを引く表のキー（接頭辞と番号をつないだ文字列）
+char *label_key(const Operand *label)
+{
+    char key[64];
+    int len = strlen(label->sym);
+    assert(len + 11 < (int)sizeof(key));
+    memcpy(key, label->sym, len);
+
+    // 番号を10進で後ろに付ける
+    char digits[11];
+    int num_digits = 0;
+    unsigned value = label->imm;
+    do
+    {
+        digits[num_digits++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (num_digits > 0)
+    {
+        key[len++] = digits[--num_digits];
+    }
+
+    return arena_strndup(ARENA_CODEGEN, key, len);
+}
+
+// 作成中のプログラムを初期化する
+static void init_program(void)
+{
+    if (asm_program.funcs == NULL)
+    {
+        asm_program.funcs = new_vector_in(ARENA_CODEGEN);
+        asm_program.globals = new_vector_in(ARENA_CODEGEN);
+    }
+}
+
+// 作成中の関数へ命令を追加
+static void push_ins(Opcode_t op, Operand dst, Operand src)
+{
+    AsmFunc *func = current_func;
+
+    if (func->len == func->capacity)
+    {
+        int capacity = func->capacity == 0 ? 64 : func->capacity * 2;
+        func->ins = arena_realloc(ARENA_CODEGEN, func->ins,
+                                  func->capacity * sizeof(Ins), capacity * sizeof(Ins));
+        mem_count(MEM_CODEGEN, (capacity - func->capacity) * sizeof(Ins), 0);
+        func->capacity = capacity;
+    }
+
+    func->ins[func->len++] = (Ins){.op = op, .dst = dst, .src = src};
+}
+
+// 関数の追加
+// 出力順は追加順になる
+AsmFunc *emit_new_function(const char *name)
+{
+    init_program();
+
+    AsmFunc *func = arena_alloc(ARENA_CODEGEN, sizeof(AsmFunc));
+    mem_count(MEM_CODEGEN, sizeof(AsmFunc), 1);
+    func->name = name;
+    vec_push(asm_program.funcs, func);
+
+    return func;
+}
+
+// 命令を追加する関数の切り替え
+// 以降このスレッドで出力する命令はこの関数に追加される
+void emit_select_function(AsmFunc *func)
+{
+    current_func = func;
+}
+
+// 関数の開始
+// 以降の命令はこの関数に追加される
+void emit_function(const char *name)
+{
+    emit_select_function(emit_new_function(name));
+}
+
+// グローバル変数の定義
+void emit_global_variable(const char *name)
+{
+    init_program();
+
+    vec_push(asm_program.globals, (char *)name);
+}
+
+// コメント
+void emit_comment(const char *comment)
+{
+    int len = strlen(comment);
+    push_ins(OP_COMMENT, (Operand){.sym = arena_strndup(ARENA_CODEGEN, comment, len)}, (Operand){0});
+}
+
+// ローカル変数の配置のコメント
+// 文字列は出力時に組み立てる
+void emit_comment_var(const char *name, int disp)
+{
+    int len = strlen(name);
+    push_ins(OP_COMMENT, (Operand){.sym = arena_strndup(ARENA_CODEGEN, name, len)}, mem_operand(REG_RBP, -disp));
+}
+
+// オペランドのない命令 (leave, ret...)
+void emit_ins(Opcode_t op)
+{
+    push_ins(op, (Operand){0}, (Operand){0});
+}
+
+// レジスタ一つの命令 (push rax)
+void emit_ins_r(Opcode_t op, Register_t reg)
+{
+    push_ins(op, reg_operand(reg), (Operand){0});
+}
+
+// 即値一つの命令 (push 42)
+void emit_ins_i(Opcode_t op, int imm)
+{
+    push_ins(op, imm_operand(imm), (Operand){0});
+}
+
+// レジスタ同士の命令 (mov rax, rdi)
+void emit_ins_rr(Opcode_t op, Register_t dst, Register_t src)
+{
+    push_ins(op, reg_operand(dst), reg_operand(src));
+}
+
+// レジスタと即値の命令 (sub rax, 8)
+void emit_ins_ri(Opcode_t op, Register_t dst, int imm)
+{
+    push_ins(op, reg_operand(dst), imm_operand(imm));
+}
+
+// メモリからレジスタへの命令 (mov rax, [rax])
+void emit_ins_rm(Opcode_t op, Register_t dst, Register_t base, int disp)
+{
+    push_ins(op, reg_operand(dst), mem_operand(base, disp));
+}
+
+// レジスタからメモリへの命令 (mov [rax], rdi)
+void emit_ins_mr(Opcode_t op, Register_t base, int disp, Register_t src)
+{
+    push_ins(op, mem_operand(base, disp), reg_operand(src));
+}
+
+// シンボルのアドレスを扱う命令 (lea rax, foo[rip])
+void emit_ins_rsym(Opcode_t op, Register_t dst, const char *sym)
+{
+    push_ins(op, reg_operand(dst), sym_operand(sym));
+}
+
+// シンボルを対象とする命令 (call foo)
+void emit_ins_sym(Opcode_t op, const char *sym)
+{
+    push_ins(op, sym_operand(sym), (Operand){0});
+}
+
+// ローカルラベルを対象とする命令 (je .Lelse0)
+void emit_ins_label(Opcode_t op, const char *prefix, int no)
+{
+    push_ins(op, label_operand(prefix, no), (Operand){0});
+}
+
+// ローカルラベル定義 (.Lelse0:)
+void emit_label(const char *prefix, int no)
+{
+    push_ins(OP_LABEL, label_operand(prefix, no), (Operand){0});
+}
+
+// オペランドを指定した命令の追加（レジスタ割り当て後の命令列用）
+void emit_ins_opd(Opcode_t op, Operand dst, Operand src)
+{
+    push_ins(op, dst, src);
+}
+
+// 作成中の関数の命令列を、作成済みの命令列に置き換える（キャッシュから取り出した命令列用）
+// 命令列はコピーしないので、出力が終わるまで有効な領域であること
+void emit_use_instructions(Ins *ins, int len)
+{
+    current_func->ins = ins;
+    current_func->len = len;
+    current_func->capacity = len;
+}
+
+// 作成したプログラム
+const AsmProgram *emit_program(void)
+{
+    init_program();
+
+    return &asm_program;
+}
+
+// 文字列をそのまま出力
+static void out_raw(const char *str, size_t len)
+{
+    buf_push(out, str, len);
+}
+
+// 文字列出力
+static void out_str(const char *str)
+{
+    out_raw(str, strlen(str));
+}
+
+// 1文字出力
+static void out_char(char ch)
+{
+    buf_push_byte(out, ch);
+}
+
+// 1行出力
+static void out_line(const char *line)
+{
+    out_str(line);
+    out_char('\n');
+}
+
+// 整数出力
+static void out_int(long value)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    unsigned long v = value < 0 ? -(unsigned long)value : (unsigned long)value;
+
+    do
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+
+    if (value < 0)
+    {
+        *--p = '-';
+    }
+
+    out_raw(p, buf + sizeof(buf) - p);
+}
+
+// オペランド出力
+// ラベル番号は関数ごとに振られているので、関数名で区別する
+static void out_operand(const AsmFunc *func, const Operand *opd)
+{
+    switch (opd->kind)
+    {
+    case OPD_REG:
+        out_str(register_names[opd->reg]);
+        break;
+    case OPD_IMM:
+        out_int(opd->imm);
+        break;
+    case OPD_MEM:
+        out_char('[');
+        out_str(register_names[opd->reg]);
+        if (opd->imm > 0)
+        {
+            out_char('+');
+        }
+        if (opd->imm != 0)
+        {
+            out_int(opd->imm);
+        }
+        out_char(']');
+        break;
+    case OPD_SYM:
+        out_str(opd->sym);
+        break;
+    case OPD_LABEL:
+        out_raw(".L", 2);
+        out_str(func->name);
+        out_char('.');
+        out_str(opd->sym);
+        out_int(opd->imm);
+        break;
+    default:
+        break;
+    }
+}
+
+// 命令のテキスト出力
+static void out_ins(const AsmFunc *func, const Ins *ins)
+{
+    switch (ins->op)
+    {
+    case OP_LABEL:
+        out_operand(func, &ins->dst);
+        out_raw(":\n", 2);
+        return;
+    case OP_COMMENT:
+        out_str(opcode_names[ins->op]);
+        if (ins->src.kind == OPD_MEM)
+        {
+            // ローカル変数の配置
+            out_str("New variable '");
+            out_str(ins->dst.sym);
+            out_str("' = [RBP-");
+            out_int(-ins->src.imm);
+            out_line("]");
+            return;
+        }
+        out_line(ins->dst.sym);
+        return;
+    case OP_LEA:
+        // RIP相対のアドレス
+        if (ins->src.kind == OPD_SYM)
+        {
+            out_str(opcode_names[ins->op]);
+            out_operand(func, &ins->dst);
+            out_raw(", ", 2);
+            out_str(ins->src.sym);
+            out_raw("[rip]\n", 6);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    out_str(opcode_names[ins->op]);
+    if (ins->dst.kind != OPD_NONE)
+    {
+        out_operand(func, &ins->dst);
+    }
+    if (ins->src.kind != OPD_NONE)
+    {
+        out_raw(", ", 2);
+        out_operand(func, &ins->src);
+    }
+    out_char('\n');
+}
+
+// グローバル変数のテキスト出力
+static void out_global_variable(const char *name)
+{
+    out_str(".global ");
+    out_line(name);
+    // 今は明示的な初期化のない変数しかないので
+    out_line(".data");
+    out_line(".align 8");
+    out_str(".size ");
+    out_str(name);
+    out_line(", 8");
+    out_str(name);
+    out_raw(":\n", 2);
+    // とりあえず変数サイズを確保してゼロクリア
+    out_line("  .zero 8");
+    out_line("");
+}
+
+// 関数のテキスト出力
+static void out_function(const AsmFunc *func)
+{
+    out_line("");
+    out_line(".text");
+    out_str(".global ");
+    out_line(func->name);
+    out_str(func->name);
+    out_raw(":\n", 2);
+
+    for (int i = 0; i < func->len; i++)
+    {
+        out_ins(func, &func->ins[i]);
+    }
+}
+
+// 出力バッファを用意する
+static void init_out(void)
+{
+    if (out == NULL)
+    {
+        out = new_buffer_in(ARENA_CODEGEN);
+        // あらかじめ大きめに確保しておく
+        out->data = arena_alloc(ARENA_CODEGEN, OUTBUF_INITIAL_CAPACITY);
+        mem_count(MEM_CODEGEN, OUTBUF_INITIAL_CAPACITY, 0);
+        out->capacity = OUTBUF_INITIAL_CAPACITY;
+    }
+}
+
+// 出力バッファの内容をファイルへ書き出す
+// pathがNULLなら標準出力へ書き出す
+static void write_out(const char *path)
+{
+    int fd = STDOUT_FILENO;
+
+    if (path != NULL)
+    {
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            compile_error("%s: %s", path, strerror(errno));
+        }
+    }
+    else
+    {
+        // ダンプなどのprintf出力を先に出しておく
+        fflush(stdout);
+    }
+
+    report_count(COUNT_OUTPUT_BYTES, out->len);
+
+    // 通常は一回のwriteで書き終わる
+    for (size_t written = 0; written < out->len;)
+    {
+        ssize_t n = write(fd, out->data + written, out->len - written);
+        if (n < 0)
+        {
+            compile_error("write: %s", strerror(errno));
+        }
+        written += n;
+    }
+
+    if (path != NULL)
+    {
+        close(fd);
+    }
+}
+
+// アセンブリを書き出す
+// pathがNULLなら標準出力へ書き出す
+void emit_write(const char *path)
+{
+    const AsmProgram *prog = emit_program();
+    init_out();
+
+    out_line(".intel_syntax noprefix");
+    out_line("# body start");
+
+    for (int i = 0; i < prog->globals->len; i++)
+    {
+        out_global_variable(prog->globals->data[i]);
+    }
+    for (int i = 0; i < prog->funcs->len; i++)
+    {
+        out_function(prog->funcs->data[i]);
+    }
+
+    out_line("# body end");
+
+    write_out(path);
+}
+
+// ELFのオブジェクトファイルを書き出す
+// pathがNULLなら標準出力へ書き出す
+void emit_write_object(const char *path)
+{
+    init_out();
+    write_object(emit_program(), out);
+
+    write_out(path);
+}
+
+// 作成済みの出力（キャッシュから取り出したもの）をそのまま書き出す
+// dataはコピーせず出力バッファとして使うので、書き出しが終わるまで有効な領域であること
+// pathがNULLなら標準出力へ書き出す
+void emit_write_bytes(const char *path, void *data, size_t len)
+{
+    out = new_buffer_in(ARENA_CODEGEN);
+    out->data = data;
+    out->len = len;
+    out->capacity = len;
+
+    write_out(path);
+}
+
+// 直前に書き出した出力
+const Buffer *emit_output(void)
+{
+    return out;
+}
+
+// 作成中のプログラムと出力バッファの破棄
+// 実体はARENA_CODEGEN上にあるので、参照を捨てるだけ
+void emit_reset(void)
+{
+    asm_program = (AsmProgram){0};
+    current_func = NULL;
+    out = NULL;
+}
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shcc.h"
+
+// REXプレフィックス
+#define REX_W 0x48 // 64bitオペランド
+#define REX_R 0x04 // ModRM.regの拡張
+#define REX_B 0x01 // ModRM.rm / オペコード中のレジスタの拡張
+
+// ラベルを参照する位置
+typedef struct
+{
+    const char *prefix; // ラベル名の接頭辞
+    int no;             // ラベル番号
+    uint32_t offset;    // 参照しているrel32の位置
+} LabelRef;
+
+// ラベル参照の可変長配列
+typedef struct
+{
+    LabelRef *data;
+    int len;
+    int capacity;
+} LabelList;
+
+// 関数一つ分のエンコード状態
+typedef struct
+{
+    Buffer *code;
+    Vector *relocs;
+    Map *labels;      // ラベル定義位置+1（キーはlabel_key）
+    LabelList fixups; // 後から埋めるジャンプ先
+} Encoder;
+
+// 2項演算命令のオペコード (op r/m64, r64)
+static const uint8_t alu_rm_r[NUM_OPS] = {
+    [OP_ADD] = 0x01,
+    [OP_SUB] = 0x29,
+    [OP_CMP] = 0x39,
+};
+
+// 即値との2項演算命令のModRM.reg拡張 (op r/m64, imm)
+static const uint8_t alu_imm_ext[NUM_OPS] = {
+    [OP_ADD] = 0,
+    [OP_SUB] = 5,
+    [OP_CMP] = 7,
+};
+
+// 単項演算命令のModRM.reg拡張 (F7 /n)
+static const uint8_t f7_ext[NUM_OPS] = {
+    [OP_NEG] = 3,
+    [OP_MUL] = 4,
+    [OP_DIV] = 6,
+};
+
+// setcc命令の2バイト目 (0F xx)
+static const uint8_t setcc_codes[NUM_OPS] = {
+    [OP_SETE] = 0x94,
+    [OP_SETNE] = 0x95,
+    [OP_SETL] = 0x9C,
+    [OP_SETGE] = 0x9D,
+    [OP_SETLE] = 0x9E,
+    [OP_SETG] = 0x9F,
+};
+
+// 条件付きジャンプ命令の2バイト目 (0F xx)
+static const uint8_t jcc_codes[NUM_OPS] = {
+    [OP_JE] = 0x84,
+    [OP_JNE] = 0x85,
+    [OP_JL] = 0x8C,
+    [OP_JGE] = 0x8D,
+    [OP_JLE] = 0x8E,
+    [OP_JG] = 0x8F,
+};
+
+// エンコードできない命令
+static void error(const Ins *ins)
+{
+    compile_error("エンコードできない命令です(op=%d)", ins->op);
+}
+
+// レジスタの番号
+// Register_tは64bitレジスタの番号順に並んでいる
+static int reg_no(int reg)
+{
+    return reg == REG_AL ? 0 : reg;
+}
+
+// 即値が符号付き8bitに収まるか
+static bool is_imm8(int32_t imm)
+{
+    return -128 <= imm && imm <= 127;
+}
+
+// 1バイト出力
+static void put8(Encoder *enc, uint8_t value)
+{
+    buf_push_byte(enc->code, value);
+}
+
+// 4バイト出力
+static void put32(Encoder *enc, uint32_t value)
+{
+    buf_push_u32(enc->code, value);
+}
+
+// REX.Wプレフィックス出力
+static void put_rex_w(Encoder *enc, int reg, int rm)
+{
+    put8(enc, REX_W | (reg_no(reg) >= 8 ? REX_R : 0) | (reg_no(rm) >= 8 ? REX_B : 0));
+}
+
+// レジスタ直接指定のModRM出力
+static void put_modrm_reg(Encoder *enc, int reg, int rm)
+{
+    put8(enc, 0xC0 | (reg_no(reg) & 7) << 3 | (reg_no(rm) & 7));
+}
+
+// [base+disp]のModRM出力
+static void put_modrm_mem(Encoder *enc, int reg, int base, int32_t disp)
+{
+    int rm = reg_no(base) & 7;
+    int mod;
+
+    // rbp/r13は変位なしが指定できないので、0の8bit変位を付ける
+    if (disp == 0 && rm != REG_RBP)
+    {
+        mod = 0x00;
+    }
+    else if (is_imm8(disp))
+    {
+        mod = 0x40;
+    }
+    else
+    {
+        mod = 0x80;
+    }
+
+    put8(enc, mod | (reg_no(reg) & 7) << 3 | rm);
+    // rsp/r12はSIBが必要
+    if (rm == REG_RSP)
+    {
+        put8(enc, 0x24);
+    }
+
+    if (mod == 0x40)
+    {
+        put8(enc, (uint8_t)disp);
+    }
+    else if (mod == 0x80)
+    {
+        put32(enc, disp);
+    }
+}
+
+// 再配置の追加
+static void add_reloc(Encoder *enc, const char *sym, RelocType_t type)
+{
+    Reloc *reloc = arena_alloc(ARENA_CODEGEN, sizeof(Reloc));
+    mem_count(MEM_CODEGEN, sizeof(Reloc), 1);
+    reloc->offset = enc->code->len;
+    reloc->sym = sym;
+    reloc->type = type;
+    // rel32は次の命令の先頭からの相対位置
+    reloc->addend = -4;
+
+    vec_push(enc->relocs, reloc);
+}
+
+// ラベル参照の追加
+static void push_label(LabelList *list, const Operand *label, uint32_t offset)
+{
+    if (list->len == list->capacity)
+    {
+        int capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        list->data = arena_realloc(ARENA_CODEGEN, list->data,
+                                   list->capacity * sizeof(LabelRef), capacity * sizeof(LabelRef));
+        mem_count(MEM_CODEGEN, (capacity - list->capacity) * sizeof(LabelRef), list->capacity == 0);
+        list->capacity = capacity;
+    }
+
+    list->data[list->len++] = (LabelRef){.prefix = label->sym, .no = label->imm, .offset = offset};
+}
+
+// ラベルへの相対ジャンプ先を出力する
+// 位置は関数の最後で埋める
+static void put_label_rel32(Encoder *enc, const Operand *label)
+{
+    push_label(&enc->fixups, label, enc->code->len);
+    put32(enc, 0);
+}
+
+// ラベル定義位置の検索
+static uint32_t find_label(const Encoder *enc, const LabelRef *fixup)
+{
+    Operand label = {.kind = OPD_LABEL, .sym = fixup->prefix, .imm = fixup->no};
+    int offset = map_geti(enc->labels, label_key(&label));
+    if (offset != 0)
+    {
+        return offset - 1;
+    }
+
+    compile_error("ラベル'.L%s%d'が見つかりません", fixup->prefix, fixup->no);
+}
+
+// 命令一つのエンコード
+static void encode_ins(Encoder *enc, const Ins *ins)
+{
+    const Operand *dst = &ins->dst;
+    const Operand *src = &ins->src;
+
+    switch (ins->op)
+    {
+    case OP_PUSH:
+        if (dst->kind == OPD_IMM)
+        {
+            if (is_imm8(dst->imm))
+            {
+                put8(enc, 0x6A);
+                put8(enc, (uint8_t)dst->imm);
+            }
+            else
+            {
+                put8(enc, 0x68);
+                put32(enc, dst->imm);
+            }
+            return;
+        }
+        // fallthrough
+    case OP_POP:
+        if (dst->kind != OPD_REG)
+        {
+            error(ins);
+        }
+        if (reg_no(dst->reg) >= 8)
+        {
+            put8(enc, 0x40 | REX_B);
+        }
+        put8(enc, (ins->op == OP_PUSH ? 0x50 : 0x58) + (reg_no(dst->reg) & 7));
+        return;
+    case OP_MOV:
+        if (dst->kind == OPD_REG && src->kind == OPD_REG)
+        {
+            put_rex_w(enc, src->reg, dst->reg);
+            put8(enc, 0x89);
+            put_modrm_reg(enc, src->reg, dst->reg);
+        }
+        else if (dst->kind == OPD_REG && src->kind == OPD_IMM)
+        {
+            put_rex_w(enc, 0, dst->reg);
+            put8(enc, 0xC7);
+            put_modrm_reg(enc, 0, dst->reg);
+            put32(enc, src->imm);
+        }
+        else if (dst->kind == OPD_REG && src->kind == OPD_MEM)
+        {
+            put_rex_w(enc, dst->reg, src->reg);
+            put8(enc, 0x8B);
+            put_modrm_mem(enc, dst->reg, src->reg, src->imm);
+        }
+        else if (dst->kind == OPD_MEM && src->kind == OPD_REG)
+        {
+            put_rex_w(enc, src->reg, dst->reg);
+            put8(enc, 0x89);
+            put_modrm_mem(enc, src->reg, dst->reg, dst->imm);
+        }
+        else
+        {
+            error(ins);
+        }
+        return;
+    case OP_MOVZB:
+        // movzx r64, r/m8
+        put_rex_w(enc, dst->reg, src->reg);
+        put8(enc, 0x0F);
+        put8(enc, 0xB6);
+        put_modrm_reg(enc, dst->reg, src->reg);
+        return;
+    case OP_LEA:
+        if (dst->kind == OPD_REG && src->kind == OPD_MEM)
+        {
+            // lea r64, [base+disp]
+            put_rex_w(enc, dst->reg, src->reg);
+            put8(enc, 0x8D);
+            put_modrm_mem(enc, dst->reg, src->reg, src->imm);
+            return;
+        }
+        if (dst->kind != OPD_REG || src->kind != OPD_SYM)
+        {
+            error(ins);
+        }
+        // lea r64, sym[rip]
+        put_rex_w(enc, dst->reg, 0);
+        put8(enc, 0x8D);
+        put8(enc, (reg_no(dst->reg) & 7) << 3 | 0x05);
+        add_reloc(enc, src->sym, RELOC_PC32);
+        put32(enc, 0);
+        return;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_CMP:
+        if (dst->kind == OPD_REG && src->kind == OPD_REG)
+        {
+            put_rex_w(enc, src->reg, dst->reg);
+            put8(enc, alu_rm_r[ins->op]);
+            put_modrm_reg(enc, src->reg, dst->reg);
+        }
+        else if (dst->kind == OPD_REG && src->kind == OPD_IMM)
+        {
+            put_rex_w(enc, 0, dst->reg);
+            put8(enc, is_imm8(src->imm) ? 0x83 : 0x81);
+            put_modrm_reg(enc, alu_imm_ext[ins->op], dst->reg);
+            if (is_imm8(src->imm))
+            {
+                put8(enc, (uint8_t)src->imm);
+            }
+            else
+            {
+                put32(enc, src->imm);
+            }
+        }
+        else
+        {
+            error(ins);
+        }
+        return;
+    case OP_MUL:
+    case OP_DIV:
+    case OP_NEG:
+        put_rex_w(enc, 0, dst->reg);
+        put8(enc, 0xF7);
+        put_modrm_reg(enc, f7_ext[ins->op], dst->reg);
+        return;
+    case OP_SETE:
+    case OP_SETNE:
+    case OP_SETL:
+    case OP_SETLE:
+    case OP_SETG:
+    case OP_SETGE:
+        if (reg_no(dst->reg) >= 8)
+        {
+            put8(enc, 0x40 | REX_B);
+        }
+        put8(enc, 0x0F);
+        put8(enc, setcc_codes[ins->op]);
+        put_modrm_reg(enc, 0, dst->reg);
+        return;
+    case OP_JMP:
+        put8(enc, 0xE9);
+        put_label_rel32(enc, dst);
+        return;
+    case OP_JE:
+    case OP_JNE:
+    case OP_JL:
+    case OP_JLE:
+    case OP_JG:
+    case OP_JGE:
+        put8(enc, 0x0F);
+        put8(enc, jcc_codes[ins->op]);
+        put_label_rel32(enc, dst);
+        return;
+    case OP_CALL:
+        put8(enc, 0xE8);
+        add_reloc(enc, dst->sym, RELOC_PLT32);
+        put32(enc, 0);
+        return;
+    case OP_LEAVE:
+        put8(enc, 0xC9);
+        return;
+    case OP_RET:
+        put8(enc, 0xC3);
+        return;
+    case OP_NOP:
+        put8(enc, 0x90);
+        return;
+    case OP_LABEL:
+        map_puti(enc->labels, label_key(dst), enc->code->len + 1);
+        return;
+    case OP_COMMENT:
+        return;
+    default:
+        error(ins);
+    }
+}
+
+// 関数一つ分を機械語に変換してcodeへ追加する
+// 外部シンボルへの参照はrelocsへ追加される(Reloc)
+void encode_func(const AsmFunc *func, Buffer *code, Vector *relocs)
+{
+    Encoder enc = {.code = code, .relocs = relocs, .labels = new_map_in(ARENA_CODEGEN)};
+
+    for (int i = 0; i < func->len; i++)
+    {
+        encode_ins(&enc, &func->ins[i]);
+    }
+
+    // ジャンプ先を埋める
+    for (int i = 0; i < enc.fixups.len; i++)
+    {
+        const LabelRef *fixup = &enc.fixups.data[i];
+        int32_t rel = find_label(&enc, fixup) - (fixup->offset + 4);
+
+        uint8_t *p = code->data + fixup->offset;
+        p[0] = rel;
+        p[1] = rel >> 8;
+        p[2] = rel >> 16;
+        p[3] = rel >> 24;
+    }
+}
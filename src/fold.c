@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shcc.h"
+
+// 定数畳み込み
+//
+// 値は実行時と同じく64bitで計算し（除算・剰余は符号なし、比較は符号付き）、
+// 結果がND_NUMに収まる（32bitの）場合だけ定数に置き換える
+// ノードはその場で書き換えるので、ノード番号を指している親はそのまま使える
+
+// ノードを別のノードの内容で置き換える
+static void replace_node(Ast *ast, NodeId id, NodeId with)
+{
+    *ast_node(ast, id) = *ast_node(ast, with);
+}
+
+// ノードを定数に置き換える
+static void replace_num(Ast *ast, NodeId id, int value)
+{
+    *ast_node(ast, id) = (Node){.ty = ND_NUM, .value = value};
+}
+
+// ノードを空文に置き換える
+static void replace_empty(Ast *ast, NodeId id)
+{
+    *ast_node(ast, id) = (Node){.ty = ND_STMT};
+}
+
+// 定数か
+static bool is_num(const Ast *ast, NodeId id, int value)
+{
+    const Node *node = ast_node(ast, id);
+    return node->ty == ND_NUM && node->value == value;
+}
+
+// 式に副作用（代入・関数呼び出し）がないか
+static bool is_pure(const Ast *ast, NodeId id)
+{
+    const Node *node = ast_node(ast, id);
+    switch (node->ty)
+    {
+    case ND_NUM:
+    case ND_VARIABLE:
+    case ND_ADDR:
+        return true;
+    case ND_ASSIGN:
+    case ND_CALL:
+        return false;
+    case ND_DEREF:
+    case ND_NEG:
+        return is_pure(ast, node->lhs);
+    default:
+        return is_pure(ast, node->lhs) && is_pure(ast, node->rhs);
+    }
+}
+
+// 定数同士の演算
+// 畳み込めない（0除算、結果が32bitに収まらない）場合はfalseを返す
+static bool eval_binary(NodeType_t ty, int64_t lhs, int64_t rhs, int *result)
+{
+    int64_t value;
+    switch (ty)
+    {
+    case ND_PLUS:
+        value = (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+        break;
+    case ND_MINUS:
+        value = (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+        break;
+    case ND_MUL:
+        value = (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+        break;
+    case ND_DIV:
+    case ND_MOD:
+        // div命令と同じく符号なしで割る
+        if (rhs == 0)
+        {
+            return false;
+        }
+        value = (int64_t)(ty == ND_DIV ? (uint64_t)lhs / (uint64_t)rhs : (uint64_t)lhs % (uint64_t)rhs);
+        break;
+    case ND_EQ:
+        value = lhs == rhs;
+        break;
+    case ND_NEQ:
+        value = lhs != rhs;
+        break;
+    case ND_LESS:
+        value = lhs < rhs;
+        break;
+    case ND_LESS_EQ:
+        value = lhs <= rhs;
+        break;
+    case ND_GREATER:
+        value = lhs > rhs;
+        break;
+    case ND_GREATER_EQ:
+        value = lhs >= rhs;
+        break;
+    default:
+        return false;
+    }
+
+    if (value < INT32_MIN || value > INT32_MAX)
+    {
+        return false;
+    }
+    *result = (int)value;
+    return true;
+}
+
+// 片方が定数の二項演算の恒等式による簡約
+// (x+0, 0+x, x-0, x*1, 1*x, x/1 => x)、(x*0, 0*x, x%1 => 0)、(0-x => -x)
+static void simplify_binary(Ast *ast, NodeId id)
+{
+    Node *node = ast_node(ast, id);
+    NodeId lhs = node->lhs;
+    NodeId rhs = node->rhs;
+
+    switch (node->ty)
+    {
+    case ND_PLUS:
+        if (is_num(ast, rhs, 0))
+        {
+            replace_node(ast, id, lhs);
+        }
+        else if (is_num(ast, lhs, 0))
+        {
+            replace_node(ast, id, rhs);
+        }
+        return;
+    case ND_MINUS:
+        if (is_num(ast, rhs, 0))
+        {
+            replace_node(ast, id, lhs);
+        }
+        else if (is_num(ast, lhs, 0))
+        {
+            *node = (Node){.ty = ND_NEG, .lhs = rhs};
+        }
+        return;
+    case ND_MUL:
+        if (is_num(ast, rhs, 1))
+        {
+            replace_node(ast, id, lhs);
+        }
+        else if (is_num(ast, lhs, 1))
+        {
+            replace_node(ast, id, rhs);
+        }
+        else if ((is_num(ast, rhs, 0) && is_pure(ast, lhs)) || (is_num(ast, lhs, 0) && is_pure(ast, rhs)))
+        {
+            replace_num(ast, id, 0);
+        }
+        return;
+    case ND_DIV:
+        if (is_num(ast, rhs, 1))
+        {
+            replace_node(ast, id, lhs);
+        }
+        return;
+    case ND_MOD:
+        if (is_num(ast, rhs, 1) && is_pure(ast, lhs))
+        {
+            replace_num(ast, id, 0);
+        }
+        return;
+    default:
+        return;
+    }
+}
+
+// 式の畳み込み
+static void fold_expr(Ast *ast, NodeId id)
+{
+    Node *node = ast_node(ast, id);
+
+    switch (node->ty)
+    {
+    case ND_NUM:
+    case ND_VARIABLE:
+    case ND_ADDR:
+        return;
+    case ND_CALL:
+    {
+        const FuncInfo *func = ast_func(ast, node->func);
+        const NodeId *args = ast_list(ast, func->args);
+        for (int i = 0; i < func->num_args; i++)
+        {
+            fold_expr(ast, args[i]);
+        }
+        return;
+    }
+    case ND_ASSIGN:
+    {
+        // 左辺は変数なので右辺だけ
+        fold_expr(ast, node->rhs);
+        return;
+    }
+    case ND_DEREF:
+    {
+        fold_expr(ast, node->lhs);
+        return;
+    }
+    case ND_NEG:
+    {
+        fold_expr(ast, node->lhs);
+        const Node *value = ast_node(ast, node->lhs);
+        if (value->ty == ND_NUM && value->value != INT32_MIN)
+        {
+            replace_num(ast, id, -value->value);
+        }
+        return;
+    }
+    default:
+    {
+        break;
+    }
+    }
+
+    fold_expr(ast, node->lhs);
+    fold_expr(ast, node->rhs);
+
+    const Node *lhs = ast_node(ast, node->lhs);
+    const Node *rhs = ast_node(ast, node->rhs);
+    int value;
+    if (lhs->ty == ND_NUM && rhs->ty == ND_NUM && eval_binary(node->ty, lhs->value, rhs->value, &value))
+    {
+        replace_num(ast, id, value);
+        return;
+    }
+
+    simplify_binary(ast, id);
+}
+
+// 文の畳み込み
+// 条件が定数のif/while/forは、実行される側だけを残す
+static void fold_stmt(Ast *ast, NodeId id)
+{
+    Node *node = ast_node(ast, id);
+
+    switch (node->ty)
+    {
+    case ND_BLOCK:
+    {
+        const NodeId *stmts = ast_list(ast, node->stmts);
+        for (int i = 0; i < node->num_stmts; i++)
+        {
+            fold_stmt(ast, stmts[i]);
+        }
+        return;
+    }
+    case ND_RETURN:
+    {
+        fold_expr(ast, node->lhs);
+        return;
+    }
+    case ND_IF:
+    {
+        fold_expr(ast, node->condition);
+        fold_stmt(ast, node->then);
+        if (node->elsethen)
+        {
+            fold_stmt(ast, node->elsethen);
+        }
+
+        const Node *condition = ast_node(ast, node->condition);
+        if (condition->ty == ND_NUM)
+        {
+            NodeId taken = condition->value != 0 ? node->then : node->elsethen;
+            if (taken)
+            {
+                replace_node(ast, id, taken);
+            }
+            else
+            {
+                replace_empty(ast, id);
+            }
+        }
+        return;
+    }
+    case ND_WHILE:
+    {
+        fold_expr(ast, node->condition);
+        fold_stmt(ast, node->then);
+        if (is_num(ast, node->condition, 0))
+        {
+            replace_empty(ast, id);
+        }
+        return;
+    }
+    case ND_FOR:
+    {
+        NodeId initializer = ast_list(ast, node->for_exprs)[0];
+        NodeId loopexpr = ast_list(ast, node->for_exprs)[1];
+        if (initializer)
+        {
+            fold_expr(ast, initializer);
+        }
+        if (node->condition)
+        {
+            fold_expr(ast, node->condition);
+        }
+        if (loopexpr)
+        {
+            fold_expr(ast, loopexpr);
+        }
+        fold_stmt(ast, node->then);
+
+        // 一度も回らないループは初期化処理だけ残す
+        if (node->condition && is_num(ast, node->condition, 0))
+        {
+            if (initializer)
+            {
+                replace_node(ast, id, initializer);
+            }
+            else
+            {
+                replace_empty(ast, id);
+            }
+        }
+        return;
+    }
+    case ND_VARDEF:
+    case ND_STMT:
+    {
+        return;
+    }
+    default:
+    {
+        fold_expr(ast, id);
+        return;
+    }
+    }
+}
+
+// 定数畳み込みと恒等式による簡約
+// パースとコード生成の間で、関数ごとに本体を書き換える
+void fold_constants(Ast *ast)
+{
+    const NodeId *decls = ast_list(ast, ast->decls);
+    for (int i = 0; i < ast->num_decls; i++)
+    {
+        const Node *node = ast_node(ast, decls[i]);
+        if (node->ty == ND_FUNCDEF)
+        {
+            fold_stmt(ast, ast_func(ast, node->func)->body);
+        }
+    }
+}
@@ -0,0 +1,623 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "shcc.h"
+
+// ローカル変数一つ分の大きさ
+#define STACK_UNIT 8
+
+// 引数の最大数
+#define MAX_ARGS 6
+
+// 関数一つ分のIRの作成状態
+//
+// ローカル変数（引数を含む）は仮想レジスタに置く
+// ただしアドレスを取る関数では、ポインタ演算で隣の変数を指せるようにすべてスタックに置く
+// 変数の仮想レジスタはスタック上の位置の順に0から振り、式の途中結果はその後に振る
+typedef struct
+{
+    const Ast *ast;
+    IrFunc *ir;
+    IrBlock *cur;          // 命令を追加中のブロック
+    bool locals_in_memory; // ローカル変数をすべてスタックに置くか
+} IrBuilder;
+
+// IR作成のエラー
+static void error(const char *msg)
+{
+    compile_error("%s", msg);
+}
+
+// ローカル変数のアドレスを取っているか
+static bool takes_local_address(const Ast *ast, NodeId id)
+{
+    if (id == NODE_NONE)
+    {
+        return false;
+    }
+
+    const Node *node = ast_node(ast, id);
+    switch (node->ty)
+    {
+    case ND_NUM:
+    case ND_VARIABLE:
+    case ND_VARDEF:
+    case ND_STMT:
+        return false;
+    case ND_ADDR:
+        return !ast_variable(ast, ast_node(ast, node->lhs)->variable)->is_global;
+    case ND_CALL:
+    {
+        const FuncInfo *func = ast_func(ast, node->func);
+        const NodeId *args = ast_list(ast, func->args);
+        for (int i = 0; i < func->num_args; i++)
+        {
+            if (takes_local_address(ast, args[i]))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    case ND_BLOCK:
+    {
+        const NodeId *stmts = ast_list(ast, node->stmts);
+        for (int i = 0; i < node->num_stmts; i++)
+        {
+            if (takes_local_address(ast, stmts[i]))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    case ND_IF:
+        return takes_local_address(ast, node->condition) || takes_local_address(ast, node->then) ||
+               takes_local_address(ast, node->elsethen);
+    case ND_FOR:
+        return takes_local_address(ast, ast_list(ast, node->for_exprs)[0]) ||
+               takes_local_address(ast, ast_list(ast, node->for_exprs)[1]) ||
+               takes_local_address(ast, node->condition) || takes_local_address(ast, node->then);
+    case ND_WHILE:
+        return takes_local_address(ast, node->condition) || takes_local_address(ast, node->then);
+    case ND_RETURN:
+        return takes_local_address(ast, node->lhs);
+    default:
+        return takes_local_address(ast, node->lhs) || takes_local_address(ast, node->rhs);
+    }
+}
+
+// 新しいブロック
+// 出力順はir_start_blockで命令の追加を始めた順になる
+static IrBlock *new_block(void)
+{
+    IrBlock *block = arena_alloc(ARENA_CODEGEN, sizeof(IrBlock));
+    mem_count(MEM_CODEGEN, sizeof(IrBlock), 1);
+    memset(block, 0, sizeof(IrBlock));
+    block->id = -1;
+
+    return block;
+}
+
+// ブロックへの命令の追加を始める
+static void start_block(IrBuilder *b, IrBlock *block)
+{
+    IrFunc *ir = b->ir;
+    if (ir->num_blocks == ir->block_capacity)
+    {
+        int capacity = ir->block_capacity == 0 ? 16 : ir->block_capacity * 2;
+        ir->blocks = arena_realloc(ARENA_CODEGEN, ir->blocks,
+                                   ir->block_capacity * sizeof(IrBlock *), capacity * sizeof(IrBlock *));
+        mem_count(MEM_CODEGEN, (capacity - ir->block_capacity) * sizeof(IrBlock *), 0);
+        ir->block_capacity = capacity;
+    }
+
+    block->id = ir->num_blocks;
+    ir->blocks[ir->num_blocks++] = block;
+    b->cur = block;
+}
+
+// ブロックの最後の命令が分岐・復帰か
+static bool is_terminated(const IrBlock *block)
+{
+    if (block->len == 0)
+    {
+        return false;
+    }
+
+    int op = block->ins[block->len - 1].op;
+    return op == IR_JMP || op == IR_BR || op == IR_RET;
+}
+
+// 新しい仮想レジスタ
+static int new_vreg(IrBuilder *b)
+{
+    return b->ir->num_vregs++;
+}
+
+// 命令の追加
+// 復帰の後など、到達しない位置の命令は新しいブロックへ追加する
+static IrIns *push_ir(IrBuilder *b, IrOp_t op, IrType_t type, int dst, int lhs, int rhs)
+{
+    if (is_terminated(b->cur))
+    {
+        start_block(b, new_block());
+    }
+
+    IrBlock *block = b->cur;
+    if (block->len == block->capacity)
+    {
+        int capacity = block->capacity == 0 ? 8 : block->capacity * 2;
+        block->ins = arena_realloc(ARENA_CODEGEN, block->ins,
+                                   block->capacity * sizeof(IrIns), capacity * sizeof(IrIns));
+        mem_count(MEM_CODEGEN, (capacity - block->capacity) * sizeof(IrIns), 0);
+        block->capacity = capacity;
+    }
+
+    IrIns *ins = &block->ins[block->len++];
+    *ins = (IrIns){.op = op, .type = type, .dst = dst, .a = lhs, .b = rhs};
+    return ins;
+}
+
+// 制御フローの辺の追加
+static void add_edge(IrBlock *from, IrBlock *to)
+{
+    from->succs[from->num_succs++] = to;
+
+    if (to->num_preds == to->pred_capacity)
+    {
+        int capacity = to->pred_capacity == 0 ? 2 : to->pred_capacity * 2;
+        to->preds = arena_realloc(ARENA_CODEGEN, to->preds,
+                                  to->pred_capacity * sizeof(IrBlock *), capacity * sizeof(IrBlock *));
+        mem_count(MEM_CODEGEN, (capacity - to->pred_capacity) * sizeof(IrBlock *), 0);
+        to->pred_capacity = capacity;
+    }
+    to->preds[to->num_preds++] = from;
+}
+
+// 無条件分岐
+static void push_jmp(IrBuilder *b, IrBlock *to)
+{
+    push_ir(b, IR_JMP, IRT_VOID, IR_NONE, IR_NONE, IR_NONE);
+    add_edge(b->cur, to);
+}
+
+// 条件分岐
+static void push_br(IrBuilder *b, int condition, IrBlock *then, IrBlock *els)
+{
+    push_ir(b, IR_BR, IRT_VOID, IR_NONE, condition, IR_NONE);
+    add_edge(b->cur, then);
+    add_edge(b->cur, els);
+}
+
+// 結果を持つ命令の追加
+// 結果の仮想レジスタを返す
+static int push_value(IrBuilder *b, IrOp_t op, IrType_t type, int lhs, int rhs)
+{
+    int dst = new_vreg(b);
+    push_ir(b, op, type, dst, lhs, rhs);
+    return dst;
+}
+
+// 定数
+static int push_imm(IrBuilder *b, int value)
+{
+    int dst = new_vreg(b);
+    push_ir(b, IR_IMM, IRT_I64, dst, IR_NONE, IR_NONE)->imm = value;
+    return dst;
+}
+
+// 変数を置いた仮想レジスタ（スタック・データ領域にあるならIR_NONE）
+static int variable_vreg(const IrBuilder *b, const VariableInfo *variable)
+{
+    if (variable->is_global || b->locals_in_memory)
+    {
+        return IR_NONE;
+    }
+
+    return variable->offset / STACK_UNIT;
+}
+
+// スタック・データ領域にある変数のアドレス
+static int variable_address(IrBuilder *b, const VariableInfo *variable)
+{
+    int dst = new_vreg(b);
+    if (variable->is_global)
+    {
+        push_ir(b, IR_GLOBAL, IRT_PTR, dst, IR_NONE, IR_NONE)->sym = variable->name;
+    }
+    else
+    {
+        push_ir(b, IR_LOCAL, IRT_PTR, dst, IR_NONE, IR_NONE)->imm = -(variable->offset + STACK_UNIT);
+    }
+    return dst;
+}
+
+// 変数の読み出し
+static int build_load(IrBuilder *b, const VariableInfo *variable)
+{
+    int var = variable_vreg(b, variable);
+    if (var != IR_NONE)
+    {
+        return var;
+    }
+
+    return push_value(b, IR_LOAD, IRT_I64, variable_address(b, variable), IR_NONE);
+}
+
+// 変数への書き込み
+static void build_store(IrBuilder *b, const VariableInfo *variable, int value)
+{
+    int var = variable_vreg(b, variable);
+    if (var != IR_NONE)
+    {
+        push_ir(b, IR_COPY, IRT_I64, var, value, IR_NONE);
+    }
+    else
+    {
+        push_ir(b, IR_STORE, IRT_VOID, IR_NONE, variable_address(b, variable), value);
+    }
+}
+
+static int build_expr(IrBuilder *b, NodeId id);
+
+// 関数呼び出し
+// 引数は右から評価する
+static int build_call(IrBuilder *b, const FuncInfo *func)
+{
+    assert(func->num_args <= MAX_ARGS);
+
+    int *values = arena_alloc(ARENA_CODEGEN, (func->num_args + 1) * sizeof(int));
+    const NodeId *args = ast_list(b->ast, func->args);
+    for (int i = func->num_args - 1; i >= 0; i--)
+    {
+        values[i] = build_expr(b, args[i]);
+    }
+
+    int dst = new_vreg(b);
+    IrIns *ins = push_ir(b, IR_CALL, IRT_I64, dst, IR_NONE, IR_NONE);
+    ins->sym = func->name;
+    ins->args = values;
+    ins->num_args = func->num_args;
+    return dst;
+}
+
+// 二項演算子に対応する命令
+static IrOp_t binary_op(NodeType_t ty)
+{
+    switch (ty)
+    {
+    case ND_PLUS:
+        return IR_ADD;
+    case ND_MINUS:
+        return IR_SUB;
+    case ND_MUL:
+        return IR_MUL;
+    case ND_DIV:
+        return IR_DIV;
+    case ND_MOD:
+        return IR_MOD;
+    case ND_EQ:
+        return IR_EQ;
+    case ND_NEQ:
+        return IR_NE;
+    case ND_LESS:
+        return IR_LT;
+    case ND_LESS_EQ:
+        return IR_LE;
+    case ND_GREATER:
+        return IR_GT;
+    case ND_GREATER_EQ:
+        return IR_GE;
+    default:
+        error("未対応のノード形式です");
+        return IR_ADD;
+    }
+}
+
+// 式のIR
+// 結果を置いた仮想レジスタを返す
+static int build_expr(IrBuilder *b, NodeId id)
+{
+    const Ast *ast = b->ast;
+    const Node *node = ast_node(ast, id);
+
+    switch (node->ty)
+    {
+    case ND_NUM:
+    {
+        return push_imm(b, node->value);
+    }
+    case ND_CALL:
+    {
+        return build_call(b, ast_func(ast, node->func));
+    }
+    case ND_ASSIGN:
+    {
+        // 代入式なら、必ず左辺は変数
+        int value = build_expr(b, node->rhs);
+        build_store(b, ast_variable(ast, ast_node(ast, node->lhs)->variable), value);
+        return value;
+    }
+    case ND_VARIABLE:
+    {
+        return build_load(b, ast_variable(ast, node->variable));
+    }
+    case ND_ADDR:
+    {
+        return variable_address(b, ast_variable(ast, ast_node(ast, node->lhs)->variable));
+    }
+    case ND_DEREF:
+    {
+        return push_value(b, IR_LOAD, IRT_I64, build_expr(b, node->lhs), IR_NONE);
+    }
+    case ND_NEG:
+    {
+        return push_value(b, IR_NEG, IRT_I64, build_expr(b, node->lhs), IR_NONE);
+    }
+    default:
+    {
+        break;
+    }
+    }
+
+    int lhs = build_expr(b, node->lhs);
+    int rhs = build_expr(b, node->rhs);
+    IrOp_t op = binary_op(node->ty);
+    return push_value(b, op, op >= IR_EQ ? IRT_BOOL : IRT_I64, lhs, rhs);
+}
+
+// 文のIR
+// 式文なら結果を置いた仮想レジスタを、それ以外はIR_NONEを返す
+static int build_stmt(IrBuilder *b, NodeId id)
+{
+    const Ast *ast = b->ast;
+    const Node *node = ast_node(ast, id);
+
+    switch (node->ty)
+    {
+    case ND_BLOCK:
+    {
+        const NodeId *stmts = ast_list(ast, node->stmts);
+        for (int i = 0; i < node->num_stmts; i++)
+        {
+            build_stmt(b, stmts[i]);
+        }
+        return IR_NONE;
+    }
+    case ND_RETURN:
+    {
+        push_ir(b, IR_RET, IRT_VOID, IR_NONE, build_expr(b, node->lhs), IR_NONE);
+        return IR_NONE;
+    }
+    case ND_IF:
+    {
+        IrBlock *then = new_block();
+        IrBlock *els = node->elsethen ? new_block() : NULL;
+        IrBlock *end = new_block();
+
+        push_br(b, build_expr(b, node->condition), then, els != NULL ? els : end);
+        start_block(b, then);
+        build_stmt(b, node->then);
+        push_jmp(b, end);
+        if (els != NULL)
+        {
+            start_block(b, els);
+            build_stmt(b, node->elsethen);
+            push_jmp(b, end);
+        }
+        start_block(b, end);
+        return IR_NONE;
+    }
+    case ND_FOR:
+    {
+        NodeId initializer = ast_list(ast, node->for_exprs)[0];
+        NodeId loopexpr = ast_list(ast, node->for_exprs)[1];
+        IrBlock *cond = new_block();
+        IrBlock *body = new_block();
+        IrBlock *step = new_block();
+        IrBlock *end = new_block();
+
+        if (initializer)
+        {
+            build_expr(b, initializer);
+        }
+        push_jmp(b, cond);
+        start_block(b, cond);
+        if (node->condition)
+        {
+            push_br(b, build_expr(b, node->condition), body, end);
+        }
+        else
+        {
+            push_jmp(b, body);
+        }
+        start_block(b, body);
+        build_stmt(b, node->then);
+        push_jmp(b, step);
+        start_block(b, step);
+        if (loopexpr)
+        {
+            build_expr(b, loopexpr);
+        }
+        push_jmp(b, cond);
+        start_block(b, end);
+        return IR_NONE;
+    }
+    case ND_WHILE:
+    {
+        IrBlock *cond = new_block();
+        IrBlock *body = new_block();
+        IrBlock *end = new_block();
+
+        push_jmp(b, cond);
+        start_block(b, cond);
+        push_br(b, build_expr(b, node->condition), body, end);
+        start_block(b, body);
+        build_stmt(b, node->then);
+        push_jmp(b, cond);
+        start_block(b, end);
+        return IR_NONE;
+    }
+    case ND_VARDEF:
+    case ND_STMT:
+    {
+        // 変数の領域は関数単位で確保済みなので何もしない
+        return IR_NONE;
+    }
+    default:
+    {
+        return build_expr(b, id);
+    }
+    }
+}
+
+// 関数のIRを作成する
+//
+// 関数の最後の文が式文なら、スタックマシン版と同じくその値を戻り値とする
+IrFunc *ir_build(const Ast *ast, const FuncInfo *func)
+{
+    IrFunc *ir = arena_alloc(ARENA_CODEGEN, sizeof(IrFunc));
+    mem_count(MEM_CODEGEN, sizeof(IrFunc), 1);
+    memset(ir, 0, sizeof(IrFunc));
+    ir->name = func->name;
+    ir->num_args = func->num_args;
+
+    IrBuilder b = {.ast = ast, .ir = ir, .locals_in_memory = takes_local_address(ast, func->body)};
+    ir->stack_size = b.locals_in_memory ? func->stack_size : 0;
+
+    // 変数の仮想レジスタはスタック上の位置の番号と同じにする
+    ir->num_vars = b.locals_in_memory ? 0 : func->stack_size / STACK_UNIT;
+    ir->num_vregs = ir->num_vars;
+
+    start_block(&b, new_block());
+
+    assert(func->num_args <= MAX_ARGS);
+    const NodeId *params = ast_list(ast, func->args);
+    for (int i = 0; i < func->num_args; i++)
+    {
+        const VariableInfo *variable = ast_variable(ast, params[i]);
+        int var = variable_vreg(&b, variable);
+        if (var != IR_NONE)
+        {
+            push_ir(&b, IR_PARAM, IRT_I64, var, IR_NONE, IR_NONE)->imm = i;
+        }
+        else
+        {
+            int value = new_vreg(&b);
+            push_ir(&b, IR_PARAM, IRT_I64, value, IR_NONE, IR_NONE)->imm = i;
+            build_store(&b, variable, value);
+        }
+    }
+
+    // 本体はブロック
+    const Node *body = ast_node(ast, func->body);
+    const NodeId *stmts = ast_list(ast, body->stmts);
+    int last = IR_NONE;
+    for (int i = 0; i < body->num_stmts; i++)
+    {
+        last = build_stmt(&b, stmts[i]);
+    }
+    if (!is_terminated(b.cur))
+    {
+        push_ir(&b, IR_RET, IRT_VOID, IR_NONE, last, IR_NONE);
+    }
+
+    return ir;
+}
+
+// 制御フローの辺を取り除く
+// 行き先のphiからも、その辺で通ってくる値を取り除く
+void ir_remove_edge(IrBlock *from, int succ)
+{
+    IrBlock *to = from->succs[succ];
+    for (int i = succ; i + 1 < from->num_succs; i++)
+    {
+        from->succs[i] = from->succs[i + 1];
+    }
+    from->num_succs--;
+
+    // 同じブロックから二本の辺がある場合は後ろのものを取り除く
+    int index = -1;
+    for (int i = 0; i < to->num_preds; i++)
+    {
+        if (to->preds[i] == from)
+        {
+            index = i;
+        }
+    }
+    assert(index >= 0);
+
+    for (int i = index; i + 1 < to->num_preds; i++)
+    {
+        to->preds[i] = to->preds[i + 1];
+    }
+    to->num_preds--;
+
+    for (int i = 0; i < to->len && to->ins[i].op == IR_PHI; i++)
+    {
+        IrIns *phi = &to->ins[i];
+        for (int j = index; j + 1 < phi->num_args; j++)
+        {
+            phi->args[j] = phi->args[j + 1];
+        }
+        phi->num_args--;
+    }
+}
+
+// 入口から到達するブロックに印を付ける
+static void mark_reachable(bool *reachable, const IrBlock *block)
+{
+    if (reachable[block->id])
+    {
+        return;
+    }
+
+    reachable[block->id] = true;
+    for (int i = 0; i < block->num_succs; i++)
+    {
+        mark_reachable(reachable, block->succs[i]);
+    }
+}
+
+// 入口から到達しないブロックを取り除き、残ったブロックの番号を振り直す
+void ir_remove_unreachable(IrFunc *ir)
+{
+    bool *reachable = arena_alloc(ARENA_CODEGEN, (ir->num_blocks + 1) * sizeof(bool));
+    memset(reachable, 0, (ir->num_blocks + 1) * sizeof(bool));
+    mem_count(MEM_CODEGEN, (ir->num_blocks + 1) * sizeof(bool), 1);
+    mark_reachable(reachable, ir->blocks[0]);
+
+    int kept = 0;
+    for (int i = 0; i < ir->num_blocks; i++)
+    {
+        IrBlock *block = ir->blocks[i];
+        if (!reachable[i])
+        {
+            while (block->num_succs > 0)
+            {
+                ir_remove_edge(block, block->num_succs - 1);
+            }
+            continue;
+        }
+        ir->blocks[kept++] = block;
+    }
+    ir->num_blocks = kept;
+
+    for (int i = 0; i < ir->num_blocks; i++)
+    {
+        ir->blocks[i]->id = i;
+    }
+}
+
+// IRの最適化
+// SSA形式にしてから、条件付き定数伝播と不要な命令の削除を行なう
+void ir_optimize(IrFunc *ir)
+{
+    ir_to_ssa(ir);
+    ir_sccp(ir);
+}
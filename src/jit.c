@@ -0,0 +1,153 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shcc.h"
+
+// 外部関数呼び出し用のスタブのサイズ
+// jmp [rip+0] (6バイト) の直後に飛び先のアドレス(8バイト)を置く
+#define STUB_SIZE 16
+
+// グローバル変数一つ分のサイズ
+#define GLOBAL_VARIABLE_SIZE 8
+
+// JITの実行エラー
+static void error(const char *msg, const char *detail)
+{
+    fprintf(stderr, "%s: %s\n", msg, detail);
+
+    exit(1);
+}
+
+// サイズをページ境界に切り上げる
+static size_t page_align(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return (size + page - 1) / page * page;
+}
+
+// 外部シンボルを解決するための共有ライブラリを読み込む
+void jit_load_library(const char *path)
+{
+    if (dlopen(path, RTLD_NOW | RTLD_GLOBAL) == NULL)
+    {
+        error("ライブラリを読み込めません", dlerror());
+    }
+}
+
+// 外部関数へのスタブを作成する
+// 外部関数は実行イメージから2GB以上離れていることがあるので、rel32で直接は呼べない
+static uint8_t *make_stub(uint8_t *stub, const char *name)
+{
+    void *addr = dlsym(RTLD_DEFAULT, name);
+    if (addr == NULL)
+    {
+        error("シンボルが見つかりません", name);
+    }
+
+    static const uint8_t jmp_rip[] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+    memcpy(stub, jmp_rip, sizeof(jmp_rip));
+    memcpy(stub + sizeof(jmp_rip), &addr, sizeof(addr));
+
+    return stub;
+}
+
+// プログラムを実行可能メモリ上に展開してmainを呼び出す
+// mainの戻り値を返す
+int jit_run(const AsmProgram *prog)
+{
+    phase_begin(PHASE_EMIT);
+
+    Buffer *text = new_buffer_in(ARENA_CODEGEN);
+    Vector *relocs = new_vector_in(ARENA_CODEGEN);
+    Map *addresses = new_map_in(ARENA_CODEGEN);
+    uint32_t *func_offsets = arena_alloc(ARENA_CODEGEN, (prog->funcs->len + 1) * sizeof(uint32_t));
+
+    for (int i = 0; i < prog->funcs->len; i++)
+    {
+        buf_align(text, 16, 0x90);
+        func_offsets[i] = text->len;
+        encode_func(prog->funcs->data[i], text, relocs);
+    }
+    buf_align(text, 16, 0x90);
+
+    // 配置: [機械語][スタブ] | [グローバル変数]
+    // スタブは再配置一つにつき高々一つなので、その分だけ確保しておく
+    size_t code_size = page_align(text->len + relocs->len * STUB_SIZE + 1);
+    size_t data_size = page_align(prog->globals->len * GLOBAL_VARIABLE_SIZE + 1);
+
+    uint8_t *image = mmap(NULL, code_size + data_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image == MAP_FAILED)
+    {
+        error("実行領域を確保できません", strerror(errno));
+    }
+    uint8_t *stubs = image + text->len;
+    uint8_t *data = image + code_size;
+
+    memcpy(image, text->data, text->len);
+
+    // 定義済みシンボルのアドレス
+    for (int i = 0; i < prog->funcs->len; i++)
+    {
+        const AsmFunc *func = prog->funcs->data[i];
+        map_put(addresses, func->name, image + func_offsets[i]);
+    }
+    for (int i = 0; i < prog->globals->len; i++)
+    {
+        map_put(addresses, prog->globals->data[i], data + i * GLOBAL_VARIABLE_SIZE);
+    }
+
+    // 再配置
+    for (int i = 0; i < relocs->len; i++)
+    {
+        const Reloc *reloc = relocs->data[i];
+        uint8_t *target = map_get(addresses, reloc->sym);
+
+        if (target == NULL)
+        {
+            // 外部の変数は参照できない
+            if (reloc->type != RELOC_PLT32)
+            {
+                error("外部の変数は参照できません", reloc->sym);
+            }
+
+            target = make_stub(stubs, reloc->sym);
+            stubs += STUB_SIZE;
+            map_put(addresses, reloc->sym, target);
+        }
+
+        int32_t rel = target + reloc->addend - (image + reloc->offset);
+        memcpy(image + reloc->offset, &rel, sizeof(rel));
+    }
+
+    if (mprotect(image, code_size, PROT_READ | PROT_EXEC) != 0)
+    {
+        error("実行権限を設定できません", strerror(errno));
+    }
+
+    int (*entry)(void) = (int (*)(void))map_get(addresses, "main");
+    if (entry == NULL)
+    {
+        error("シンボルが見つかりません", "main");
+    }
+
+    report_count(COUNT_OUTPUT_BYTES, text->len);
+    phase_end(PHASE_EMIT);
+
+    int status = entry();
+    // 呼び出し先のprintfなどの出力を確定させておく
+    fflush(stdout);
+
+    munmap(image, code_size + data_size);
+
+    return status;
+}
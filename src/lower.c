@@ -0,0 +1,502 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "shcc.h"
+
+// 引数に使うレジスタ
+static const Register_t arg_regs[] = {REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9};
+
+// 関数一つ分の変換状態
+//
+// IRの仮想レジスタはそのままLIRの仮想レジスタとして使い、変換中に必要になったものはその後に振る
+// 定数とスタック上の変数のアドレスは、使う命令のオペランドへ直接埋め込めるので、その場では命令を作らない
+typedef struct
+{
+    const IrFunc *ir;
+    LirFunc *lir;
+    const IrIns **defs; // 仮想レジスタごとの、定数・アドレスを作る命令（埋め込めないものはNULL）
+    int *phi_temps;     // phiの結果ごとの、先行ブロックから値を受け渡す仮想レジスタ
+    bool *reachable;    // ブロックごとの、入口から到達するか
+} Lowerer;
+
+// 変換のエラー
+static void error(const char *msg)
+{
+    compile_error("%s", msg);
+}
+
+// 仮想レジスタオペランド
+static Operand vreg_operand(int vreg)
+{
+    return (Operand){.kind = OPD_VREG, .imm = vreg};
+}
+
+// 仮想レジスタが指すメモリのオペランド
+static Operand vmem_operand(int vreg)
+{
+    return (Operand){.kind = OPD_VMEM, .imm = vreg};
+}
+
+// レジスタオペランド
+static Operand reg_operand(Register_t reg)
+{
+    return (Operand){.kind = OPD_REG, .reg = reg};
+}
+
+// 即値オペランド
+static Operand imm_operand(int imm)
+{
+    return (Operand){.kind = OPD_IMM, .imm = imm};
+}
+
+// ブロックのラベルオペランド
+static Operand block_operand(const IrBlock *block)
+{
+    return (Operand){.kind = OPD_LABEL, .sym = "bb", .imm = block->id};
+}
+
+// 命令の追加
+static void push_lir(Lowerer *lw, Opcode_t op, Operand dst, Operand src)
+{
+    LirFunc *lir = lw->lir;
+    if (lir->len == lir->capacity)
+    {
+        int capacity = lir->capacity == 0 ? 64 : lir->capacity * 2;
+        lir->ins = arena_realloc(ARENA_CODEGEN, lir->ins,
+                                 lir->capacity * sizeof(Ins), capacity * sizeof(Ins));
+        mem_count(MEM_CODEGEN, (capacity - lir->capacity) * sizeof(Ins), 0);
+        lir->capacity = capacity;
+    }
+
+    lir->ins[lir->len++] = (Ins){.op = op, .dst = dst, .src = src};
+}
+
+// 新しい仮想レジスタ
+static int new_vreg(Lowerer *lw)
+{
+    return lw->lir->num_vregs++;
+}
+
+// 値が即値として埋め込めるか
+static bool is_imm(const Lowerer *lw, int v)
+{
+    return lw->defs[v] != NULL && lw->defs[v]->op == IR_IMM;
+}
+
+// 値を置いた仮想レジスタ
+// 埋め込むはずだった定数・アドレスは、ここで新しい仮想レジスタに作る
+static int value_vreg(Lowerer *lw, int v)
+{
+    const IrIns *def = lw->defs[v];
+    if (def == NULL)
+    {
+        return v;
+    }
+
+    int t = new_vreg(lw);
+    if (def->op == IR_IMM)
+    {
+        push_lir(lw, OP_MOV, vreg_operand(t), imm_operand(def->imm));
+    }
+    else
+    {
+        push_lir(lw, OP_LEA, vreg_operand(t), (Operand){.kind = OPD_MEM, .reg = REG_RBP, .imm = def->imm});
+    }
+    return t;
+}
+
+// 値のオペランド（定数なら即値）
+static Operand value_operand(Lowerer *lw, int v)
+{
+    if (is_imm(lw, v))
+    {
+        return imm_operand(lw->defs[v]->imm);
+    }
+    return vreg_operand(value_vreg(lw, v));
+}
+
+// 値が指すメモリのオペランド（スタック上の変数ならRBPからの位置）
+static Operand memory_operand(Lowerer *lw, int v)
+{
+    const IrIns *def = lw->defs[v];
+    if (def != NULL && def->op == IR_LOCAL)
+    {
+        return (Operand){.kind = OPD_MEM, .reg = REG_RBP, .imm = def->imm};
+    }
+    return vmem_operand(value_vreg(lw, v));
+}
+
+// 値を仮想レジスタへ移す（スタック上の変数のアドレスはleaで作る）
+static void lower_move(Lowerer *lw, Operand dst, int v)
+{
+    const IrIns *def = lw->defs[v];
+    if (def != NULL && def->op == IR_LOCAL)
+    {
+        push_lir(lw, OP_LEA, dst, memory_operand(lw, v));
+    }
+    else
+    {
+        push_lir(lw, OP_MOV, dst, value_operand(lw, v));
+    }
+}
+
+// 比較命令に対応するsetcc命令
+static Opcode_t setcc_op(IrOp_t op)
+{
+    switch (op)
+    {
+    case IR_EQ:
+        return OP_SETE;
+    case IR_NE:
+        return OP_SETNE;
+    case IR_LT:
+        return OP_SETL;
+    case IR_LE:
+        return OP_SETLE;
+    case IR_GT:
+        return OP_SETG;
+    case IR_GE:
+        return OP_SETGE;
+    default:
+        error("未対応のIR命令です");
+        return OP_NOP;
+    }
+}
+
+// 関数呼び出し
+// 引数をすべて引数レジスタへ移してから呼ぶ
+static void lower_call(Lowerer *lw, const IrIns *ins)
+{
+    assert(ins->num_args <= NUMOF(arg_regs));
+
+    for (int i = 0; i < ins->num_args; i++)
+    {
+        lower_move(lw, reg_operand(arg_regs[i]), ins->args[i]);
+    }
+
+    // 引数の数
+    if (ins->num_args > 0)
+    {
+        push_lir(lw, OP_MOV, reg_operand(REG_RAX), imm_operand(ins->num_args));
+    }
+    push_lir(lw, OP_CALL, (Operand){.kind = OPD_SYM, .sym = ins->sym}, (Operand){0});
+    push_lir(lw, OP_MOV, vreg_operand(ins->dst), reg_operand(REG_RAX));
+}
+
+// 二項演算
+// 2オペランド形式にするため、結果の仮想レジスタへ左辺を移してから演算する
+static void lower_binary(Lowerer *lw, const IrIns *ins)
+{
+    Operand dst = vreg_operand(ins->dst);
+
+    switch (ins->op)
+    {
+    case IR_ADD:
+    case IR_SUB:
+    {
+        Operand rhs = value_operand(lw, ins->b);
+        if (ins->dst == ins->b)
+        {
+            // 左辺を移すと右辺が壊れる
+            int t = new_vreg(lw);
+            push_lir(lw, OP_MOV, vreg_operand(t), rhs);
+            rhs = vreg_operand(t);
+        }
+        push_lir(lw, OP_MOV, dst, value_operand(lw, ins->a));
+        push_lir(lw, ins->op == IR_ADD ? OP_ADD : OP_SUB, dst, rhs);
+        return;
+    }
+    case IR_MUL:
+    {
+        push_lir(lw, OP_MOV, reg_operand(REG_RAX), value_operand(lw, ins->a));
+        push_lir(lw, OP_MUL, vreg_operand(value_vreg(lw, ins->b)), (Operand){0});
+        push_lir(lw, OP_MOV, dst, reg_operand(REG_RAX));
+        return;
+    }
+    case IR_DIV:
+    case IR_MOD:
+    {
+        // div命令は rax = ((rdx << 64) | rax) / src、rdx = 余り
+        int rhs = value_vreg(lw, ins->b);
+        push_lir(lw, OP_MOV, reg_operand(REG_RAX), value_operand(lw, ins->a));
+        push_lir(lw, OP_MOV, reg_operand(REG_RDX), imm_operand(0));
+        push_lir(lw, OP_DIV, vreg_operand(rhs), (Operand){0});
+        push_lir(lw, OP_MOV, dst, reg_operand(ins->op == IR_DIV ? REG_RAX : REG_RDX));
+        return;
+    }
+    default:
+    {
+        // cmpの左辺はレジスタ、右辺は即値でもよい
+        int lhs = value_vreg(lw, ins->a);
+        push_lir(lw, OP_CMP, vreg_operand(lhs), value_operand(lw, ins->b));
+        push_lir(lw, setcc_op(ins->op), reg_operand(REG_AL), (Operand){0});
+        push_lir(lw, OP_MOVZB, dst, reg_operand(REG_AL));
+        return;
+    }
+    }
+}
+
+// 出力順で次に出力するブロック（なければNULL）
+static const IrBlock *next_block(const Lowerer *lw, const IrBlock *block)
+{
+    for (int i = block->id + 1; i < lw->ir->num_blocks; i++)
+    {
+        if (lw->reachable[i])
+        {
+            return lw->ir->blocks[i];
+        }
+    }
+    return NULL;
+}
+
+// phiの結果を受け渡す仮想レジスタ
+static int phi_temp(Lowerer *lw, int dst)
+{
+    if (lw->phi_temps[dst] == IR_NONE)
+    {
+        lw->phi_temps[dst] = new_vreg(lw);
+    }
+    return lw->phi_temps[dst];
+}
+
+// 後続ブロックのphiへ値を渡す
+//
+// phi同士が互いの結果を使っても壊れないように、いったんphiごとの仮想レジスタへ移し、
+// 後続ブロックの先頭でphiの結果へ移す
+static void lower_phi_moves(Lowerer *lw, const IrBlock *block)
+{
+    for (int s = 0; s < block->num_succs; s++)
+    {
+        const IrBlock *succ = block->succs[s];
+        if (s == 1 && succ == block->succs[0])
+        {
+            continue;
+        }
+        for (int i = 0; i < succ->len && succ->ins[i].op == IR_PHI; i++)
+        {
+            const IrIns *phi = &succ->ins[i];
+            for (int j = 0; j < succ->num_preds; j++)
+            {
+                if (succ->preds[j] == block)
+                {
+                    lower_move(lw, vreg_operand(phi_temp(lw, phi->dst)), phi->args[j]);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// 分岐命令
+// 次に出力するブロックへの分岐は省く
+static void lower_branch(Lowerer *lw, const IrBlock *block, const IrIns *ins)
+{
+    const IrBlock *next = next_block(lw, block);
+    const IrBlock *then = block->succs[0];
+
+    lower_phi_moves(lw, block);
+
+    if (ins->op == IR_BR)
+    {
+        const IrBlock *els = block->succs[1];
+        if (is_imm(lw, ins->a))
+        {
+            // 条件が定数なら行き先は決まっている
+            then = lw->defs[ins->a]->imm != 0 ? then : els;
+        }
+        else
+        {
+            push_lir(lw, OP_CMP, vreg_operand(value_vreg(lw, ins->a)), imm_operand(0));
+            push_lir(lw, OP_JE, block_operand(els), (Operand){0});
+        }
+    }
+
+    if (then != next)
+    {
+        push_lir(lw, OP_JMP, block_operand(then), (Operand){0});
+    }
+}
+
+// 命令の変換
+static void lower_ins(Lowerer *lw, const IrBlock *block, const IrIns *ins)
+{
+    switch (ins->op)
+    {
+    case IR_IMM:
+    case IR_LOCAL:
+    {
+        // 埋め込めない（変数へ直接書く）場合だけ作る
+        if (lw->defs[ins->dst] == NULL)
+        {
+            if (ins->op == IR_IMM)
+            {
+                push_lir(lw, OP_MOV, vreg_operand(ins->dst), imm_operand(ins->imm));
+            }
+            else
+            {
+                push_lir(lw, OP_LEA, vreg_operand(ins->dst), (Operand){.kind = OPD_MEM, .reg = REG_RBP, .imm = ins->imm});
+            }
+        }
+        return;
+    }
+    case IR_COPY:
+    {
+        lower_move(lw, vreg_operand(ins->dst), ins->a);
+        return;
+    }
+    case IR_PHI:
+    {
+        push_lir(lw, OP_MOV, vreg_operand(ins->dst), vreg_operand(phi_temp(lw, ins->dst)));
+        return;
+    }
+    case IR_PARAM:
+    {
+        push_lir(lw, OP_MOV, vreg_operand(ins->dst), reg_operand(arg_regs[ins->imm]));
+        return;
+    }
+    case IR_NEG:
+    {
+        push_lir(lw, OP_MOV, vreg_operand(ins->dst), value_operand(lw, ins->a));
+        push_lir(lw, OP_NEG, vreg_operand(ins->dst), (Operand){0});
+        return;
+    }
+    case IR_GLOBAL:
+    {
+        push_lir(lw, OP_LEA, vreg_operand(ins->dst), (Operand){.kind = OPD_SYM, .sym = ins->sym});
+        return;
+    }
+    case IR_LOAD:
+    {
+        push_lir(lw, OP_MOV, vreg_operand(ins->dst), memory_operand(lw, ins->a));
+        return;
+    }
+    case IR_STORE:
+    {
+        // メモリへ即値は書けないので値はレジスタに置く
+        Operand value = vreg_operand(value_vreg(lw, ins->b));
+        push_lir(lw, OP_MOV, memory_operand(lw, ins->a), value);
+        return;
+    }
+    case IR_CALL:
+    {
+        lower_call(lw, ins);
+        return;
+    }
+    case IR_JMP:
+    case IR_BR:
+    {
+        lower_branch(lw, block, ins);
+        return;
+    }
+    case IR_RET:
+    {
+        if (ins->a != IR_NONE)
+        {
+            push_lir(lw, OP_MOV, reg_operand(REG_RAX), value_operand(lw, ins->a));
+        }
+        push_lir(lw, OP_RET, (Operand){0}, (Operand){0});
+        return;
+    }
+    default:
+    {
+        lower_binary(lw, ins);
+        return;
+    }
+    }
+}
+
+// ブロックにラベルが必要か
+// 直前に出力したブロックから、分岐命令を省いて流れ込むだけならラベルは要らない
+static bool needs_label(const IrBlock *block, const IrBlock *prev)
+{
+    for (int i = 0; i < block->num_preds; i++)
+    {
+        const IrBlock *pred = block->preds[i];
+        if (pred != prev || pred->succs[0] != block || (pred->num_succs == 2 && pred->succs[1] == block))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 入口から到達するブロックに印を付ける
+static void mark_reachable(bool *reachable, const IrBlock *block)
+{
+    if (reachable[block->id])
+    {
+        return;
+    }
+
+    reachable[block->id] = true;
+    for (int i = 0; i < block->num_succs; i++)
+    {
+        mark_reachable(reachable, block->succs[i]);
+    }
+}
+
+// IRを仮想レジスタの命令列へ変換する
+//
+// mul/div/setcc/callが使う物理レジスタだけを明示し、それ以外はすべて仮想レジスタのまま残す
+// 入口から到達しないブロックは出力しない
+LirFunc *lower_func(const IrFunc *ir)
+{
+    LirFunc *lir = arena_alloc(ARENA_CODEGEN, sizeof(LirFunc));
+    mem_count(MEM_CODEGEN, sizeof(LirFunc), 1);
+    memset(lir, 0, sizeof(LirFunc));
+    lir->num_vregs = ir->num_vregs;
+    lir->num_args = ir->num_args;
+    lir->stack_size = ir->stack_size;
+
+    Lowerer lw = {.ir = ir, .lir = lir};
+    lw.defs = arena_alloc(ARENA_CODEGEN, (ir->num_vregs + 1) * sizeof(IrIns *));
+    lw.reachable = arena_alloc(ARENA_CODEGEN, (ir->num_blocks + 1) * sizeof(bool));
+    lw.phi_temps = arena_alloc(ARENA_CODEGEN, (ir->num_vregs + 1) * sizeof(int));
+    memset(lw.defs, 0, (ir->num_vregs + 1) * sizeof(IrIns *));
+    memset(lw.reachable, 0, (ir->num_blocks + 1) * sizeof(bool));
+    mem_count(MEM_CODEGEN, (ir->num_vregs + 1) * (sizeof(IrIns *) + sizeof(int)) + (ir->num_blocks + 1) * sizeof(bool), 3);
+    for (int v = 0; v < ir->num_vregs; v++)
+    {
+        lw.phi_temps[v] = IR_NONE;
+    }
+
+    // 変数以外の仮想レジスタは一度しか書かれないので、定数・アドレスは使う位置に埋め込める
+    for (int i = 0; i < ir->num_blocks; i++)
+    {
+        const IrBlock *block = ir->blocks[i];
+        for (int j = 0; j < block->len; j++)
+        {
+            const IrIns *ins = &block->ins[j];
+            if ((ins->op == IR_IMM || ins->op == IR_LOCAL) && ins->dst >= ir->num_vars)
+            {
+                lw.defs[ins->dst] = ins;
+            }
+        }
+    }
+    mark_reachable(lw.reachable, ir->blocks[0]);
+
+    const IrBlock *prev = NULL;
+    for (int i = 0; i < ir->num_blocks; i++)
+    {
+        const IrBlock *block = ir->blocks[i];
+        if (!lw.reachable[i])
+        {
+            continue;
+        }
+        if (needs_label(block, prev))
+        {
+            push_lir(&lw, OP_LABEL, block_operand(block), (Operand){0});
+        }
+        prev = block;
+        for (int j = 0; j < block->len; j++)
+        {
+            lower_ins(&lw, block, &block->ins[j]);
+        }
+    }
+
+    return lir;
+}
@@ -4,24 +4,62 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #include "shcc.h"
 
-void runtest(void);
+int runtest(const char *cases_path, int jobs);
+
+// 各種レポートの出力
+static void print_reports(bool needs_mem_report, bool needs_cache_stats, bool needs_peephole_stats, bool json)
+{
+    time_report_print(json);
+    if (needs_mem_report)
+    {
+        mem_report_print(json);
+    }
+    if (needs_cache_stats)
+    {
+        cache_stats_print();
+    }
+    if (needs_peephole_stats)
+    {
+        peephole_stats_print();
+    }
+}
 
 // main
 int main(int argc, char **argv)
 {
     bool needs_dump_token_list = false;
     bool needs_dump_node_list = false;
+    bool needs_dump_ir = false;
+    bool needs_object = false;
+    bool needs_run = false;
+    bool needs_test = false;
+    bool needs_time_report = false;
+    bool needs_json_report = false;
+    bool needs_mem_report = false;
+    bool needs_cache_stats = false;
+    bool needs_peephole_stats = false;
+    // コード生成の並列数（既定はCPU数）
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    // 最適化レベル（既定はスタックマシン）
+    int opt_level = 0;
     char *source_code = NULL;
+    char *source_path = NULL;
+    char *output_path = NULL;
+    // パース結果のスナップショットの書き出し先・読み込み元
+    char *snapshot_out = NULL;
+    char *snapshot_in = NULL;
+    // 一括コンパイルの入力ファイル（-batch指定時のみ）
+    Vector *batch_inputs = NULL;
 
     for (int i = 1; i < argc; i++)
     {
-        if (strcmp(argv[1], "-test") == 0)
+        if (strcmp(argv[i], "-test") == 0)
         {
-            runtest();
-            return 0;
+            needs_test = true;
         }
         else if (strcmp(argv[i], "-dumptoken") == 0)
         {
@@ -31,6 +69,96 @@ int main(int argc, char **argv)
         {
             needs_dump_node_list = true;
         }
+        else if (strcmp(argv[i], "-dumpir") == 0)
+        {
+            needs_dump_ir = true;
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            needs_object = true;
+        }
+        else if (strcmp(argv[i], "-run") == 0)
+        {
+            needs_run = true;
+        }
+        else if (strcmp(argv[i], "-runlib") == 0 && i + 1 < argc)
+        {
+            // 外部関数の解決に使う共有ライブラリ
+            jit_load_library(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-ftime-report") == 0)
+        {
+            needs_time_report = true;
+        }
+        else if (strcmp(argv[i], "-ftime-report=json") == 0)
+        {
+            needs_time_report = true;
+            needs_json_report = true;
+        }
+        else if (strcmp(argv[i], "-fmem-report") == 0)
+        {
+            needs_mem_report = true;
+        }
+        else if (strcmp(argv[i], "-fmem-report=json") == 0)
+        {
+            needs_mem_report = true;
+            needs_json_report = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O") == 0)
+        {
+            opt_level = argv[i][2] == '0' ? 0 : 1;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+        {
+            // 変更のない関数はキャッシュの命令列を使う
+            cache_init(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-cachestats") == 0)
+        {
+            needs_cache_stats = true;
+        }
+        else if (strcmp(argv[i], "-peepholestats") == 0)
+        {
+            needs_peephole_stats = true;
+        }
+        else if (strcmp(argv[i], "-snapshot") == 0 && i + 1 < argc)
+        {
+            snapshot_out = argv[++i];
+        }
+        else if (strcmp(argv[i], "-loadsnapshot") == 0 && i + 1 < argc)
+        {
+            snapshot_in = argv[++i];
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc && source_code == NULL)
+        {
+            // コマンドライン引数に収まらない大きなソースコード用
+            source_path = argv[++i];
+            source_code = read_file(source_path);
+        }
+        else if (strcmp(argv[i], "-batch") == 0)
+        {
+            batch_inputs = new_vector();
+        }
+        else if (batch_inputs != NULL)
+        {
+            // @<file>は1行に1ファイルのパスを書いたマニフェスト
+            if (argv[i][0] == '@')
+            {
+                batch_read_manifest(batch_inputs, argv[i] + 1);
+            }
+            else
+            {
+                vec_push(batch_inputs, argv[i]);
+            }
+        }
         else if (source_code == NULL)
         {
             source_code = argv[i];
@@ -43,8 +171,38 @@ int main(int argc, char **argv)
         }
     }
 
+    // 計測は-test・-batchの前に有効にしておく（ワーカースレッドの分は終了時に集計される）
+    if (needs_time_report)
+    {
+        time_report_enable();
+    }
+
+    // 内部機能のテスト
+    // ソースコードの代わりにケース表のパスを受け取る
+    if (needs_test)
+    {
+        int failures = runtest(source_code, jobs);
+        print_reports(needs_mem_report, needs_cache_stats, needs_peephole_stats, needs_json_report);
+        return failures == 0 ? 0 : 1;
+    }
+
+    // 一括コンパイル
+    // 出力は入力ごとに拡張子を.s(-cなら.o)に置き換えたファイル
+    // エラーになった入力があっても残りはコンパイルし、失敗した数を出力して異常終了する
+    if (batch_inputs != NULL)
+    {
+        int failures = compile_batch(batch_inputs, jobs, needs_object, opt_level);
+        print_reports(needs_mem_report, needs_cache_stats, needs_peephole_stats, needs_json_report);
+        if (failures > 0)
+        {
+            fprintf(stderr, "%d個中%d個の入力のコンパイルに失敗しました\n", batch_inputs->len, failures);
+            return 1;
+        }
+        return 0;
+    }
+
     // ソースコードが見つからなかった
-    if (source_code == NULL)
+    if ((source_code == NULL) == (snapshot_in == NULL))
     {
         fprintf(stderr, "引数が正しくありません\n");
         return 1;
@@ -55,22 +213,122 @@ int main(int argc, char **argv)
         initialize_dump_env();
     }
 
-    // トークナイズ
-    Vector *tokens = tokenize(source_code);
-    if (needs_dump_token_list)
+    // 翻訳単位のキャッシュ
+    // 同じソースコード・オプションのコンパイル結果があれば、トークナイズもせずにそれを書き出す
+    const char *output_ext = needs_object ? ".o" : ".s";
+    bool uses_unit_cache = cache_enabled() && source_code != NULL && snapshot_out == NULL &&
+                           !needs_run && !needs_dump_token_list && !needs_dump_node_list && !needs_dump_ir;
+    uint64_t unit_key = 0;
+    if (uses_unit_cache)
     {
-        dump_token_list(tokens);
+        char options[16];
+        snprintf(options, sizeof(options), "%s-O%d", needs_object ? "-c " : "", opt_level);
+        unit_key = cache_unit_key(source_code, options);
+
+        phase_begin(PHASE_EMIT);
+        bool hit = cache_load_unit(unit_key, output_ext, output_path);
+        phase_end(PHASE_EMIT);
+        if (hit)
+        {
+            print_reports(needs_mem_report, needs_cache_stats, needs_peephole_stats, needs_json_report);
+            arena_reset_all();
+            return 0;
+        }
     }
 
-    // パース
-    Vector *code = program(tokens);
+    TokenList *tokens;
+    Ast *ast;
+    if (snapshot_in != NULL)
+    {
+        // パース済みのスナップショットを読み込む
+        phase_begin(PHASE_PARSE);
+        ast = snapshot_load(snapshot_in, &tokens);
+        phase_end(PHASE_PARSE);
+        if (needs_dump_token_list)
+        {
+            dump_token_list(tokens);
+        }
+    }
+    else
+    {
+        // トークナイズ
+        phase_begin(PHASE_TOKENIZE);
+        tokens = tokenize(source_code);
+        phase_end(PHASE_TOKENIZE);
+        if (needs_dump_token_list)
+        {
+            dump_token_list(tokens);
+        }
+
+        // パース
+        phase_begin(PHASE_PARSE);
+        ast = program(tokens);
+        phase_end(PHASE_PARSE);
+    }
+    report_count(COUNT_TOKENS, tokens->len);
+    report_count(COUNT_NODES, ast->num_nodes);
     if (needs_dump_node_list)
     {
-        dump_node_list(code);
+        dump_node_list(ast);
+    }
+
+    // パース結果だけを書き出して終わる
+    if (snapshot_out != NULL)
+    {
+        phase_begin(PHASE_EMIT);
+        snapshot_write(snapshot_out, tokens, ast);
+        phase_end(PHASE_EMIT);
+        print_reports(needs_mem_report, needs_cache_stats, needs_peephole_stats, needs_json_report);
+        arena_reset_all();
+        return 0;
+    }
+
+    // トークン列はもう使わない
+    arena_reset(ARENA_TOKEN);
+
+    phase_begin(PHASE_FOLD);
+    fold_constants(ast);
+    phase_end(PHASE_FOLD);
+    if (needs_dump_ir)
+    {
+        dump_ir(ast, opt_level);
     }
 
     // アセンブリ出力
-    gen_asm(code);
+    // 関数のキャッシュは入力ファイル（なければ出力先）ごとに持つ
+    cache_set_unit(source_path != NULL ? source_path : output_path);
+    phase_begin(PHASE_CODEGEN);
+    gen_asm(ast, jobs, opt_level);
+    phase_end(PHASE_CODEGEN);
+    if (needs_run)
+    {
+        // メモリ上で直接実行し、mainの戻り値を終了コードとする
+        // 計測はJITの配置までで、プログラムの実行時間は含まない
+        int status = jit_run(emit_program());
+        print_reports(needs_mem_report, needs_cache_stats, needs_peephole_stats, needs_json_report);
+        arena_reset_all();
+
+        return status;
+    }
+
+    phase_begin(PHASE_EMIT);
+    if (needs_object)
+    {
+        // アセンブラを介さず直接オブジェクトファイルを出力
+        emit_write_object(output_path);
+    }
+    else
+    {
+        emit_write(output_path);
+    }
+    if (uses_unit_cache)
+    {
+        cache_store_unit(unit_key, output_ext);
+    }
+    phase_end(PHASE_EMIT);
+
+    print_reports(needs_mem_report, needs_cache_stats, needs_peephole_stats, needs_json_report);
+    arena_reset_all();
 
     return 0;
 }
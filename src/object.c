@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <elf.h>
+
+#include "shcc.h"
+
+// グローバル変数一つ分のサイズ
+#define GLOBAL_VARIABLE_SIZE 8
+
+// セクション番号
+enum
+{
+    SEC_NULL,
+    SEC_TEXT,
+    SEC_DATA,
+    SEC_RELA_TEXT,
+    SEC_SYMTAB,
+    SEC_STRTAB,
+    SEC_SHSTRTAB,
+    SEC_NOTE_GNU_STACK,
+    NUM_SECTIONS,
+};
+
+// セクション名
+static const char *section_names[NUM_SECTIONS] = {
+    [SEC_NULL] = "",
+    [SEC_TEXT] = ".text",
+    [SEC_DATA] = ".data",
+    [SEC_RELA_TEXT] = ".rela.text",
+    [SEC_SYMTAB] = ".symtab",
+    [SEC_STRTAB] = ".strtab",
+    [SEC_SHSTRTAB] = ".shstrtab",
+    [SEC_NOTE_GNU_STACK] = ".note.GNU-stack",
+};
+
+// 文字列テーブルへの追加
+// 追加した文字列の位置を返す
+static uint32_t add_string(Buffer *strtab, const char *str)
+{
+    uint32_t offset = strtab->len;
+    buf_push(strtab, str, strlen(str) + 1);
+
+    return offset;
+}
+
+// シンボルの追加
+// 追加したシンボルの番号を返す
+static int add_symbol(Buffer *symtab, Buffer *strtab, Map *indices,
+                      const char *name, int type, int shndx, uint64_t value, uint64_t size)
+{
+    Elf64_Sym sym = {
+        .st_name = add_string(strtab, name),
+        .st_info = ELF64_ST_INFO(STB_GLOBAL, type),
+        .st_other = STV_DEFAULT,
+        .st_shndx = shndx,
+        .st_value = value,
+        .st_size = size,
+    };
+    buf_push(symtab, &sym, sizeof(sym));
+
+    int index = symtab->len / sizeof(Elf64_Sym) - 1;
+    map_puti(indices, name, index);
+
+    return index;
+}
+
+// シンボル番号の取得
+// 未定義のシンボルは外部シンボルとして追加する
+static int symbol_index(Buffer *symtab, Buffer *strtab, Map *indices, const char *name)
+{
+    if (map_get(indices, name) != NULL)
+    {
+        return map_geti(indices, name);
+    }
+
+    return add_symbol(symtab, strtab, indices, name, STT_NOTYPE, SHN_UNDEF, 0, 0);
+}
+
+// セクションを出力し、位置を記録する
+static void put_section(Buffer *out, Elf64_Shdr *shdr, const Buffer *data)
+{
+    buf_align(out, shdr->sh_addralign == 0 ? 1 : shdr->sh_addralign, 0);
+    shdr->sh_offset = out->len;
+    shdr->sh_size = data->len;
+
+    if (data->len > 0)
+    {
+        buf_push(out, data->data, data->len);
+    }
+}
+
+// ELF64の再配置可能オブジェクトファイルを作成してoutへ書き出す
+void write_object(const AsmProgram *prog, Buffer *out)
+{
+    Buffer *text = new_buffer_in(ARENA_CODEGEN);
+    Buffer *data = new_buffer_in(ARENA_CODEGEN);
+    Buffer *rela = new_buffer_in(ARENA_CODEGEN);
+    Buffer *symtab = new_buffer_in(ARENA_CODEGEN);
+    Buffer *strtab = new_buffer_in(ARENA_CODEGEN);
+    Buffer *shstrtab = new_buffer_in(ARENA_CODEGEN);
+    Buffer *empty = new_buffer_in(ARENA_CODEGEN);
+    Vector *relocs = new_vector_in(ARENA_CODEGEN);
+    Map *indices = new_map_in(ARENA_CODEGEN);
+
+    // 先頭は空のシンボルと空文字列
+    Elf64_Sym null_sym = {0};
+    buf_push(symtab, &null_sym, sizeof(null_sym));
+    buf_push_byte(strtab, 0);
+
+    // ローカルシンボルは無いので、以降はすべてグローバルシンボル
+    int first_global = 1;
+
+    // 関数本体
+    for (int i = 0; i < prog->funcs->len; i++)
+    {
+        const AsmFunc *func = prog->funcs->data[i];
+
+        buf_align(text, 16, 0x90);
+        uint32_t start = text->len;
+        encode_func(func, text, relocs);
+        add_symbol(symtab, strtab, indices, func->name, STT_FUNC, SEC_TEXT, start, text->len - start);
+    }
+
+    // グローバル変数
+    // 今は明示的な初期化のない変数しかないのでゼロ埋め
+    for (int i = 0; i < prog->globals->len; i++)
+    {
+        const char *name = prog->globals->data[i];
+
+        uint32_t start = data->len;
+        buf_push_u64(data, 0);
+        add_symbol(symtab, strtab, indices, name, STT_OBJECT, SEC_DATA, start, GLOBAL_VARIABLE_SIZE);
+    }
+
+    // 再配置
+    for (int i = 0; i < relocs->len; i++)
+    {
+        const Reloc *reloc = relocs->data[i];
+        int sym = symbol_index(symtab, strtab, indices, reloc->sym);
+
+        Elf64_Rela r = {
+            .r_offset = reloc->offset,
+            .r_info = ELF64_R_INFO(sym, reloc->type),
+            .r_addend = reloc->addend,
+        };
+        buf_push(rela, &r, sizeof(r));
+    }
+
+    Elf64_Shdr shdrs[NUM_SECTIONS] = {
+        [SEC_TEXT] = {
+            .sh_type = SHT_PROGBITS,
+            .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+            .sh_addralign = 16,
+        },
+        [SEC_DATA] = {
+            .sh_type = SHT_PROGBITS,
+            .sh_flags = SHF_ALLOC | SHF_WRITE,
+            .sh_addralign = 8,
+        },
+        [SEC_RELA_TEXT] = {
+            .sh_type = SHT_RELA,
+            .sh_flags = SHF_INFO_LINK,
+            .sh_link = SEC_SYMTAB,
+            .sh_info = SEC_TEXT,
+            .sh_addralign = 8,
+            .sh_entsize = sizeof(Elf64_Rela),
+        },
+        [SEC_SYMTAB] = {
+            .sh_type = SHT_SYMTAB,
+            .sh_link = SEC_STRTAB,
+            .sh_info = first_global,
+            .sh_addralign = 8,
+            .sh_entsize = sizeof(Elf64_Sym),
+        },
+        [SEC_STRTAB] = {
+            .sh_type = SHT_STRTAB,
+            .sh_addralign = 1,
+        },
+        [SEC_SHSTRTAB] = {
+            .sh_type = SHT_STRTAB,
+            .sh_addralign = 1,
+        },
+        [SEC_NOTE_GNU_STACK] = {
+            .sh_type = SHT_PROGBITS,
+            .sh_addralign = 1,
+        },
+    };
+
+    for (int i = 0; i < NUM_SECTIONS; i++)
+    {
+        shdrs[i].sh_name = add_string(shstrtab, section_names[i]);
+    }
+
+    // ELFヘッダは最後に埋める
+    Elf64_Ehdr ehdr = {0};
+    size_t ehdr_pos = out->len;
+    buf_push(out, &ehdr, sizeof(ehdr));
+
+    put_section(out, &shdrs[SEC_TEXT], text);
+    put_section(out, &shdrs[SEC_DATA], data);
+    put_section(out, &shdrs[SEC_RELA_TEXT], rela);
+    put_section(out, &shdrs[SEC_SYMTAB], symtab);
+    put_section(out, &shdrs[SEC_STRTAB], strtab);
+    put_section(out, &shdrs[SEC_SHSTRTAB], shstrtab);
+    put_section(out, &shdrs[SEC_NOTE_GNU_STACK], empty);
+
+    buf_align(out, 8, 0);
+    size_t shoff = out->len;
+    buf_push(out, shdrs, sizeof(shdrs));
+
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = shoff;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = NUM_SECTIONS;
+    ehdr.e_shstrndx = SEC_SHSTRTAB;
+    memcpy(out->data + ehdr_pos, &ehdr, sizeof(ehdr));
+}
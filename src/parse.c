@@ -14,233 +14,371 @@ const int STACK_UNIT = 8;
 
 typedef struct
 {
-    Vector *tokens;
+    TokenList *tokens;
     int pos;
 
-    // 変数を管理するベクタ
+    // スコープごとに宣言された識別子を管理するベクタ
     // [0]: グローバル変数
     // [1]: ローカル変数
     // 以降、スコープを一つ潜るたびにindexが増え、抜けるたびにindexが減る
-    // このベクタはMAPを管理する
-    // MAP<Key:変数名, Value:変数情報>
-    Vector *variables;
+    // このベクタはVector<Symbol>を管理し、スコープを抜けるときに各Symbolの束縛をpopする
+    // 変数情報そのものは各Symbolの束縛スタックが持つ
+    Vector *scopes;
     // RBPからのオフセット
     //   parserにRBPなんて言葉が出てくるのはあんまりよい気はしないが……
     int variable_offset;
+
+    // 作成中の抽象構文木
+    Ast *ast;
+    // 作成中のノード列を一時的に積んでおくスタック
+    // ブロックの文や関数の引数は、数が確定してからAst.listsへまとめて移す
+    NodeId *pending;
+    int num_pending;
+    int pending_capacity;
+
+    // ここまでに宣言されたグローバル変数名のハッシュ（関数のキャッシュのキー用）
+    uint64_t globals_hash;
 } Tokens;
 
-static Node *expr(Tokens *tks);
-static Node *assign(Tokens *tks);
-static Node *stmt(Tokens *tks);
-static Node *multi_stmt(Tokens *tks);
+static NodeId expr(Tokens *tks);
+static NodeId assign(Tokens *tks);
+static NodeId stmt(Tokens *tks);
+static NodeId multi_stmt(Tokens *tks);
+
+// 現在のトークンの位置を返す
+static int current_token(Tokens *tks)
+{
+    return tks->pos;
+}
+
+// トークンの数値
+static int token_value(Tokens *tks, int tk)
+{
+    return tks->tokens->values[tk];
+}
+
+// トークンの識別子
+static Symbol *token_symbol(Tokens *tks, int tk)
+{
+    return symbol_at(tks->tokens->values[tk]);
+}
+
+// 配列の末尾に空きがなければ2倍に拡張する
+static void *reserve(void *array, int len, int *capacity, size_t size)
+{
+    if (len < *capacity)
+    {
+        return array;
+    }
+
+    int new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+    array = arena_realloc(ARENA_NODE, array, *capacity * size, new_capacity * size);
+    mem_count(MEM_NODES, (new_capacity - *capacity) * size, *capacity == 0);
+    *capacity = new_capacity;
+
+    return array;
+}
+
+// ノード番号からノードを取得
+// ノードの追加で配列が移動し得るので、取得したポインタを保持し続けないこと
+static Node *node_of(Tokens *tks, NodeId id)
+{
+    return ast_node(tks->ast, id);
+}
+
+// ノード列を作成中のスタックに積む
+static void push_pending(Tokens *tks, NodeId id)
+{
+    tks->pending = reserve(tks->pending, tks->num_pending, &tks->pending_capacity, sizeof(NodeId));
+    tks->pending[tks->num_pending++] = id;
+}
 
-// 現在のトークンを返す
-static Token *current_token(Tokens *tks)
+// スタックのmark以降に積んだノード列をAst.listsへ移す
+// 戻り値はAst.lists上の位置
+static uint32_t pop_pending(Tokens *tks, int mark)
 {
-    return tks->tokens->data[tks->pos];
+    Ast *ast = tks->ast;
+    int len = tks->num_pending - mark;
+
+    while (ast->num_lists + len > ast->list_capacity)
+    {
+        ast->lists = reserve(ast->lists, ast->list_capacity, &ast->list_capacity, sizeof(NodeId));
+    }
+
+    uint32_t pos = ast->num_lists;
+    memcpy(&ast->lists[pos], &tks->pending[mark], len * sizeof(NodeId));
+    ast->num_lists += len;
+    tks->num_pending = mark;
+
+    return pos;
 }
 
 // 変数情報を格納するインスタンスを生成
-static VariableInfo *new_varinfo(VariableType_t ty, bool is_global, const char *name)
+// 戻り値は変数番号
+static uint32_t new_varinfo(Tokens *tks, VariableType_t ty, bool is_global, const char *name)
 {
-    VariableInfo *info = calloc(1, sizeof(VariableInfo));
-    info->type = ty;
-    info->is_global = is_global;
-    info->name = name;
-    return info;
+    Ast *ast = tks->ast;
+    ast->variables = reserve(ast->variables, ast->num_variables, &ast->variable_capacity, sizeof(VariableInfo));
+
+    uint32_t id = ast->num_variables++;
+    VariableInfo *info = ast_variable(ast, id);
+    *info = (VariableInfo){
+        .type = ty,
+        .is_global = is_global,
+        .name = name};
+
+    return id;
 }
 
 // ローカル変数情報を格納するインスタンスを生成
-static VariableInfo *new_local_varinfo(VariableType_t ty, const char *name, int offset)
+static uint32_t new_local_varinfo(Tokens *tks, VariableType_t ty, const char *name, int offset)
 {
-    VariableInfo *info = new_varinfo(ty, false, name);
-    info->offset = offset;
-    return info;
+    uint32_t id = new_varinfo(tks, ty, false, name);
+    ast_variable(tks->ast, id)->offset = offset;
+    return id;
 }
 
 // グローバル変数情報を格納するインスタンスを生成
-static VariableInfo *new_global_varinfo(VariableType_t ty, const char *name)
+static uint32_t new_global_varinfo(Tokens *tks, VariableType_t ty, const char *name)
+{
+    return new_varinfo(tks, ty, true, name);
+}
+
+// 関数情報を格納するインスタンスを生成
+// 戻り値は関数番号
+static uint32_t new_funcinfo(Tokens *tks, const char *name)
 {
-    VariableInfo *info = new_varinfo(ty, true, name);
-    return info;
+    Ast *ast = tks->ast;
+    ast->funcs = reserve(ast->funcs, ast->num_funcs, &ast->func_capacity, sizeof(FuncInfo));
+
+    uint32_t id = ast->num_funcs++;
+    *ast_func(ast, id) = (FuncInfo){.name = name};
+
+    return id;
 }
 
 // ノード生成
-static Node *new_node(NodeType_t ty)
+static NodeId new_node(Tokens *tks, NodeType_t ty)
 {
-    Node *node = calloc(1, sizeof(Node));
-    node->ty = ty;
+    Ast *ast = tks->ast;
+    ast->nodes = reserve(ast->nodes, ast->num_nodes, &ast->node_capacity, sizeof(Node));
 
-    return node;
+    NodeId id = ast->num_nodes++;
+    ast->nodes[id] = (Node){.ty = ty};
+
+    return id;
 }
 
 // 単項演算子用のノード生成
-static Node *new_node_unary_operator(NodeType_t ty, Node *operand)
+static NodeId new_node_unary_operator(Tokens *tks, NodeType_t ty, NodeId operand)
 {
-    Node *node = new_node(ty);
-    node->lhs = operand;
+    NodeId node = new_node(tks, ty);
+    node_of(tks, node)->lhs = operand;
 
     return node;
 }
 
 // 二項演算子用のノード生成
-static Node *new_node_binary_operator(NodeType_t ty, Node *lhs, Node *rhs)
+static NodeId new_node_binary_operator(Tokens *tks, NodeType_t ty, NodeId lhs, NodeId rhs)
 {
-    Node *node = new_node(ty);
-    node->lhs = lhs;
-    node->rhs = rhs;
+    NodeId node = new_node(tks, ty);
+    node_of(tks, node)->lhs = lhs;
+    node_of(tks, node)->rhs = rhs;
 
     return node;
 }
 
 // 数値ノード
-static Node *new_node_num(int value)
+static NodeId new_node_num(Tokens *tks, int value)
 {
-    Node *node = new_node(ND_NUM);
-    node->value = value;
+    NodeId node = new_node(tks, ND_NUM);
+    node_of(tks, node)->value = value;
 
     return node;
 }
 
 // 単項"-"ノード
-static Node *new_node_negative(Node *value)
+static NodeId new_node_negative(Tokens *tks, NodeId value)
 {
     // 0から引くアセンブリを吐くようにする
-    return new_node_binary_operator(ND_MINUS, new_node_num(0), value);
+    return new_node_binary_operator(tks, ND_MINUS, new_node_num(tks, 0), value);
 }
 
 // 変数ノード
-static Node *new_node_variable(VariableInfo *info)
+static NodeId new_node_variable(Tokens *tks, uint32_t variable)
 {
-    Node *node = new_node(ND_VARIABLE);
-    node->variable = info;
+    NodeId node = new_node(tks, ND_VARIABLE);
+    node_of(tks, node)->variable = variable;
     return node;
 }
 
 // 変数定義ノード
-static Node *new_node_vardef(VariableInfo *info)
+static NodeId new_node_vardef(Tokens *tks, uint32_t variable)
 {
-    Node *node = new_node(ND_VARDEF);
-    node->variable = info;
+    NodeId node = new_node(tks, ND_VARDEF);
+    node_of(tks, node)->variable = variable;
     return node;
 }
 
 // 関数ノード
-static Node *new_node_funccall(const char *name)
+static NodeId new_node_funccall(Tokens *tks, const char *name)
 {
-    FuncInfo *info = calloc(1, sizeof(FuncInfo));
-    info->name = name;
-    info->args = new_vector();
+    uint32_t func = new_funcinfo(tks, name);
 
-    Node *node = new_node(ND_CALL);
-    node->func = info;
+    NodeId node = new_node(tks, ND_CALL);
+    node_of(tks, node)->func = func;
     return node;
 }
 
 // 関数定義ノード
-static Node *new_node_funcdef(const char *name)
+static NodeId new_node_funcdef(Tokens *tks, const char *name)
 {
-    FuncInfo *info = calloc(1, sizeof(FuncInfo));
-    info->name = name;
-    info->args = new_vector();
+    uint32_t func = new_funcinfo(tks, name);
 
-    Node *node = new_node(ND_FUNCDEF);
-    node->func = info;
+    NodeId node = new_node(tks, ND_FUNCDEF);
+    node_of(tks, node)->func = func;
     return node;
 }
 
 // returnノード
-static Node *new_node_return(Node *node)
+static NodeId new_node_return(Tokens *tks, NodeId node)
 {
-    return new_node_unary_operator(ND_RETURN, node);
+    return new_node_unary_operator(tks, ND_RETURN, node);
 }
 
 // 空文 ノード
-static Node *new_node_empty_stmt(void)
+static NodeId new_node_empty_stmt(Tokens *tks)
 {
-    return new_node(ND_STMT);
+    return new_node(tks, ND_STMT);
 }
 
 // Block ノード
-static Node *new_node_block(void)
+// 文は作成中のスタックのmark以降に積まれている
+static NodeId new_node_block(Tokens *tks, int mark)
 {
-    Node *node = new_node(ND_BLOCK);
-    node->block_stmts = new_vector();
+    int num_stmts = tks->num_pending - mark;
+    uint32_t stmts = pop_pending(tks, mark);
+
+    NodeId node = new_node(tks, ND_BLOCK);
+    node_of(tks, node)->stmts = stmts;
+    node_of(tks, node)->num_stmts = num_stmts;
 
     return node;
 }
 
 // if-elseノード
-static Node *new_node_ifelse(Node *condition, Node *then, Node *elsethen)
+static NodeId new_node_ifelse(Tokens *tks, NodeId condition, NodeId then, NodeId elsethen)
 {
-    Node *node = new_node(ND_IF);
-    node->condition = condition;
-    node->then = then;
-    node->elsethen = elsethen;
+    NodeId node = new_node(tks, ND_IF);
+    node_of(tks, node)->condition = condition;
+    node_of(tks, node)->then = then;
+    node_of(tks, node)->elsethen = elsethen;
     return node;
 }
 
 // forノード
-static Node *new_node_for(Node *initializer, Node *condition, Node *loopexpr, Node *then)
+static NodeId new_node_for(Tokens *tks, NodeId initializer, NodeId condition, NodeId loopexpr, NodeId then)
 {
-    Node *node = new_node(ND_FOR);
-    node->initializer = initializer;
-    node->condition = condition;
-    node->loopexpr = loopexpr;
-    node->then = then;
+    // 初期化処理とループ終了時の処理はノード列として持つ
+    int mark = tks->num_pending;
+    push_pending(tks, initializer);
+    push_pending(tks, loopexpr);
+    uint32_t for_exprs = pop_pending(tks, mark);
+
+    NodeId node = new_node(tks, ND_FOR);
+    node_of(tks, node)->condition = condition;
+    node_of(tks, node)->then = then;
+    node_of(tks, node)->for_exprs = for_exprs;
     return node;
 }
 
 // whileノード
-static Node *new_node_while(Node *condition, Node *then)
+static NodeId new_node_while(Tokens *tks, NodeId condition, NodeId then)
 {
-    Node *node = new_node(ND_WHILE);
-    node->condition = condition;
-    node->then = then;
+    NodeId node = new_node(tks, ND_WHILE);
+    node_of(tks, node)->condition = condition;
+    node_of(tks, node)->then = then;
     return node;
 }
 
 // トークン解析失敗エラー
 static void error(Tokens *tks, const char *msg)
 {
-    Token *tk = current_token(tks);
-    fprintf(stderr, "%s: %s\n", msg, tk->input);
-
-    exit(1);
+    int tk = current_token(tks);
+    compile_error("%s: %.*s", msg, tks->tokens->lengths[tk], tks->tokens->source + tks->tokens->offsets[tk]);
 }
 
 // 次トークンがtyか確認する
 // consumeの先読み版
 static bool is_match_next_token(Tokens *tks, int ty)
 {
-    Token *tk = current_token(tks);
+    return tks->tokens->types[tks->pos] == ty;
+}
+
+// 現在のスコープの深さ
+static int current_scope_depth(Tokens *tks)
+{
+    return tks->scopes->len - 1;
+}
+
+// 新しいスコープに入る
+static void enter_scope(Tokens *tks)
+{
+    vec_push(tks->scopes, new_vector_in(ARENA_NODE));
+}
 
-    return tk->ty == ty;
+// スコープを抜ける
+// このスコープで宣言された変数の束縛をすべて外す
+static void leave_scope(Tokens *tks)
+{
+    Vector *declared = tks->scopes->data[tks->scopes->len - 1];
+    for (int i = 0; i < declared->len; i++)
+    {
+        Symbol *sym = declared->data[i];
+        sym->bindings->len--;
+    }
+
+    tks->scopes->len--;
 }
 
-// 変数情報を取得する
-static VariableInfo *get_variable_info(Tokens *tks, const char *name)
+// 変数番号を取得する
+// 見つからなければ-1
+static int get_variable(Symbol *sym)
 {
-    // よりローカルな方のスコープから探索すればCっぽいスコープ管理になる
-    for (int i = tks->variables->len - 1; i >= 0; i--)
+    phase_begin(PHASE_SCOPE_LOOKUP);
+
+    // 束縛スタックの先頭が最もローカルなスコープの変数なので、Cっぽいスコープ管理になる
+    int variable = -1;
+    if (sym->bindings != NULL && sym->bindings->len > 0)
     {
-        VariableInfo *info = (VariableInfo *)map_get((const Map *)tks->variables->data[i], name);
-        if (info != NULL)
-        {
-            return info;
-        }
+        variable = (int)(intptr_t)sym->bindings->data[sym->bindings->len - 1];
     }
 
-    return NULL;
+    phase_end(PHASE_SCOPE_LOOKUP);
+
+    return variable;
 }
 
 // 変数を宣言可能か？
-static bool can_declaration_variable(Tokens *tks, const char *name)
+static bool can_declaration_variable(Tokens *tks, Symbol *sym)
 {
     // 一番ローカルなスコープになければOK
-    void *value = map_get((const Map *)tks->variables->data[tks->variables->len - 1], name);
+    int variable = get_variable(sym);
 
-    return value == NULL;
+    return variable < 0 || ast_variable(tks->ast, variable)->scope_depth != current_scope_depth(tks);
+}
+
+// 現在のスコープに変数を宣言する
+static void declare_variable(Tokens *tks, Symbol *sym, uint32_t variable)
+{
+    if (sym->bindings == NULL)
+    {
+        sym->bindings = new_vector_in(ARENA_NODE);
+    }
+
+    ast_variable(tks->ast, variable)->scope_depth = current_scope_depth(tks);
+    vec_push(sym->bindings, (void *)(intptr_t)variable);
+    vec_push(tks->scopes->data[tks->scopes->len - 1], sym);
 }
 
 // 次トークンがtyか確認し、tyの時のみトークンを一つ進める
@@ -255,12 +393,32 @@ static bool consume(Tokens *tks, int ty)
     return is_match;
 }
 
+// 引数・仮引数の区切りのカンマを読む
+// カンマは省略できるが、書けるのは二つの引数の間だけ（先頭・末尾・連続はエラー）
+static void consume_separator(Tokens *tks, int mark)
+{
+    if (!is_match_next_token(tks, TK_COMMA))
+    {
+        return;
+    }
+    if (tks->num_pending == mark)
+    {
+        error(tks, "引数の前にカンマがあります");
+    }
+
+    tks->pos++;
+    if (is_match_next_token(tks, TK_COMMA) || is_match_next_token(tks, TK_PRCLOSE))
+    {
+        error(tks, "カンマの後に引数がありません");
+    }
+}
+
 // 末尾ノード 括弧か数値
-static Node *term(Tokens *tks)
+static NodeId term(Tokens *tks)
 {
     if (consume(tks, TK_PROPEN))
     {
-        Node *node = expr(tks);
+        NodeId node = expr(tks);
 
         if (!consume(tks, TK_PRCLOSE))
         {
@@ -270,39 +428,46 @@ static Node *term(Tokens *tks)
         return node;
     }
 
-    Token *tk = current_token(tks);
+    int tk = current_token(tks);
     if (consume(tks, TK_NUM))
     {
-        Node *node = new_node_num(tk->value);
+        NodeId node = new_node_num(tks, token_value(tks, tk));
 
         return node;
     }
     if (consume(tks, TK_IDENT))
     {
-        Node *node = NULL;
+        NodeId node = NODE_NONE;
+        Symbol *sym = token_symbol(tks, tk);
 
         if (consume(tks, TK_PROPEN))
         {
             // 関数呼び出し
-            node = new_node_funccall(tk->input);
+            node = new_node_funccall(tks, sym->name);
 
             // 引数
+            int mark = tks->num_pending;
             while (!consume(tks, TK_PRCLOSE))
             {
-                vec_push(node->func->args, assign(tks));
+                consume_separator(tks, mark);
+                push_pending(tks, assign(tks));
             }
+
+            FuncInfo *func = ast_func(tks->ast, node_of(tks, node)->func);
+            func->num_args = tks->num_pending - mark;
+            func->args = pop_pending(tks, mark);
         }
         else
         {
-            VariableInfo *info = get_variable_info(tks, tk->input);
-            if (info == NULL)
+            int variable = get_variable(sym);
+            if (variable < 0)
             {
-                char *msg = calloc(256, sizeof(char));
-                snprintf(msg, 256, "未定義の変数'%s'です", tk->input);
+                char msg[256];
+                snprintf(msg, 256, "未定義の変数'%s'です", sym->name);
                 error(tks, msg);
             }
 
-            node = new_node_variable(info);
+            node = new_node_variable(tks, variable);
         }
 
         return node;
@@ -310,12 +475,12 @@ static Node *term(Tokens *tks)
 
     error(tks, "数値でも開き括弧でもないトークンです");
 
-    return 0;
+    return NODE_NONE;
 }
 
 // 前置増分/減分, 単項式
 // ++ -- ! ~ +-（符号） * & sizeof()
-static Node *monomial(Tokens *tks)
+static NodeId monomial(Tokens *tks)
 {
     if (consume(tks, TK_PLUS))
     {
@@ -323,47 +488,47 @@ static Node *monomial(Tokens *tks)
     }
     else if (consume(tks, TK_MINUS))
     {
-        Node *node = term(tks);
-        return new_node_negative(node);
+        NodeId node = term(tks);
+        return new_node_negative(tks, node);
     }
     else if (consume(tks, TK_ADDR))
     {
-        return new_node_unary_operator(ND_ADDR, monomial(tks));
+        return new_node_unary_operator(tks, ND_ADDR, monomial(tks));
     }
     else if (consume(tks, TK_DEREF))
     {
-        return new_node_unary_operator(ND_DEREF, monomial(tks));
+        return new_node_unary_operator(tks, ND_DEREF, monomial(tks));
     }
 
     return term(tks);
 }
 
 // キャスト演算子
-static Node *cast(Tokens *tks)
+static NodeId cast(Tokens *tks)
 {
-    Node *node = monomial(tks);
+    NodeId node = monomial(tks);
 
     return node;
 }
 
 // 乗除余演算子
-static Node *mul(Tokens *tks)
+static NodeId mul(Tokens *tks)
 {
-    Node *node = cast(tks);
+    NodeId node = cast(tks);
 
     for (;;)
     {
         if (consume(tks, TK_MUL))
         {
-            node = new_node_binary_operator(ND_MUL, node, mul(tks));
+            node = new_node_binary_operator(tks, ND_MUL, node, cast(tks));
         }
         else if (consume(tks, TK_DIV))
         {
-            node = new_node_binary_operator(ND_DIV, node, mul(tks));
+            node = new_node_binary_operator(tks, ND_DIV, node, cast(tks));
         }
         else if (consume(tks, TK_MOD))
         {
-            node = new_node_binary_operator(ND_MOD, node, mul(tks));
+            node = new_node_binary_operator(tks, ND_MOD, node, cast(tks));
         }
         else
         {
@@ -373,19 +538,19 @@ static Node *mul(Tokens *tks)
 }
 
 // 加減演算子
-static Node *add(Tokens *tks)
+static NodeId add(Tokens *tks)
 {
-    Node *node = mul(tks);
+    NodeId node = mul(tks);
 
     for (;;)
     {
         if (consume(tks, TK_PLUS))
         {
-            node = new_node_binary_operator(ND_PLUS, node, add(tks));
+            node = new_node_binary_operator(tks, ND_PLUS, node, mul(tks));
         }
         else if (consume(tks, TK_MINUS))
         {
-            node = new_node_binary_operator(ND_MINUS, node, add(tks));
+            node = new_node_binary_operator(tks, ND_MINUS, node, mul(tks));
         }
         else
         {
@@ -395,35 +560,35 @@ static Node *add(Tokens *tks)
 }
 
 // シフト演算子
-static Node *shift(Tokens *tks)
+static NodeId shift(Tokens *tks)
 {
-    Node *node = add(tks);
+    NodeId node = add(tks);
 
     return node;
 }
 
 // 比較演算子
-static Node *comparison(Tokens *tks)
+static NodeId comparison(Tokens *tks)
 {
-    Node *node = shift(tks);
+    NodeId node = shift(tks);
 
     for (;;)
     {
         if (consume(tks, TK_LESS))
         {
-            node = new_node_binary_operator(ND_LESS, node, comparison(tks));
+            node = new_node_binary_operator(tks, ND_LESS, node, shift(tks));
         }
         else if (consume(tks, TK_GREATER))
         {
-            node = new_node_binary_operator(ND_GREATER, node, comparison(tks));
+            node = new_node_binary_operator(tks, ND_GREATER, node, shift(tks));
         }
         else if (consume(tks, TK_LESS_EQ))
         {
-            node = new_node_binary_operator(ND_LESS_EQ, node, comparison(tks));
+            node = new_node_binary_operator(tks, ND_LESS_EQ, node, shift(tks));
         }
         else if (consume(tks, TK_GREATER_EQ))
         {
-            node = new_node_binary_operator(ND_GREATER_EQ, node, comparison(tks));
+            node = new_node_binary_operator(tks, ND_GREATER_EQ, node, shift(tks));
         }
         else
         {
@@ -433,19 +598,19 @@ static Node *comparison(Tokens *tks)
 }
 
 // 等価演算子
-static Node *equality(Tokens *tks)
+static NodeId equality(Tokens *tks)
 {
-    Node *node = comparison(tks);
+    NodeId node = comparison(tks);
 
     for (;;)
     {
         if (consume(tks, TK_EQ))
         {
-            node = new_node_binary_operator(ND_EQ, node, comparison(tks));
+            node = new_node_binary_operator(tks, ND_EQ, node, comparison(tks));
         }
         else if (consume(tks, TK_NEQ))
         {
-            node = new_node_binary_operator(ND_NEQ, node, comparison(tks));
+            node = new_node_binary_operator(tks, ND_NEQ, node, comparison(tks));
         }
         else
         {
@@ -455,101 +620,101 @@ static Node *equality(Tokens *tks)
 }
 
 // ビットAND
-static Node *bit_and(Tokens *tks)
+static NodeId bit_and(Tokens *tks)
 {
-    Node *node = equality(tks);
+    NodeId node = equality(tks);
 
     return node;
 }
 
 // ビットXOR
-static Node *bit_xor(Tokens *tks)
+static NodeId bit_xor(Tokens *tks)
 {
-    Node *node = bit_and(tks);
+    NodeId node = bit_and(tks);
 
     return node;
 }
 
 // ビットOR
-static Node *bit_or(Tokens *tks)
+static NodeId bit_or(Tokens *tks)
 {
-    Node *node = bit_xor(tks);
+    NodeId node = bit_xor(tks);
 
     return node;
 }
 
 // 論理AND
-static Node *logical_and(Tokens *tks)
+static NodeId logical_and(Tokens *tks)
 {
-    Node *node = bit_or(tks);
+    NodeId node = bit_or(tks);
 
     return node;
 }
 
 // 論理OR
-static Node *logical_or(Tokens *tks)
+static NodeId logical_or(Tokens *tks)
 {
-    Node *node = logical_and(tks);
+    NodeId node = logical_and(tks);
 
     return node;
 }
 
 // 条件演算子
-static Node *conditional(Tokens *tks)
+static NodeId conditional(Tokens *tks)
 {
-    Node *node = logical_or(tks);
+    NodeId node = logical_or(tks);
 
     return node;
 }
 
 // 代入演算子
-static Node *assign(Tokens *tks)
+static NodeId assign(Tokens *tks)
 {
-    Node *node = conditional(tks);
+    NodeId node = conditional(tks);
     if (consume(tks, TK_ASSIGN))
     {
-        node = new_node_binary_operator(ND_ASSIGN, node, assign(tks));
+        node = new_node_binary_operator(tks, ND_ASSIGN, node, assign(tks));
     }
     else if (consume(tks, TK_ADD_ASSIGN))
     {
         // [a += b;] = [a = a + b;]
-        Node *expr = new_node_binary_operator(ND_PLUS, node, assign(tks));
-        node = new_node_binary_operator(ND_ASSIGN, node, expr);
+        NodeId expr = new_node_binary_operator(tks, ND_PLUS, node, assign(tks));
+        node = new_node_binary_operator(tks, ND_ASSIGN, node, expr);
     }
     else if (consume(tks, TK_SUB_ASSIGN))
     {
-        Node *expr = new_node_binary_operator(ND_MINUS, node, assign(tks));
-        node = new_node_binary_operator(ND_ASSIGN, node, expr);
+        NodeId expr = new_node_binary_operator(tks, ND_MINUS, node, assign(tks));
+        node = new_node_binary_operator(tks, ND_ASSIGN, node, expr);
     }
     else if (consume(tks, TK_MUL_ASSIGN))
     {
-        Node *expr = new_node_binary_operator(ND_MUL, node, assign(tks));
-        node = new_node_binary_operator(ND_ASSIGN, node, expr);
+        NodeId expr = new_node_binary_operator(tks, ND_MUL, node, assign(tks));
+        node = new_node_binary_operator(tks, ND_ASSIGN, node, expr);
     }
     else if (consume(tks, TK_DIV_ASSIGN))
     {
-        Node *expr = new_node_binary_operator(ND_DIV, node, assign(tks));
-        node = new_node_binary_operator(ND_ASSIGN, node, expr);
+        NodeId expr = new_node_binary_operator(tks, ND_DIV, node, assign(tks));
+        node = new_node_binary_operator(tks, ND_ASSIGN, node, expr);
     }
     else if (consume(tks, TK_MOD_ASSIGN))
     {
-        Node *expr = new_node_binary_operator(ND_MOD, node, assign(tks));
-        node = new_node_binary_operator(ND_ASSIGN, node, expr);
+        NodeId expr = new_node_binary_operator(tks, ND_MOD, node, assign(tks));
+        node = new_node_binary_operator(tks, ND_ASSIGN, node, expr);
     }
 
     return node;
 }
 
 // 一つの式
-static Node *expr(Tokens *tks)
+static NodeId expr(Tokens *tks)
 {
-    Node *node = assign(tks);
+    NodeId node = assign(tks);
 
     return node;
 }
 
 // if文
-static Node *stmt_if(Tokens *tks)
+static NodeId stmt_if(Tokens *tks)
 {
     // ここに来る時点ではIFトークンは消費済み
 
@@ -558,26 +723,26 @@ static Node *stmt_if(Tokens *tks)
         error(tks, "if文には'('が必要です");
     }
 
-    Node *condition = expr(tks);
+    NodeId condition = expr(tks);
 
     if (!consume(tks, TK_PRCLOSE))
     {
         error(tks, "if文には')'が必要です");
     }
 
-    Node *then = stmt(tks);
+    NodeId then = stmt(tks);
 
-    Node *elsethen = NULL;
+    NodeId elsethen = NODE_NONE;
     if (consume(tks, TK_ELSE))
     {
         elsethen = stmt(tks);
     }
 
-    return new_node_ifelse(condition, then, elsethen);
+    return new_node_ifelse(tks, condition, then, elsethen);
 }
 
 // for文
-static Node *stmt_for(Tokens *tks)
+static NodeId stmt_for(Tokens *tks)
 {
     // ここに来る時点ではFORトークンは消費済み
 
@@ -586,9 +751,9 @@ static Node *stmt_for(Tokens *tks)
         error(tks, "for文には'('が必要です");
     }
 
-    Node *initializer = NULL;
-    Node *condition = NULL;
-    Node *loopexpr = NULL;
+    NodeId initializer = NODE_NONE;
+    NodeId condition = NODE_NONE;
+    NodeId loopexpr = NODE_NONE;
     if (!is_match_next_token(tks, TK_STMT))
     {
         initializer = expr(tks);
@@ -617,13 +782,13 @@ static Node *stmt_for(Tokens *tks)
         error(tks, "for文には')'が必要です");
     }
 
-    Node *then = stmt(tks);
+    NodeId then = stmt(tks);
 
-    return new_node_for(initializer, condition, loopexpr, then);
+    return new_node_for(tks, initializer, condition, loopexpr, then);
 }
 
 // while文
-static Node *stmt_while(Tokens *tks)
+static NodeId stmt_while(Tokens *tks)
 {
     // ここに来る時点ではWHILEトークンは消費済み
 
@@ -632,30 +797,30 @@ static Node *stmt_while(Tokens *tks)
         error(tks, "while文には'('が必要です");
     }
 
-    Node *condition = expr(tks);
+    NodeId condition = expr(tks);
 
     if (!consume(tks, TK_PRCLOSE))
     {
         error(tks, "while文には')'が必要です");
     }
 
-    Node *then = stmt(tks);
+    NodeId then = stmt(tks);
 
-    return new_node_while(condition, then);
+    return new_node_while(tks, condition, then);
 }
 
 // ステートメントノード
-static Node *stmt(Tokens *tks)
+static NodeId stmt(Tokens *tks)
 {
     if (is_match_next_token(tks, TK_BRACE_OPEN))
     {
         return multi_stmt(tks);
     }
 
-    Node *node;
+    NodeId node;
     if (consume(tks, TK_RETURN))
     {
-        node = new_node_return(expr(tks));
+        node = new_node_return(tks, expr(tks));
     }
     else if (consume(tks, TK_IF))
     {
@@ -674,11 +839,11 @@ static Node *stmt(Tokens *tks)
     }
     else if (consume(tks, TK_STMT))
     {
-        return new_node_empty_stmt();
+        return new_node_empty_stmt(tks);
     }
     else if (consume(tks, TK_INT))
     {
-        Token *tk = current_token(tks);
+        int tk = current_token(tks);
 
         // 変数定義
         if (!consume(tks, TK_IDENT))
@@ -686,16 +851,17 @@ static Node *stmt(Tokens *tks)
             error(tks, "変数名の必要があります。");
         }
 
-        if (!can_declaration_variable(tks, tk->input))
+        Symbol *sym = token_symbol(tks, tk);
+        if (!can_declaration_variable(tks, sym))
         {
-            char *msg = calloc(256, sizeof(char));
-            snprintf(msg, 256, "定義済みの変数'%s'です", tk->input);
+            char msg[256];
+            snprintf(msg, 256, "定義済みの変数'%s'です", sym->name);
             error(tks, msg);
         }
 
-        VariableInfo *info = new_local_varinfo(VT_INT, tk->input, tks->variable_offset);
-        map_put(tks->variables->data[tks->variables->len - 1], info->name, info);
-        node = new_node_vardef(info);
+        uint32_t variable = new_local_varinfo(tks, VT_INT, sym->name, tks->variable_offset);
+        declare_variable(tks, sym, variable);
+        node = new_node_vardef(tks, variable);
         tks->variable_offset += STACK_UNIT;
     }
     else
@@ -712,15 +878,12 @@ static Node *stmt(Tokens *tks)
 }
 
 // 複文 / ブロック（{}）
-static Node *multi_stmt(Tokens *tks)
+static NodeId multi_stmt(Tokens *tks)
 {
-    int current_scope_depth = tks->variables->len;
+    // このスコープ用の束縛をつくる
+    enter_scope(tks);
 
-    // このスコープ用のローカル変数MAPをつくる
-    Map *local_variables = new_map();
-    vec_push(tks->variables, local_variables);
-
-    Node *node = new_node_block();
+    int mark = tks->num_pending;
 
     if (!consume(tks, TK_BRACE_OPEN))
     {
@@ -739,101 +902,128 @@ static Node *multi_stmt(Tokens *tks)
         }
         else
         {
-            vec_push(node->block_stmts, stmt(tks));
+            push_pending(tks, stmt(tks));
         }
     }
 
-    tks->variables->len = current_scope_depth;
-    vec_push(node->block_stmts, NULL);
-    return node;
+    leave_scope(tks);
+    return new_node_block(tks, mark);
 }
 
 // 関数定義
-static Node *funcdef(Tokens *tks, const char *name)
+static NodeId funcdef(Tokens *tks, const char *name)
 {
-    int current_scope_depth = tks->variables->len;
-
-    // この関数用のローカル変数MAPをつくる
-    Map *local_variables = new_map();
-    vec_push(tks->variables, local_variables);
+    // この関数（引数）用の束縛をつくる
+    enter_scope(tks);
 
     // 関数ごとに変数のオフセットはクリアする
     tks->variable_offset = 0;
 
-    Node *node = new_node_funcdef(name);
+    NodeId node = new_node_funcdef(tks, name);
+    uint32_t func = node_of(tks, node)->func;
 
-    // 仮引数
+    // 仮引数（区切りのカンマは省略可能）
+    int mark = tks->num_pending;
     while (!consume(tks, TK_PRCLOSE))
     {
+        consume_separator(tks, mark);
         if (!consume(tks, TK_INT))
         {
             error(tks, "仮引数の型が未定義です。");
         }
 
-        Token *tk = current_token(tks);
+        int tk = current_token(tks);
         if (!consume(tks, TK_IDENT))
         {
             error(tks, "仮引数の宣言が不正です");
         }
 
-        if (!can_declaration_variable(tks, tk->input))
+        Symbol *sym = token_symbol(tks, tk);
+        if (!can_declaration_variable(tks, sym))
         {
-            char *msg = calloc(256, sizeof(char));
-            snprintf(msg, 256, "定義済みの変数'%s'です", tk->input);
+            char msg[256];
+            snprintf(msg, 256, "定義済みの変数'%s'です", sym->name);
             error(tks, msg);
         }
 
         // うーん、引数もきちんとマッピングしておかないと後々困りそうな……
-        VariableInfo *info = new_local_varinfo(VT_INT, tk->input, tks->variable_offset);
-        map_put(local_variables, info->name, info);
+        uint32_t variable = new_local_varinfo(tks, VT_INT, sym->name, tks->variable_offset);
+        declare_variable(tks, sym, variable);
         tks->variable_offset += STACK_UNIT;
-        vec_push(node->func->args, tk->input);
+        push_pending(tks, variable);
     }
 
+    ast_func(tks->ast, func)->num_args = tks->num_pending - mark;
+    ast_func(tks->ast, func)->args = pop_pending(tks, mark);
+
     // 関数定義本体（ブレース内）
-    node->func->body = multi_stmt(tks);
-    node->func->stack_size = tks->variable_offset;
+    NodeId body = multi_stmt(tks);
+    ast_func(tks->ast, func)->body = body;
+    ast_func(tks->ast, func)->stack_size = tks->variable_offset;
 
-    tks->variables->len = current_scope_depth;
+    leave_scope(tks);
     return node;
 }
 
+// トークン列[begin, end)の内容のハッシュ
+// 関数定義のトークン列と、その時点で見えるグローバル変数から関数のキャッシュのキーを作る
+static uint64_t hash_tokens(Tokens *tks, int begin, int end)
+{
+    const TokenList *tl = tks->tokens;
+    uint64_t hash = tks->globals_hash;
+
+    for (int i = begin; i < end; i++)
+    {
+        hash = hash_bytes(hash, &tl->types[i], sizeof(tl->types[i]));
+        hash = hash_bytes(hash, tl->source + tl->offsets[i], tl->lengths[i]);
+    }
+
+    return hash;
+}
+
 // グローバル領域の定義
 // 関数と変数
-static Node *global(Tokens *tks)
+static NodeId global(Tokens *tks)
 {
-    Node *node = NULL;
+    NodeId node = NODE_NONE;
+    int begin = current_token(tks);
 
     if (!consume(tks, TK_INT))
     {
         error(tks, "関数の戻り値または変数の型が未定義です。");
     }
 
-    Token *tk = current_token(tks);
+    int tk = current_token(tks);
     if (!consume(tks, TK_IDENT))
     {
         error(tks, "関数名か変数名が見つかりません");
     }
 
-    const char *name = tk->input;
+    Symbol *sym = token_symbol(tks, tk);
+    const char *name = sym->name;
     if (consume(tks, TK_PROPEN))
     {
         // 関数っぽい
         node = funcdef(tks, name);
+        if (cache_enabled())
+        {
+            ast_func(tks->ast, node_of(tks, node)->func)->hash = hash_tokens(tks, begin, current_token(tks));
+        }
     }
     else if (consume(tks, TK_STMT))
     {
         // 変数っぽい
-        if (!can_declaration_variable(tks, name))
+        if (!can_declaration_variable(tks, sym))
         {
-            char *msg = calloc(256, sizeof(char));
+            char msg[256];
             snprintf(msg, 256, "定義済みの変数'%s'です", name);
             error(tks, msg);
         }
 
-        VariableInfo *info = new_global_varinfo(VT_INT, name);
-        map_put(tks->variables->data[tks->variables->len - 1], info->name, info);
-        node = new_node_vardef(info);
+        uint32_t variable = new_global_varinfo(tks, VT_INT, name);
+        declare_variable(tks, sym, variable);
+        node = new_node_vardef(tks, variable);
+        tks->globals_hash = hash_bytes(tks->globals_hash, name, sym->len + 1);
         // tks->variable_offset += STACK_UNIT;
     }
     else
@@ -846,19 +1036,24 @@ static Node *global(Tokens *tks)
 }
 
 // プログラム全体のノード作成
-Vector *program(Vector *token_list)
+Ast *program(TokenList *token_list)
 {
-    Vector *code = new_vector();
-    Vector *variables = new_vector();
-    // グローバル変数MAPをつくる
-    Map *global_variables = new_map();
-    vec_push(variables, global_variables);
+    Ast *ast = arena_alloc(ARENA_NODE, sizeof(Ast));
+    mem_count(MEM_NODES, sizeof(Ast), 1);
 
     Tokens tokens = {
         .tokens = token_list,
         .pos = 0,
-        .variables = variables,
-        .variable_offset = 0};
+        .scopes = new_vector_in(ARENA_NODE),
+        .variable_offset = 0,
+        .ast = ast,
+        .globals_hash = HASH_INIT};
+
+    // ノード番号0は空ノードとして予約しておく
+    new_node(&tokens, 0);
+
+    // グローバル変数用の束縛をつくる
+    enter_scope(&tokens);
 
     for (;;)
     {
@@ -867,12 +1062,16 @@ Vector *program(Vector *token_list)
             break;
         }
 
-        vec_push(code, global(&tokens));
+        push_pending(&tokens, global(&tokens));
     }
 
-    vec_push(code, NULL);
+    // 識別子はインターンされて使い回されるので、グローバル変数の束縛も外しておく
+    leave_scope(&tokens);
+
+    ast->num_decls = tokens.num_pending;
+    ast->decls = pop_pending(&tokens, 0);
 
-    return code;
+    return ast;
 }
 
 // [種類] [演算子] [結合規則]
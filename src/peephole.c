@@ -0,0 +1,617 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "shcc.h"
+
+// 覗き穴最適化
+//
+// 関数の命令列を先頭から一命令ずつ出力側へ移し、そのたびに出力の末尾の数命令（窓）へ
+// 規則表の規則を当てはまらなくなるまで適用する
+// 窓はラベルを越えず、コメントは飛ばして数える
+// 「この先でレジスタ・フラグを使わない」という条件は、まだ移していない命令列を
+// ジャンプ先もたどりながら先読みして確かめる（確かめられなければ使うものとみなす）
+
+// 窓の最大の命令数
+#define WINDOW 8
+
+// 窓を集めるときにさかのぼる最大の命令数（コメントを含む）
+// コメントばかりが続く場合でも窓を集める時間を一定にする
+#define WINDOW_SCAN (WINDOW * 4)
+
+// 先読みする最大の命令数
+#define LOOKAHEAD 32
+
+// 呼び出し元へ値を保って返すレジスタ
+#define CALLEE_SAVED (REG_BIT(REG_RBX) | REG_BIT(REG_RBP) | REG_BIT(REG_RSP) | REG_BIT(REG_R12) | REG_BIT(REG_R13) | \
+                      REG_BIT(REG_R14) | REG_BIT(REG_R15))
+
+// 関数一つ分の最適化状態
+typedef struct
+{
+    AsmFunc *func;
+    int out_len;       // 出力側の命令数（命令列の先頭から）
+    int next;          // 次に出力側へ移す命令
+    Map *labels;       // ラベルの位置+1
+    int tail[WINDOW];  // 窓の命令の位置（tail[0]が最後）
+    int tail_len;
+} Peephole;
+
+// 規則
+// 窓に当てはまれば書き換えてtrueを返す
+typedef struct
+{
+    const char *name;
+    bool (*apply)(Peephole *ph);
+    atomic_long hits;
+} PeepholeRule;
+
+// オペランドが読むレジスタ（メモリオペランドのベース）
+static uint32_t address_regs(const Operand *opd)
+{
+    return opd->kind == OPD_MEM ? REG_BIT(opd->reg) : 0;
+}
+
+// 命令が読むレジスタ
+static uint32_t ins_reads(const Ins *ins)
+{
+    uint32_t regs = address_regs(&ins->dst) | address_regs(&ins->src);
+    if (ins->src.kind == OPD_REG)
+    {
+        regs |= REG_BIT(full_reg(ins->src.reg));
+    }
+
+    uint32_t dst = ins->dst.kind == OPD_REG ? REG_BIT(full_reg(ins->dst.reg)) : 0;
+    switch (ins->op)
+    {
+    case OP_PUSH:
+    case OP_ADD:
+    case OP_SUB:
+    case OP_NEG:
+    case OP_CMP:
+        return regs | dst;
+    case OP_MUL:
+        return regs | dst | REG_BIT(REG_RAX);
+    case OP_DIV:
+        return regs | dst | REG_BIT(REG_RAX) | REG_BIT(REG_RDX);
+    case OP_CALL:
+        return regs | ARG_REGS | REG_BIT(REG_RAX);
+    case OP_RET:
+        return regs | REG_BIT(REG_RAX) | CALLEE_SAVED;
+    case OP_LEAVE:
+        return regs | REG_BIT(REG_RBP);
+    default:
+        return regs;
+    }
+}
+
+// 命令が値をすべて書き換えるレジスタ
+// setccは下位8bitしか書かないので含めない
+static uint32_t ins_writes(const Ins *ins)
+{
+    uint32_t dst = ins->dst.kind == OPD_REG ? REG_BIT(full_reg(ins->dst.reg)) : 0;
+    switch (ins->op)
+    {
+    case OP_POP:
+    case OP_MOV:
+    case OP_MOVZB:
+    case OP_LEA:
+    case OP_ADD:
+    case OP_SUB:
+    case OP_NEG:
+        return dst;
+    case OP_MUL:
+    case OP_DIV:
+        return REG_BIT(REG_RAX) | REG_BIT(REG_RDX);
+    case OP_CALL:
+        return CALLER_SAVED;
+    case OP_LEAVE:
+        return REG_BIT(REG_RBP) | REG_BIT(REG_RSP);
+    default:
+        return 0;
+    }
+}
+
+// 命令が書き換えうるレジスタ（一部だけ書くsetccを含む）
+// 値を保ったまま命令を動かせるかの判定に使う
+static uint32_t ins_modifies(const Ins *ins)
+{
+    uint32_t regs = ins_writes(ins);
+    if (ins->op >= OP_SETE && ins->op <= OP_SETGE && ins->dst.kind == OPD_REG)
+    {
+        regs |= REG_BIT(full_reg(ins->dst.reg));
+    }
+    return regs;
+}
+
+// 命令がフラグを読むか
+static bool reads_flags(Opcode_t op)
+{
+    switch (op)
+    {
+    case OP_SETE:
+    case OP_SETNE:
+    case OP_SETL:
+    case OP_SETLE:
+    case OP_SETG:
+    case OP_SETGE:
+    case OP_JE:
+    case OP_JNE:
+    case OP_JL:
+    case OP_JLE:
+    case OP_JG:
+    case OP_JGE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 命令がフラグを書き換えるか（呼び出しでは保存されない）
+static bool writes_flags(Opcode_t op)
+{
+    return op == OP_ADD || op == OP_SUB || op == OP_NEG || op == OP_CMP || op == OP_MUL || op == OP_DIV ||
+           op == OP_CALL;
+}
+
+// 条件付きジャンプか
+static bool is_cond_jump(Opcode_t op)
+{
+    return op >= OP_JE && op <= OP_JGE;
+}
+
+// スタック・制御の流れに関わる命令か（窓の中で命令を入れ替えられない）
+static bool is_barrier(Opcode_t op)
+{
+    return op == OP_PUSH || op == OP_POP || op == OP_CALL || op == OP_LEAVE || op == OP_RET || op == OP_JMP ||
+           is_cond_jump(op) || op == OP_LABEL;
+}
+
+// レジスタオペランドか
+static bool is_reg(const Operand *opd, int reg)
+{
+    return opd->kind == OPD_REG && full_reg(opd->reg) == reg;
+}
+
+// まだ出力側へ移していないラベルの位置（なければ-1）
+// 後方のラベルは出力側で書き換わっているので、先読みではたどらない
+static int find_label(const Peephole *ph, const Operand *label)
+{
+    int pos = map_geti(ph->labels, label_key(label)) - 1;
+    return pos >= ph->next ? pos : -1;
+}
+
+// 位置posから先で、レジスタとフラグの値が使われないか
+static bool is_dead_from(const Peephole *ph, int pos, uint32_t regs, bool flags, int *budget)
+{
+    const AsmFunc *func = ph->func;
+    for (int i = pos; i < func->len; i++)
+    {
+        if (regs == 0 && !flags)
+        {
+            return true;
+        }
+        if (--*budget < 0)
+        {
+            return false;
+        }
+
+        const Ins *ins = &func->ins[i];
+        if ((ins_reads(ins) & regs) || (flags && reads_flags(ins->op)))
+        {
+            return false;
+        }
+        regs &= ~ins_writes(ins);
+        flags = flags && !writes_flags(ins->op);
+
+        if (ins->op == OP_RET)
+        {
+            return true;
+        }
+        if (ins->op == OP_JMP || is_cond_jump(ins->op))
+        {
+            int target = find_label(ph, &ins->dst);
+            if (target < 0)
+            {
+                return false;
+            }
+            if (ins->op == OP_JMP)
+            {
+                i = target;
+                continue;
+            }
+            if (!is_dead_from(ph, target, regs, flags, budget))
+            {
+                return false;
+            }
+        }
+    }
+
+    // 復帰せずに関数の終わりに達した（確かめられない）
+    return false;
+}
+
+// 窓の後でレジスタとフラグの値が使われないか
+static bool is_dead(const Peephole *ph, uint32_t regs, bool flags)
+{
+    int budget = LOOKAHEAD;
+    return is_dead_from(ph, ph->next, regs, flags, &budget);
+}
+
+// 窓の命令を集める
+static void collect_tail(Peephole *ph)
+{
+    ph->tail_len = 0;
+    int stop = ph->out_len > WINDOW_SCAN ? ph->out_len - WINDOW_SCAN : 0;
+    for (int i = ph->out_len - 1; i >= stop && ph->tail_len < WINDOW; i--)
+    {
+        const Ins *ins = &ph->func->ins[i];
+        if (ins->op == OP_LABEL)
+        {
+            break;
+        }
+        if (ins->op != OP_COMMENT)
+        {
+            ph->tail[ph->tail_len++] = i;
+        }
+    }
+}
+
+// 窓のk番目（0が最後）の命令
+static Ins *tail_ins(const Peephole *ph, int k)
+{
+    return k < ph->tail_len ? &ph->func->ins[ph->tail[k]] : NULL;
+}
+
+// 窓のk番目の命令を取り除く
+// 窓は集め直す
+static void remove_tail(Peephole *ph, int k)
+{
+    int pos = ph->tail[k];
+    Ins *ins = ph->func->ins;
+    memmove(&ins[pos], &ins[pos + 1], (ph->out_len - pos - 1) * sizeof(Ins));
+    ph->out_len--;
+    collect_tail(ph);
+}
+
+// push X; ...; pop R => ...; mov R, X
+// 間の命令がスタックを使わず、Xを書き換えない場合
+static bool rule_push_pop(Peephole *ph)
+{
+    Ins *pop = tail_ins(ph, 0);
+    if (pop == NULL || pop->op != OP_POP)
+    {
+        return false;
+    }
+
+    for (int k = 1; k < ph->tail_len; k++)
+    {
+        Ins *ins = tail_ins(ph, k);
+        if (ins->op == OP_PUSH)
+        {
+            if (ins->dst.kind != OPD_REG && ins->dst.kind != OPD_IMM)
+            {
+                return false;
+            }
+            Operand value = ins->dst;
+            for (int j = 1; j < k; j++)
+            {
+                if (value.kind == OPD_REG && (ins_modifies(tail_ins(ph, j)) & REG_BIT(value.reg)))
+                {
+                    return false;
+                }
+            }
+            *pop = (Ins){.op = OP_MOV, .dst = pop->dst, .src = value};
+            remove_tail(ph, k);
+            return true;
+        }
+        if (is_barrier(ins->op))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+// mov R, R => （削除）
+static bool rule_self_mov(Peephole *ph)
+{
+    Ins *ins = tail_ins(ph, 0);
+    if (ins == NULL || ins->op != OP_MOV || ins->dst.kind != OPD_REG || !is_reg(&ins->src, ins->dst.reg))
+    {
+        return false;
+    }
+
+    remove_tail(ph, 0);
+    return true;
+}
+
+// mov R, rbp; sub R, K => lea R, [rbp-K]
+// subが書くフラグを使わない場合
+static bool rule_lea_local(Peephole *ph)
+{
+    Ins *sub = tail_ins(ph, 0);
+    Ins *mov = tail_ins(ph, 1);
+    if (mov == NULL || sub->op != OP_SUB || mov->op != OP_MOV || sub->src.kind != OPD_IMM ||
+        mov->dst.kind != OPD_REG || !is_reg(&mov->src, REG_RBP) || !is_reg(&sub->dst, mov->dst.reg) ||
+        !is_dead(ph, 0, true))
+    {
+        return false;
+    }
+
+    *mov = (Ins){.op = OP_LEA, .dst = mov->dst, .src = {.kind = OPD_MEM, .reg = REG_RBP, .imm = -sub->src.imm}};
+    remove_tail(ph, 0);
+    return true;
+}
+
+// lea R, [B+d]; mov D, [R] => mov D, [B+d]
+// DがRと同じか、Rの値を後で使わない場合
+static bool rule_load_local(Peephole *ph)
+{
+    Ins *load = tail_ins(ph, 0);
+    Ins *lea = tail_ins(ph, 1);
+    if (lea == NULL || load->op != OP_MOV || lea->op != OP_LEA || lea->src.kind != OPD_MEM ||
+        load->src.kind != OPD_MEM || load->src.imm != 0 || load->dst.kind != OPD_REG ||
+        !is_reg(&lea->dst, load->src.reg))
+    {
+        return false;
+    }
+    int addr = lea->dst.reg;
+    if (load->dst.reg != addr && !is_dead(ph, REG_BIT(addr), false))
+    {
+        return false;
+    }
+
+    load->src = lea->src;
+    remove_tail(ph, 1);
+    return true;
+}
+
+// lea R, [B+d]; ...; mov [R], S => ...; mov [B+d], S
+// 間の命令がRとBを読み書きせず、Rの値を後で使わない場合
+static bool rule_store_local(Peephole *ph)
+{
+    Ins *store = tail_ins(ph, 0);
+    if (store == NULL || store->op != OP_MOV || store->dst.kind != OPD_MEM || store->dst.imm != 0 ||
+        store->src.kind != OPD_REG)
+    {
+        return false;
+    }
+    int addr = store->dst.reg;
+
+    for (int k = 1; k < ph->tail_len && k < 4; k++)
+    {
+        Ins *ins = tail_ins(ph, k);
+        if (ins->op == OP_LEA && is_reg(&ins->dst, addr))
+        {
+            if (ins->src.kind != OPD_MEM || full_reg(store->src.reg) == addr || !is_dead(ph, REG_BIT(addr), false))
+            {
+                return false;
+            }
+            uint32_t touched = REG_BIT(addr) | REG_BIT(ins->src.reg);
+            for (int j = 1; j < k; j++)
+            {
+                const Ins *mid = tail_ins(ph, j);
+                if (is_barrier(mid->op) || ((ins_reads(mid) | ins_modifies(mid)) & touched))
+                {
+                    return false;
+                }
+            }
+            store->dst = ins->src;
+            remove_tail(ph, k);
+            return true;
+        }
+        if (is_barrier(ins->op))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+// mov R1, X; mov R2, R1 => mov R2, X
+// R1の値を後で使わない場合
+static bool rule_mov_through(Peephole *ph)
+{
+    Ins *second = tail_ins(ph, 0);
+    Ins *first = tail_ins(ph, 1);
+    if (first == NULL || first->op != OP_MOV || second->op != OP_MOV || first->dst.kind != OPD_REG ||
+        second->dst.kind != OPD_REG || !is_reg(&second->src, first->dst.reg) ||
+        second->dst.reg == first->dst.reg || !is_dead(ph, REG_BIT(first->dst.reg), false))
+    {
+        return false;
+    }
+
+    // メモリ同士の転送はできないので、転送元はレジスタ・即値・メモリのどれでもよい
+    first->dst = second->dst;
+    remove_tail(ph, 0);
+    return true;
+}
+
+// mov R, imm; op D, R => op D, imm（opはadd/sub/cmp）
+// Rの値を後で使わない場合
+static bool rule_imm_operand(Peephole *ph)
+{
+    Ins *op = tail_ins(ph, 0);
+    Ins *mov = tail_ins(ph, 1);
+    if (mov == NULL || (op->op != OP_ADD && op->op != OP_SUB && op->op != OP_CMP) || mov->op != OP_MOV ||
+        mov->dst.kind != OPD_REG || mov->src.kind != OPD_IMM || op->dst.kind != OPD_REG ||
+        !is_reg(&op->src, mov->dst.reg) || is_reg(&op->dst, mov->dst.reg) ||
+        !is_dead(ph, REG_BIT(mov->dst.reg), false))
+    {
+        return false;
+    }
+
+    op->src = mov->src;
+    remove_tail(ph, 1);
+    return true;
+}
+
+// setcc命令の条件が成り立たないときに飛ぶジャンプ命令
+static Opcode_t inverse_jump(Opcode_t setcc)
+{
+    switch (setcc)
+    {
+    case OP_SETE:
+        return OP_JNE;
+    case OP_SETNE:
+        return OP_JE;
+    case OP_SETL:
+        return OP_JGE;
+    case OP_SETLE:
+        return OP_JG;
+    case OP_SETG:
+        return OP_JLE;
+    case OP_SETGE:
+        return OP_JL;
+    default:
+        return OP_NOP;
+    }
+}
+
+// setcc al; movzb R, al; cmp R, 0; je L => j(逆の条件) L
+// raxとRとフラグの値を後で使わない場合
+static bool rule_cmp_branch(Peephole *ph)
+{
+    Ins *je = tail_ins(ph, 0);
+    Ins *cmp = tail_ins(ph, 1);
+    Ins *movzb = tail_ins(ph, 2);
+    Ins *setcc = tail_ins(ph, 3);
+    if (setcc == NULL || je->op != OP_JE || cmp->op != OP_CMP || movzb->op != OP_MOVZB ||
+        inverse_jump(setcc->op) == OP_NOP || !is_reg(&setcc->dst, REG_RAX) || !is_reg(&movzb->src, REG_RAX) ||
+        movzb->dst.kind != OPD_REG || !is_reg(&cmp->dst, movzb->dst.reg) || cmp->src.kind != OPD_IMM ||
+        cmp->src.imm != 0)
+    {
+        return false;
+    }
+
+    // ジャンプ先と次の命令の両方で使わないこと
+    uint32_t regs = REG_BIT(REG_RAX) | REG_BIT(movzb->dst.reg);
+    int budget = LOOKAHEAD;
+    int target = find_label(ph, &je->dst);
+    if (target < 0 || !is_dead(ph, regs, true) || !is_dead_from(ph, target, regs, true, &budget))
+    {
+        return false;
+    }
+
+    *setcc = (Ins){.op = inverse_jump(setcc->op), .dst = je->dst};
+    remove_tail(ph, 0);
+    remove_tail(ph, 0);
+    remove_tail(ph, 0);
+    return true;
+}
+
+// 書いた値を使わないmov/lea/movzb => （削除）
+static bool rule_dead_mov(Peephole *ph)
+{
+    Ins *ins = tail_ins(ph, 0);
+    if (ins == NULL || (ins->op != OP_MOV && ins->op != OP_LEA && ins->op != OP_MOVZB) ||
+        ins->dst.kind != OPD_REG || !is_dead(ph, REG_BIT(full_reg(ins->dst.reg)), false))
+    {
+        return false;
+    }
+
+    remove_tail(ph, 0);
+    return true;
+}
+
+// ジャンプ・復帰の直後の命令 => （削除）
+// ラベルが無いのでどこからも到達しない
+static bool rule_unreachable(Peephole *ph)
+{
+    Ins *prev = tail_ins(ph, 1);
+    if (prev == NULL || (prev->op != OP_JMP && prev->op != OP_RET))
+    {
+        return false;
+    }
+
+    remove_tail(ph, 0);
+    return true;
+}
+
+// jmp L; L: => L:
+// 間にはラベルとコメントしかない場合
+static bool rule_jump_next(Peephole *ph)
+{
+    Ins *jmp = tail_ins(ph, 0);
+    if (jmp->op != OP_JMP)
+    {
+        return false;
+    }
+
+    const AsmFunc *func = ph->func;
+    for (int i = ph->next; i < func->len && (func->ins[i].op == OP_LABEL || func->ins[i].op == OP_COMMENT); i++)
+    {
+        const Operand *label = &func->ins[i].dst;
+        if (func->ins[i].op == OP_LABEL && label->imm == jmp->dst.imm && strcmp(label->sym, jmp->dst.sym) == 0)
+        {
+            remove_tail(ph, 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 規則表（上から順に試す）
+static PeepholeRule rules[] = {
+    {"push-pop", rule_push_pop},
+    {"self-mov", rule_self_mov},
+    {"lea-local", rule_lea_local},
+    {"load-local", rule_load_local},
+    {"store-local", rule_store_local},
+    {"mov-through", rule_mov_through},
+    {"imm-operand", rule_imm_operand},
+    {"cmp-branch", rule_cmp_branch},
+    {"dead-mov", rule_dead_mov},
+    {"unreachable", rule_unreachable},
+    {"jump-next", rule_jump_next},
+};
+
+// 関数の命令列を覗き穴最適化する
+// 命令列はその場で書き換える
+void peephole_optimize(AsmFunc *func)
+{
+    Peephole ph = {.func = func, .labels = new_map_in(ARENA_CODEGEN)};
+    for (int i = 0; i < func->len; i++)
+    {
+        if (func->ins[i].op == OP_LABEL)
+        {
+            map_puti(ph.labels, label_key(&func->ins[i].dst), i + 1);
+        }
+    }
+
+    while (ph.next < func->len)
+    {
+        func->ins[ph.out_len++] = func->ins[ph.next++];
+        collect_tail(&ph);
+
+        for (int r = 0; r < NUMOF(rules);)
+        {
+            if (ph.tail_len > 0 && rules[r].apply(&ph))
+            {
+                atomic_fetch_add(&rules[r].hits, 1);
+                r = 0;
+            }
+            else
+            {
+                r++;
+            }
+        }
+    }
+
+    func->len = ph.out_len;
+}
+
+// 規則ごとの適用回数を標準エラー出力へ出力する
+void peephole_stats_print(void)
+{
+    fprintf(stderr, "Peephole stats:\n");
+    fprintf(stderr, "  %-16s %10s\n", "rule", "hits");
+    for (int i = 0; i < NUMOF(rules); i++)
+    {
+        fprintf(stderr, "  %-16s %10ld\n", rules[i].name, atomic_load(&rules[i].hits));
+    }
+}
@@ -0,0 +1,633 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shcc.h"
+
+// ローカル変数・スピル領域一つ分の大きさ
+#define STACK_UNIT 8
+
+// 物理レジスタが定義されていないことを表す位置
+#define NO_DEF INT_MIN
+
+// 引数に使うレジスタ
+static const Register_t arg_regs[] = {REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9};
+
+// スピルした仮想レジスタを読み書きするためのレジスタ（割り当てには使わない）
+#define SCRATCH_DST REG_R10
+#define SCRATCH_SRC REG_R11
+
+// 割り当てに使うレジスタ（優先順）
+// 呼び出しで壊れるレジスタを先に使い、呼び出しをまたぐ区間には呼び出し先で保存するレジスタを使う
+static const Register_t alloc_regs[] = {
+    REG_RCX, REG_RSI, REG_RDI, REG_R8, REG_R9, REG_RDX, REG_RAX,
+    REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15,
+};
+
+// 呼び出し先で保存するレジスタ
+static const Register_t callee_saved_regs[] = {REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15};
+
+// 仮想レジスタの生存区間
+// 位置は命令番号の2倍で、命令の間（奇数）でも物理レジスタの使用を区別する
+typedef struct
+{
+    int vreg;
+    int start;          // 最初に現れる命令番号
+    int end;            // 最後に現れる命令番号
+    uint32_t forbidden; // 区間内で他の用途に使われる物理レジスタ
+    int reg;            // 割り当てたレジスタ（スピルしたら-1）
+} Interval;
+
+// 関数一つ分の割り当て状態
+typedef struct
+{
+    const LirFunc *lir;
+    Interval *intervals; // 仮想レジスタ番号順
+    int *reg_of;         // 仮想レジスタごとのレジスタ（スピルしたら-1）
+    int *slot_of;        // 仮想レジスタごとのスピル領域の番号
+    int num_spills;
+    uint32_t used; // 使用したレジスタ
+} RegAlloc;
+
+// 割り当てのエラー
+static void error(const char *msg)
+{
+    compile_error("%s", msg);
+}
+
+// 命令が読む物理レジスタ
+static uint32_t phys_reads(const Ins *ins)
+{
+    uint32_t regs = 0;
+    if (ins->src.kind == OPD_REG)
+    {
+        regs |= REG_BIT(full_reg(ins->src.reg));
+    }
+
+    switch (ins->op)
+    {
+    case OP_MUL:
+        return regs | REG_BIT(REG_RAX);
+    case OP_DIV:
+        return regs | REG_BIT(REG_RAX) | REG_BIT(REG_RDX);
+    case OP_CALL:
+        return regs | ARG_REGS | REG_BIT(REG_RAX);
+    case OP_RET:
+        return regs | REG_BIT(REG_RAX);
+    default:
+        return regs;
+    }
+}
+
+// 命令が結果を置く物理レジスタのうち、オペランドに現れないもの
+static uint32_t phys_results(const Ins *ins)
+{
+    switch (ins->op)
+    {
+    case OP_DIV:
+        return REG_BIT(REG_RAX) | REG_BIT(REG_RDX);
+    case OP_MUL:
+    case OP_CALL:
+    case OP_SETE:
+    case OP_SETNE:
+    case OP_SETL:
+    case OP_SETLE:
+    case OP_SETG:
+    case OP_SETGE:
+        return REG_BIT(REG_RAX);
+    default:
+        return 0;
+    }
+}
+
+// 命令が書く物理レジスタのうち、オペランドに現れないもの（壊れるレジスタ）
+static uint32_t phys_clobbers(const Ins *ins)
+{
+    switch (ins->op)
+    {
+    case OP_MUL:
+    case OP_DIV:
+        return REG_BIT(REG_RAX) | REG_BIT(REG_RDX);
+    case OP_CALL:
+        return CALLER_SAVED;
+    case OP_SETE:
+    case OP_SETNE:
+    case OP_SETL:
+    case OP_SETLE:
+    case OP_SETG:
+    case OP_SETGE:
+        return REG_BIT(REG_RAX);
+    default:
+        return 0;
+    }
+}
+
+// 命令がdstを読むか
+static bool reads_dst(Opcode_t op)
+{
+    return op == OP_ADD || op == OP_SUB || op == OP_NEG || op == OP_CMP || op == OP_MUL || op == OP_DIV;
+}
+
+// 命令がdstへ書くか
+static bool writes_dst(Opcode_t op)
+{
+    return op == OP_MOV || op == OP_MOVZB || op == OP_LEA || op == OP_ADD || op == OP_SUB || op == OP_NEG;
+}
+
+// オペランドが仮想レジスタを使うか
+static bool is_virtual(const Operand *opd)
+{
+    return opd->kind == OPD_VREG || opd->kind == OPD_VMEM;
+}
+
+// 仮想レジスタの集合の語数
+static int bitset_words(int num_vregs)
+{
+    return (num_vregs + 63) / 64;
+}
+
+// 集合に仮想レジスタを加える
+static void bitset_add(uint64_t *set, int v)
+{
+    set[v / 64] |= (uint64_t)1 << (v % 64);
+}
+
+// 集合に仮想レジスタが含まれるか
+static bool bitset_has(const uint64_t *set, int v)
+{
+    return (set[v / 64] >> (v % 64)) & 1;
+}
+
+// 命令が読み書きする仮想レジスタを集合へ加える
+// 書く前に読むものだけをuseへ加える
+static void add_use_def(const Ins *ins, uint64_t *use, uint64_t *def)
+{
+    if (is_virtual(&ins->src) && !bitset_has(def, ins->src.imm))
+    {
+        bitset_add(use, ins->src.imm);
+    }
+    if (!is_virtual(&ins->dst))
+    {
+        return;
+    }
+    if ((ins->dst.kind == OPD_VMEM || reads_dst(ins->op)) && !bitset_has(def, ins->dst.imm))
+    {
+        bitset_add(use, ins->dst.imm);
+    }
+    if (ins->dst.kind == OPD_VREG && writes_dst(ins->op))
+    {
+        bitset_add(def, ins->dst.imm);
+    }
+}
+
+// 生存区間の算出
+//
+// 命令列をラベルと分岐で基本ブロックに分け、後ろ向きのデータフロー解析でブロックの出入口で生きている
+// 仮想レジスタを求める
+// 区間は、仮想レジスタが現れる位置と、生きたまま出入りするブロックの境界をすべて含む範囲とする
+static void build_intervals(RegAlloc *ra)
+{
+    const LirFunc *lir = ra->lir;
+    Interval *intervals = ra->intervals;
+    for (int v = 0; v < lir->num_vregs; v++)
+    {
+        intervals[v] = (Interval){.vreg = v, .start = -1, .end = -1, .reg = -1};
+    }
+
+    // 基本ブロックの先頭位置
+    Map *labels = new_map_in(ARENA_CODEGEN);
+    int *begins = arena_alloc(ARENA_CODEGEN, (lir->len + 2) * sizeof(int));
+    int num_blocks = 0;
+    for (int i = 0; i < lir->len; i++)
+    {
+        const Ins *ins = &lir->ins[i];
+        bool after_branch = i > 0 && (lir->ins[i - 1].op == OP_JMP || lir->ins[i - 1].op == OP_JE ||
+                                      lir->ins[i - 1].op == OP_RET);
+        if (i == 0 || ins->op == OP_LABEL || after_branch)
+        {
+            begins[num_blocks++] = i;
+        }
+        if (ins->op == OP_LABEL)
+        {
+            map_puti(labels, label_key(&ins->dst), num_blocks);
+        }
+    }
+    begins[num_blocks] = lir->len;
+
+    // ブロックの後続（分岐先と次のブロック）
+    int *succs = arena_alloc(ARENA_CODEGEN, (num_blocks + 1) * 2 * sizeof(int));
+    for (int b = 0; b < num_blocks; b++)
+    {
+        const Ins *last = &lir->ins[begins[b + 1] - 1];
+        int fallthrough = b + 1 < num_blocks ? b + 1 : -1;
+        succs[b * 2] = -1;
+        succs[b * 2 + 1] = -1;
+        if (last->op == OP_JMP || last->op == OP_JE)
+        {
+            int target = map_geti(labels, label_key(&last->dst)) - 1;
+            if (target < 0)
+            {
+                error("ジャンプ先のラベルがありません");
+            }
+            succs[b * 2] = target;
+            if (last->op == OP_JE)
+            {
+                succs[b * 2 + 1] = fallthrough;
+            }
+        }
+        else if (last->op != OP_RET)
+        {
+            succs[b * 2] = fallthrough;
+        }
+    }
+
+    // ブロックごとのuse/defと、出入口で生きている仮想レジスタ
+    int words = bitset_words(lir->num_vregs);
+    size_t set_bytes = words * sizeof(uint64_t);
+    uint64_t *sets = arena_alloc(ARENA_CODEGEN, (num_blocks * 4 + 1) * set_bytes);
+    memset(sets, 0, (num_blocks * 4 + 1) * set_bytes);
+    mem_count(MEM_CODEGEN, (num_blocks * 4 + 1) * set_bytes, 1);
+    uint64_t *use = sets;
+    uint64_t *def = use + num_blocks * words;
+    uint64_t *live_in = def + num_blocks * words;
+    uint64_t *live_out = live_in + num_blocks * words;
+
+    for (int b = 0; b < num_blocks; b++)
+    {
+        for (int i = begins[b]; i < begins[b + 1]; i++)
+        {
+            add_use_def(&lir->ins[i], &use[b * words], &def[b * words]);
+        }
+    }
+
+    // 変わらなくなるまで後ろのブロックから繰り返す
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (int b = num_blocks - 1; b >= 0; b--)
+        {
+            for (int w = 0; w < words; w++)
+            {
+                uint64_t out = 0;
+                for (int k = 0; k < 2; k++)
+                {
+                    int s = succs[b * 2 + k];
+                    if (s >= 0)
+                    {
+                        out |= live_in[s * words + w];
+                    }
+                }
+                uint64_t in = use[b * words + w] | (out & ~def[b * words + w]);
+                if (out != live_out[b * words + w] || in != live_in[b * words + w])
+                {
+                    live_out[b * words + w] = out;
+                    live_in[b * words + w] = in;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < lir->len; i++)
+    {
+        const Ins *ins = &lir->ins[i];
+        const Operand *opds[] = {&ins->dst, &ins->src};
+        for (int j = 0; j < 2; j++)
+        {
+            if (is_virtual(opds[j]))
+            {
+                Interval *it = &intervals[opds[j]->imm];
+                if (it->start < 0)
+                {
+                    it->start = i;
+                }
+                it->end = i;
+            }
+        }
+    }
+
+    // ブロックの入口で生きていれば先頭から、出口で生きていれば次のブロックの先頭まで区間に含める
+    // 出口で生きている値はブロック内で定義されているか、入口でも生きている
+    for (int b = 0; b < num_blocks; b++)
+    {
+        int end = begins[b + 1] < lir->len ? begins[b + 1] : lir->len - 1;
+        for (int w = 0; w < words; w++)
+        {
+            // 生きている値のない語は飛ばす
+            uint64_t in = live_in[b * words + w];
+            uint64_t out = live_out[b * words + w];
+            for (int bit = 0; bit < 64 && (in | out) >> bit != 0; bit++)
+            {
+                Interval *it = &intervals[w * 64 + bit];
+                if ((in >> bit) & 1)
+                {
+                    if (it->start < 0 || it->start > begins[b])
+                    {
+                        it->start = begins[b];
+                    }
+                    it->end = it->end > begins[b] ? it->end : begins[b];
+                }
+                if ((out >> bit) & 1)
+                {
+                    it->end = it->end > end ? it->end : end;
+                }
+            }
+        }
+    }
+}
+
+// 区間ごとに、その間に他の用途で使われる物理レジスタを求める
+//
+// 物理レジスタは書いてから読むまでの間（引数レジスタは関数の先頭から）使用中とし、
+// 命令が暗黙に壊すレジスタはその命令の位置で使用中とする
+static void build_forbidden(RegAlloc *ra)
+{
+    const LirFunc *lir = ra->lir;
+    int num_points = lir->len * 2 + 1;
+    uint32_t *busy = arena_alloc(ARENA_CODEGEN, num_points * sizeof(uint32_t));
+    memset(busy, 0, num_points * sizeof(uint32_t));
+
+    int def[NUM_REGS];
+    for (int r = 0; r < NUM_REGS; r++)
+    {
+        def[r] = NO_DEF;
+    }
+    for (int i = 0; i < lir->num_args; i++)
+    {
+        def[arg_regs[i]] = -1;
+    }
+
+    for (int i = 0; i < lir->len; i++)
+    {
+        const Ins *ins = &lir->ins[i];
+        uint32_t reads = phys_reads(ins);
+        for (int r = 0; r < NUM_REGS; r++)
+        {
+            if ((reads & REG_BIT(r)) && def[r] != NO_DEF)
+            {
+                for (int p = def[r] * 2 + 1; p < i * 2; p++)
+                {
+                    if (p >= 0)
+                    {
+                        busy[p] |= REG_BIT(r);
+                    }
+                }
+                def[r] = NO_DEF;
+            }
+        }
+
+        uint32_t clobbers = phys_clobbers(ins);
+        uint32_t results = phys_results(ins);
+        busy[i * 2] |= clobbers;
+        for (int r = 0; r < NUM_REGS; r++)
+        {
+            if (results & REG_BIT(r))
+            {
+                def[r] = i;
+            }
+            else if (clobbers & REG_BIT(r))
+            {
+                def[r] = NO_DEF;
+            }
+        }
+        if (ins->dst.kind == OPD_REG && ins->op != OP_CMP)
+        {
+            def[full_reg(ins->dst.reg)] = i;
+        }
+    }
+
+    for (int v = 0; v < lir->num_vregs; v++)
+    {
+        Interval *it = &ra->intervals[v];
+        if (it->start < 0)
+        {
+            continue;
+        }
+        for (int p = it->start * 2; p <= it->end * 2; p++)
+        {
+            it->forbidden |= busy[p];
+        }
+    }
+}
+
+// 区間の開始位置順の比較
+static int compare_start(const void *a, const void *b)
+{
+    const Interval *x = *(Interval *const *)a;
+    const Interval *y = *(Interval *const *)b;
+    if (x->start != y->start)
+    {
+        return x->start - y->start;
+    }
+    return x->vreg - y->vreg;
+}
+
+// 仮想レジスタをスピルする
+static void spill(RegAlloc *ra, Interval *it)
+{
+    it->reg = -1;
+    ra->slot_of[it->vreg] = ra->num_spills++;
+}
+
+// 線形スキャンでレジスタを割り当てる
+// 空きがなければ、終わりが最も遠い区間をスピルする
+static void linear_scan(RegAlloc *ra)
+{
+    const LirFunc *lir = ra->lir;
+    Interval **sorted = arena_alloc(ARENA_CODEGEN, (lir->num_vregs + 1) * sizeof(Interval *));
+    Interval **active = arena_alloc(ARENA_CODEGEN, (lir->num_vregs + 1) * sizeof(Interval *));
+    int num_sorted = 0;
+    int num_active = 0;
+
+    for (int v = 0; v < lir->num_vregs; v++)
+    {
+        if (ra->intervals[v].start >= 0)
+        {
+            sorted[num_sorted++] = &ra->intervals[v];
+        }
+    }
+    qsort(sorted, num_sorted, sizeof(Interval *), compare_start);
+
+    for (int i = 0; i < num_sorted; i++)
+    {
+        Interval *cur = sorted[i];
+
+        // 終わった区間のレジスタを空ける
+        // 同じ命令で読み終わるレジスタへは書いてよい
+        uint32_t in_use = 0;
+        int kept = 0;
+        for (int j = 0; j < num_active; j++)
+        {
+            if (active[j]->end > cur->start)
+            {
+                active[kept++] = active[j];
+                in_use |= REG_BIT(active[j]->reg);
+            }
+        }
+        num_active = kept;
+
+        int reg = -1;
+        for (int j = 0; j < NUMOF(alloc_regs); j++)
+        {
+            uint32_t bit = REG_BIT(alloc_regs[j]);
+            if (!(in_use & bit) && !(cur->forbidden & bit))
+            {
+                reg = alloc_regs[j];
+                break;
+            }
+        }
+
+        if (reg < 0)
+        {
+            // 使えるレジスタを持つ区間のうち、終わりが最も遠いもの
+            int victim = -1;
+            for (int j = 0; j < num_active; j++)
+            {
+                if (!(cur->forbidden & REG_BIT(active[j]->reg)) &&
+                    (victim < 0 || active[j]->end > active[victim]->end))
+                {
+                    victim = j;
+                }
+            }
+            if (victim < 0 || active[victim]->end <= cur->end)
+            {
+                spill(ra, cur);
+                continue;
+            }
+            reg = active[victim]->reg;
+            spill(ra, active[victim]);
+            active[victim] = active[--num_active];
+        }
+
+        cur->reg = reg;
+        ra->used |= REG_BIT(reg);
+        active[num_active++] = cur;
+    }
+
+    for (int v = 0; v < lir->num_vregs; v++)
+    {
+        ra->reg_of[v] = ra->intervals[v].reg;
+    }
+}
+
+// スピル領域のメモリオペランド
+static Operand slot_operand(const RegAlloc *ra, int vreg)
+{
+    return (Operand){.kind = OPD_MEM, .reg = REG_RBP, .imm = -(ra->lir->stack_size + STACK_UNIT * (ra->slot_of[vreg] + 1))};
+}
+
+// 仮想レジスタを使うオペランドを物理レジスタに置き換える
+// スピルしていればスクラッチレジスタへ読み込む
+static Operand rewrite_operand(const RegAlloc *ra, const Operand *opd, Register_t scratch, bool load)
+{
+    int reg = ra->reg_of[opd->imm];
+    if (reg < 0)
+    {
+        reg = scratch;
+        if (load)
+        {
+            emit_ins_rm(OP_MOV, scratch, REG_RBP, slot_operand(ra, opd->imm).imm);
+        }
+    }
+
+    if (opd->kind == OPD_VMEM)
+    {
+        return (Operand){.kind = OPD_MEM, .reg = reg, .imm = 0};
+    }
+    return (Operand){.kind = OPD_REG, .reg = reg};
+}
+
+// 割り当て結果で命令列を出力する
+static void emit_allocated(const RegAlloc *ra)
+{
+    const LirFunc *lir = ra->lir;
+
+    // 呼び出し先で保存するレジスタのうち使ったもの
+    Register_t saved[NUMOF(callee_saved_regs)];
+    int num_saved = 0;
+    for (int i = 0; i < NUMOF(callee_saved_regs); i++)
+    {
+        if (ra->used & REG_BIT(callee_saved_regs[i]))
+        {
+            saved[num_saved++] = callee_saved_regs[i];
+        }
+    }
+
+    // フレームはローカル変数、スピル領域、保存したレジスタの順に並べる
+    int save_base = lir->stack_size + STACK_UNIT * ra->num_spills;
+    int frame_size = save_base + STACK_UNIT * num_saved;
+    frame_size = ((frame_size + (16 - 1)) / 16) * 16;
+
+    emit_comment("function prologue begin");
+    emit_ins_r(OP_PUSH, REG_RBP);
+    emit_ins_rr(OP_MOV, REG_RBP, REG_RSP);
+    if (frame_size > 0)
+    {
+        emit_ins_ri(OP_SUB, REG_RSP, frame_size);
+    }
+    for (int i = 0; i < num_saved; i++)
+    {
+        emit_ins_mr(OP_MOV, REG_RBP, -(save_base + STACK_UNIT * (i + 1)), saved[i]);
+    }
+    emit_comment("function prologue end");
+
+    for (int i = 0; i < lir->len; i++)
+    {
+        const Ins *ins = &lir->ins[i];
+
+        if (ins->op == OP_RET)
+        {
+            for (int j = 0; j < num_saved; j++)
+            {
+                emit_ins_rm(OP_MOV, saved[j], REG_RBP, -(save_base + STACK_UNIT * (j + 1)));
+            }
+            emit_ins(OP_LEAVE);
+            emit_ins(OP_RET);
+            continue;
+        }
+
+        Operand dst = ins->dst;
+        Operand src = ins->src;
+        bool spilled_dst = false;
+        if (is_virtual(&ins->src))
+        {
+            src = rewrite_operand(ra, &ins->src, SCRATCH_SRC, true);
+        }
+        if (is_virtual(&ins->dst))
+        {
+            bool load = ins->dst.kind == OPD_VMEM || reads_dst(ins->op);
+            dst = rewrite_operand(ra, &ins->dst, SCRATCH_DST, load);
+            spilled_dst = ins->dst.kind == OPD_VREG && ra->reg_of[ins->dst.imm] < 0 && writes_dst(ins->op);
+        }
+
+        // 同じレジスタ同士の転送は不要
+        if (ins->op == OP_MOV && dst.kind == OPD_REG && src.kind == OPD_REG && dst.reg == src.reg)
+        {
+            continue;
+        }
+        emit_ins_opd(ins->op, dst, src);
+
+        if (spilled_dst)
+        {
+            emit_ins_mr(OP_MOV, REG_RBP, slot_operand(ra, ins->dst.imm).imm, SCRATCH_DST);
+        }
+    }
+}
+
+// 仮想レジスタの命令列にレジスタを割り当てて、作成中の関数へ出力する
+void regalloc_emit(const LirFunc *lir)
+{
+    RegAlloc ra = {.lir = lir};
+    ra.intervals = arena_alloc(ARENA_CODEGEN, (lir->num_vregs + 1) * sizeof(Interval));
+    ra.reg_of = arena_alloc(ARENA_CODEGEN, (lir->num_vregs + 1) * sizeof(int));
+    ra.slot_of = arena_alloc(ARENA_CODEGEN, (lir->num_vregs + 1) * sizeof(int));
+    mem_count(MEM_CODEGEN, (lir->num_vregs + 1) * (sizeof(Interval) + 2 * sizeof(int)), 3);
+
+    build_intervals(&ra);
+    build_forbidden(&ra);
+    linear_scan(&ra);
+    emit_allocated(&ra);
+}
@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "shcc.h"
+
+// 計測区間
+typedef struct
+{
+    const char *name; // 区間名
+    int depth;        // 0ならフェーズ、1ならサブフェーズ
+    // サブフェーズは呼び出し回数が多いので、CPU時間（システムコールになる）は計測しない
+    bool has_cpu;
+    double wall; // 経過時間の合計（秒）
+    double cpu;  // CPU時間の合計（秒）
+    struct timespec wall_start;
+    struct timespec cpu_start;
+} PhaseTimer;
+
+// 計測結果を出力するか
+static bool time_report_enabled = false;
+
+// 区間ごとの計測結果
+// 計測はスレッドごとに行ない、ワーカースレッドの分は終了時に全体の集計へ加える
+// 並列コード生成の分はcodegenのCPU時間（プロセス全体）に含まれる
+static _Thread_local PhaseTimer timers[NUM_PHASES] = {
+    [PHASE_TOKENIZE] = {"tokenize", 0, true},
+    [PHASE_PARSE] = {"parse", 0, true},
+    [PHASE_SCOPE_LOOKUP] = {"scope lookup", 1, false},
+    [PHASE_FOLD] = {"fold", 0, true},
+    [PHASE_CODEGEN] = {"codegen", 0, true},
+    [PHASE_EMIT] = {"emit", 0, true},
+};
+
+// 件数
+static _Thread_local long counters[NUM_COUNTERS];
+
+// 区間ごとの時間と件数の集計
+typedef struct
+{
+    double wall[NUM_PHASES]; // 経過時間の合計（秒）
+    double cpu[NUM_PHASES];  // CPU時間の合計（秒）
+    long counters[NUM_COUNTERS];
+} TimeStats;
+
+// 終了したワーカースレッドの計測結果
+// 時間も件数もスレッドをまたいで合計する（並列に実行した分、経過時間は実際の時間より長くなる）
+static TimeStats merged_time = {0};
+static pthread_mutex_t merged_time_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 計測を有効にしたスレッド（結果を出力するメインスレッド）
+static pthread_t report_thread;
+
+// メモリ使用量
+typedef struct
+{
+    size_t bytes[NUM_MEM_CATEGORIES]; // 確保したバイト数の累計
+    long objects[NUM_MEM_CATEGORIES]; // 確保したオブジェクト数の累計
+    size_t footprint;                 // アリーナが確保中のメモリ量
+    size_t peak;                      // footprintの最大値
+    size_t phase_peaks[NUM_PHASES];   // フェーズごとのfootprintの最大値
+} MemStats;
+
+// メモリ使用量の分類名
+static const char *mem_category_names[NUM_MEM_CATEGORIES] = {
+    [MEM_TOKENS] = "tokens",
+    [MEM_NODES] = "nodes",
+    [MEM_VECTORS] = "vectors",
+    [MEM_MAPS] = "maps",
+    [MEM_STRINGS] = "strings",
+    [MEM_SYMBOLS] = "symbols",
+    [MEM_CODEGEN] = "codegen",
+};
+
+// このスレッドのメモリ使用量
+static _Thread_local MemStats mem = {0};
+
+// 実行中のフェーズ（サブフェーズは含まない）
+static _Thread_local int mem_phase = -1;
+
+// 終了したワーカースレッドのメモリ使用量
+// 件数は合計し、最大値は各スレッドの最大値とする
+static MemStats merged_mem = {0};
+static pthread_mutex_t merged_mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 秒に変換
+static double to_sec(const struct timespec *ts)
+{
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+// 計測を有効にする
+// 結果はこの関数を呼んだスレッドで出力する
+void time_report_enable(void)
+{
+    time_report_enabled = true;
+    report_thread = pthread_self();
+}
+
+// CPU時間の計測に使う時計
+// メインスレッドはプロセス全体（並列コード生成のワーカーの分を含む）、
+// ワーカースレッドはスレッドごとのCPU時間を計測し、合計したときに重ならないようにする
+static clockid_t cpu_clock(void)
+{
+    return pthread_equal(pthread_self(), report_thread) ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID;
+}
+
+// 区間の計測開始
+void phase_begin(Phase_t phase)
+{
+    PhaseTimer *timer = &timers[phase];
+    if (timer->depth == 0)
+    {
+        mem_phase = phase;
+        if (mem.phase_peaks[phase] < mem.footprint)
+        {
+            mem.phase_peaks[phase] = mem.footprint;
+        }
+    }
+
+    if (!time_report_enabled)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall_start);
+    if (timer->has_cpu)
+    {
+        clock_gettime(cpu_clock(), &timer->cpu_start);
+    }
+}
+
+// 区間の計測終了
+void phase_end(Phase_t phase)
+{
+    PhaseTimer *timer = &timers[phase];
+    if (timer->depth == 0)
+    {
+        mem_phase = -1;
+    }
+
+    if (!time_report_enabled)
+    {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timer->wall += to_sec(&now) - to_sec(&timer->wall_start);
+    if (timer->has_cpu)
+    {
+        clock_gettime(cpu_clock(), &now);
+        timer->cpu += to_sec(&now) - to_sec(&timer->cpu_start);
+    }
+}
+
+// 件数の加算
+void report_count(Counter_t counter, long n)
+{
+    counters[counter] += n;
+}
+
+// このスレッドの計測結果を全体の集計に加える
+// ワーカースレッドの終了時に使う
+void time_report_merge_thread(void)
+{
+    pthread_mutex_lock(&merged_time_lock);
+
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        merged_time.wall[i] += timers[i].wall;
+        merged_time.cpu[i] += timers[i].cpu;
+        timers[i].wall = 0;
+        timers[i].cpu = 0;
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        merged_time.counters[i] += counters[i];
+        counters[i] = 0;
+    }
+
+    pthread_mutex_unlock(&merged_time_lock);
+}
+
+// 終了したワーカースレッドの分とこのスレッドの分を合わせた計測結果
+static TimeStats collect_time_stats(void)
+{
+    pthread_mutex_lock(&merged_time_lock);
+    TimeStats stats = merged_time;
+    pthread_mutex_unlock(&merged_time_lock);
+
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        stats.wall[i] += timers[i].wall;
+        stats.cpu[i] += timers[i].cpu;
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        stats.counters[i] += counters[i];
+    }
+
+    return stats;
+}
+
+// 1秒あたりの件数
+static double per_sec(long count, double sec)
+{
+    return sec > 0 ? count / sec : 0;
+}
+
+// テキスト形式で出力
+static void print_text(const TimeStats *stats, double total_wall, double total_cpu)
+{
+    fprintf(stderr, "Time report:\n");
+    fprintf(stderr, "  %-16s %12s %12s\n", "phase", "wall(ms)", "cpu(ms)");
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        const PhaseTimer *timer = &timers[i];
+        char name[32];
+        snprintf(name, sizeof(name), "%*s%s", timer->depth * 2, "", timer->name);
+        if (timer->has_cpu)
+        {
+            fprintf(stderr, "  %-16s %12.3f %12.3f\n", name, stats->wall[i] * 1e3, stats->cpu[i] * 1e3);
+        }
+        else
+        {
+            fprintf(stderr, "  %-16s %12.3f %12s\n", name, stats->wall[i] * 1e3, "-");
+        }
+    }
+    fprintf(stderr, "  %-16s %12.3f %12.3f\n", "total", total_wall * 1e3, total_cpu * 1e3);
+
+    fprintf(stderr, "Throughput:\n");
+    fprintf(stderr, "  %-16s %12ld %14.0f /s\n", "tokens", stats->counters[COUNT_TOKENS],
+            per_sec(stats->counters[COUNT_TOKENS], stats->wall[PHASE_TOKENIZE]));
+    fprintf(stderr, "  %-16s %12ld %14.0f /s\n", "nodes", stats->counters[COUNT_NODES],
+            per_sec(stats->counters[COUNT_NODES], stats->wall[PHASE_PARSE]));
+    fprintf(stderr, "  %-16s %12ld %14.0f /s\n", "output bytes", stats->counters[COUNT_OUTPUT_BYTES],
+            per_sec(stats->counters[COUNT_OUTPUT_BYTES], stats->wall[PHASE_CODEGEN] + stats->wall[PHASE_EMIT]));
+}
+
+// JSON形式で出力
+static void print_json(const TimeStats *stats, double total_wall, double total_cpu)
+{
+    fprintf(stderr, "{\"phases\":[");
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        const PhaseTimer *timer = &timers[i];
+        fprintf(stderr, "%s{\"name\":\"%s\",\"depth\":%d,\"wall_ms\":%.6f", i == 0 ? "" : ",",
+                timer->name, timer->depth, stats->wall[i] * 1e3);
+        if (timer->has_cpu)
+        {
+            fprintf(stderr, ",\"cpu_ms\":%.6f", stats->cpu[i] * 1e3);
+        }
+        fprintf(stderr, "}");
+    }
+    fprintf(stderr, "],\"total\":{\"wall_ms\":%.6f,\"cpu_ms\":%.6f},", total_wall * 1e3, total_cpu * 1e3);
+    fprintf(stderr, "\"tokens\":%ld,\"tokens_per_sec\":%.0f,", stats->counters[COUNT_TOKENS],
+            per_sec(stats->counters[COUNT_TOKENS], stats->wall[PHASE_TOKENIZE]));
+    fprintf(stderr, "\"nodes\":%ld,\"nodes_per_sec\":%.0f,", stats->counters[COUNT_NODES],
+            per_sec(stats->counters[COUNT_NODES], stats->wall[PHASE_PARSE]));
+    fprintf(stderr, "\"output_bytes\":%ld,\"output_bytes_per_sec\":%.0f}\n", stats->counters[COUNT_OUTPUT_BYTES],
+            per_sec(stats->counters[COUNT_OUTPUT_BYTES], stats->wall[PHASE_CODEGEN] + stats->wall[PHASE_EMIT]));
+}
+
+// 計測結果を標準エラー出力へ出力する
+// スループットはそれぞれ、トークンはtokenize、ノードはparse、出力はcodegenとemitの時間あたり
+// 一括コンパイルやテストのワーカースレッドの分は、スレッドごとの時間の合計になる
+void time_report_print(bool json)
+{
+    if (!time_report_enabled)
+    {
+        return;
+    }
+
+    TimeStats stats = collect_time_stats();
+    double total_wall = 0;
+    double total_cpu = 0;
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        if (timers[i].depth == 0)
+        {
+            total_wall += stats.wall[i];
+            total_cpu += stats.cpu[i];
+        }
+    }
+
+    if (json)
+    {
+        print_json(&stats, total_wall, total_cpu);
+    }
+    else
+    {
+        print_text(&stats, total_wall, total_cpu);
+    }
+}
+
+// メモリ確保の記録
+// 既存の領域の拡張ではobjectsを0にして増えた分だけ記録する
+void mem_count(MemCategory_t category, size_t bytes, int objects)
+{
+    mem.bytes[category] += bytes;
+    mem.objects[category] += objects;
+}
+
+// アリーナが確保中のメモリ量の増減
+void mem_footprint(long delta)
+{
+    mem.footprint += delta;
+
+    if (mem.peak < mem.footprint)
+    {
+        mem.peak = mem.footprint;
+    }
+    if (mem_phase >= 0 && mem.phase_peaks[mem_phase] < mem.footprint)
+    {
+        mem.phase_peaks[mem_phase] = mem.footprint;
+    }
+}
+
+// このスレッドのメモリ使用量を全体の集計に加える
+// ワーカースレッドの終了時に使う
+void mem_report_merge_thread(void)
+{
+    pthread_mutex_lock(&merged_mem_lock);
+
+    for (int i = 0; i < NUM_MEM_CATEGORIES; i++)
+    {
+        merged_mem.bytes[i] += mem.bytes[i];
+        merged_mem.objects[i] += mem.objects[i];
+    }
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        if (merged_mem.phase_peaks[i] < mem.phase_peaks[i])
+        {
+            merged_mem.phase_peaks[i] = mem.phase_peaks[i];
+        }
+    }
+    if (merged_mem.peak < mem.peak)
+    {
+        merged_mem.peak = mem.peak;
+    }
+
+    pthread_mutex_unlock(&merged_mem_lock);
+
+    mem = (MemStats){0};
+}
+
+// 終了したワーカースレッドの分とこのスレッドの分を合わせたメモリ使用量
+static MemStats collect_mem_stats(void)
+{
+    pthread_mutex_lock(&merged_mem_lock);
+    MemStats stats = merged_mem;
+    pthread_mutex_unlock(&merged_mem_lock);
+
+    for (int i = 0; i < NUM_MEM_CATEGORIES; i++)
+    {
+        stats.bytes[i] += mem.bytes[i];
+        stats.objects[i] += mem.objects[i];
+    }
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        if (stats.phase_peaks[i] < mem.phase_peaks[i])
+        {
+            stats.phase_peaks[i] = mem.phase_peaks[i];
+        }
+    }
+    if (stats.peak < mem.peak)
+    {
+        stats.peak = mem.peak;
+    }
+
+    return stats;
+}
+
+// 分類ごとの累計（categoryがNUM_MEM_CATEGORIESなら全分類の合計）
+static void sum_mem_stats(const MemStats *stats, MemCategory_t category, size_t *bytes, long *objects)
+{
+    *bytes = 0;
+    *objects = 0;
+    for (int i = 0; i < NUM_MEM_CATEGORIES; i++)
+    {
+        if (category == NUM_MEM_CATEGORIES || category == (MemCategory_t)i)
+        {
+            *bytes += stats->bytes[i];
+            *objects += stats->objects[i];
+        }
+    }
+}
+
+// メモリ使用量の累計の取得（categoryがNUM_MEM_CATEGORIESなら全分類の合計）
+// 出力するレポートの値と同じく、終了したワーカースレッドの分も含む
+void mem_report_totals(MemCategory_t category, size_t *bytes, long *objects)
+{
+    MemStats stats = collect_mem_stats();
+    sum_mem_stats(&stats, category, bytes, objects);
+}
+
+// メモリ使用量をテキスト形式で出力
+static void print_mem_text(const MemStats *stats)
+{
+    size_t total_bytes;
+    long total_objects;
+    sum_mem_stats(stats, NUM_MEM_CATEGORIES, &total_bytes, &total_objects);
+
+    fprintf(stderr, "Memory report:\n");
+    fprintf(stderr, "  %-16s %12s %12s\n", "category", "bytes", "objects");
+    for (int i = 0; i < NUM_MEM_CATEGORIES; i++)
+    {
+        fprintf(stderr, "  %-16s %12zu %12ld\n", mem_category_names[i], stats->bytes[i], stats->objects[i]);
+    }
+    fprintf(stderr, "  %-16s %12zu %12ld\n", "total", total_bytes, total_objects);
+
+    fprintf(stderr, "Peak arena footprint:\n");
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        if (timers[i].depth == 0 && stats->phase_peaks[i] > 0)
+        {
+            fprintf(stderr, "  %-16s %12zu\n", timers[i].name, stats->phase_peaks[i]);
+        }
+    }
+    fprintf(stderr, "  %-16s %12zu\n", "peak", stats->peak);
+}
+
+// メモリ使用量をJSON形式で出力
+static void print_mem_json(const MemStats *stats)
+{
+    fprintf(stderr, "{\"categories\":[");
+    for (int i = 0; i < NUM_MEM_CATEGORIES; i++)
+    {
+        fprintf(stderr, "%s{\"name\":\"%s\",\"bytes\":%zu,\"objects\":%ld}", i == 0 ? "" : ",",
+                mem_category_names[i], stats->bytes[i], stats->objects[i]);
+    }
+    fprintf(stderr, "],\"phase_peaks\":{");
+    bool first = true;
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        if (timers[i].depth == 0 && stats->phase_peaks[i] > 0)
+        {
+            fprintf(stderr, "%s\"%s\":%zu", first ? "" : ",", timers[i].name, stats->phase_peaks[i]);
+            first = false;
+        }
+    }
+    fprintf(stderr, "},\"peak\":%zu}\n", stats->peak);
+}
+
+// メモリ使用量を標準エラー出力へ出力する
+// フェーズごとの最大値は、各フェーズの実行中にアリーナが確保していた量の最大値
+// 並列コード生成のワーカーが確保した分は、メインスレッドへ引き継いだ時点で数える
+// 一括コンパイルやテストのワーカースレッドの分は、各スレッドの最大値になる
+void mem_report_print(bool json)
+{
+    MemStats stats = collect_mem_stats();
+
+    if (json)
+    {
+        print_mem_json(&stats);
+    }
+    else
+    {
+        print_mem_text(&stats);
+    }
+}
@@ -0,0 +1,579 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "shcc.h"
+
+// 条件付き定数伝播（Sparse Conditional Constant Propagation）
+//
+// SSA形式のIRで、実行されうる辺と各仮想レジスタの値（未定・定数・不定）を同時に求める
+// 値は実行時と同じく64bitで計算し（除算・剰余は符号なし、比較は符号付き）、
+// 結果が即値に収まる（32bitの）場合だけ定数に置き換える
+// 通らない辺と実行されないブロックは取り除き、最後に結果を使われない命令を取り除く
+
+// 値の状態
+typedef enum
+{
+    LAT_TOP,    // まだ値が決まっていない
+    LAT_CONST,  // 定数
+    LAT_BOTTOM, // 定数ではない
+} Lattice_t;
+
+// 仮想レジスタの値
+typedef struct
+{
+    Lattice_t state;
+    int64_t value;
+} LatticeValue;
+
+// 命令の位置
+typedef struct
+{
+    IrBlock *block;
+    IrIns *ins;
+} IrUse;
+
+// 伝播の作業状態
+typedef struct
+{
+    IrFunc *ir;
+    LatticeValue *values; // 仮想レジスタごとの値
+    IrUse **uses;         // 仮想レジスタごとの、値を使う命令
+    int *num_uses;
+    bool *executable;      // ブロックごとの、実行されうるか
+    bool *edge_executable; // ブロックごとの後続への辺（ブロック番号*2+後続の番号）が通りうるか
+    int *edge_work;        // 通りうるとわかった辺の作業リスト
+    int num_edge_work;
+    int *value_work; // 値が変わった仮想レジスタの作業リスト
+    int num_value_work;
+} Sccp;
+
+// 作業領域の確保
+static void *sccp_alloc(size_t size)
+{
+    void *p = arena_alloc(ARENA_CODEGEN, size);
+    memset(p, 0, size);
+    mem_count(MEM_CODEGEN, size, 1);
+    return p;
+}
+
+// 命令が使う仮想レジスタを順に呼び出す
+static void for_each_operand(IrIns *ins, void (*fn)(void *ctx, int *v), void *ctx)
+{
+    if (ins->a != IR_NONE)
+    {
+        fn(ctx, &ins->a);
+    }
+    if (ins->b != IR_NONE)
+    {
+        fn(ctx, &ins->b);
+    }
+    if (ins->op == IR_CALL || ins->op == IR_PHI)
+    {
+        for (int i = 0; i < ins->num_args; i++)
+        {
+            fn(ctx, &ins->args[i]);
+        }
+    }
+}
+
+// 使用数を数える
+static void count_use(void *ctx, int *v)
+{
+    ((int *)ctx)[*v]++;
+}
+
+// 使用位置を記録する（作成中の使用位置のための文脈）
+typedef struct
+{
+    Sccp *sc;
+    IrBlock *block;
+    IrIns *ins;
+} UseCollector;
+
+// 使用位置を記録する
+static void collect_use(void *ctx, int *v)
+{
+    UseCollector *uc = ctx;
+    Sccp *sc = uc->sc;
+    IrUse *uses = sc->uses[*v];
+
+    // 同じ命令が同じ値を二度使う場合は一度だけ記録する
+    int n = sc->num_uses[*v];
+    if (n > 0 && uses[n - 1].ins == uc->ins)
+    {
+        return;
+    }
+    uses[n] = (IrUse){.block = uc->block, .ins = uc->ins};
+    sc->num_uses[*v]++;
+}
+
+// 仮想レジスタごとの使用位置の作成
+static void build_uses(Sccp *sc)
+{
+    IrFunc *ir = sc->ir;
+    int *counts = sccp_alloc((ir->num_vregs + 1) * sizeof(int));
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        IrBlock *block = ir->blocks[b];
+        for (int i = 0; i < block->len; i++)
+        {
+            for_each_operand(&block->ins[i], count_use, counts);
+        }
+    }
+
+    sc->uses = sccp_alloc((ir->num_vregs + 1) * sizeof(IrUse *));
+    sc->num_uses = sccp_alloc((ir->num_vregs + 1) * sizeof(int));
+    for (int v = 0; v < ir->num_vregs; v++)
+    {
+        sc->uses[v] = sccp_alloc((counts[v] + 1) * sizeof(IrUse));
+    }
+
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        IrBlock *block = ir->blocks[b];
+        for (int i = 0; i < block->len; i++)
+        {
+            UseCollector uc = {.sc = sc, .block = block, .ins = &block->ins[i]};
+            for_each_operand(&block->ins[i], collect_use, &uc);
+        }
+    }
+}
+
+// 辺が通りうることを記録する
+static void mark_edge(Sccp *sc, const IrBlock *block, int succ)
+{
+    int edge = block->id * 2 + succ;
+    if (!sc->edge_executable[edge])
+    {
+        sc->edge_executable[edge] = true;
+        sc->edge_work[sc->num_edge_work++] = edge;
+    }
+}
+
+// 値を下げる（未定→定数→不定の順にしか変わらない）
+static void lower_value(Sccp *sc, int v, LatticeValue value)
+{
+    LatticeValue *cur = &sc->values[v];
+    if (cur->state == value.state && (value.state != LAT_CONST || cur->value == value.value))
+    {
+        return;
+    }
+    if (cur->state == LAT_CONST && value.state == LAT_CONST)
+    {
+        // 異なる定数の合流
+        value.state = LAT_BOTTOM;
+    }
+    if (cur->state > value.state)
+    {
+        return;
+    }
+
+    *cur = value;
+    sc->value_work[sc->num_value_work++] = v;
+}
+
+// 定数同士の演算
+// 計算できない（0除算）場合はfalseを返す
+static bool eval_binary(IrOp_t op, int64_t lhs, int64_t rhs, int64_t *result)
+{
+    switch (op)
+    {
+    case IR_ADD:
+        *result = (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+        return true;
+    case IR_SUB:
+        *result = (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+        return true;
+    case IR_MUL:
+        *result = (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+        return true;
+    case IR_DIV:
+    case IR_MOD:
+        // div命令と同じく符号なしで割る
+        if (rhs == 0)
+        {
+            return false;
+        }
+        *result = (int64_t)(op == IR_DIV ? (uint64_t)lhs / (uint64_t)rhs : (uint64_t)lhs % (uint64_t)rhs);
+        return true;
+    case IR_EQ:
+        *result = lhs == rhs;
+        return true;
+    case IR_NE:
+        *result = lhs != rhs;
+        return true;
+    case IR_LT:
+        *result = lhs < rhs;
+        return true;
+    case IR_LE:
+        *result = lhs <= rhs;
+        return true;
+    case IR_GT:
+        *result = lhs > rhs;
+        return true;
+    case IR_GE:
+        *result = lhs >= rhs;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// phiの評価
+// 通りうる辺から来る値だけを合流する
+static LatticeValue eval_phi(const Sccp *sc, const IrBlock *block, const IrIns *phi)
+{
+    LatticeValue result = {.state = LAT_TOP};
+    for (int i = 0; i < phi->num_args; i++)
+    {
+        const IrBlock *pred = block->preds[i];
+        bool reachable = false;
+        for (int s = 0; s < pred->num_succs; s++)
+        {
+            reachable |= pred->succs[s] == block && sc->edge_executable[pred->id * 2 + s];
+        }
+        if (!reachable)
+        {
+            continue;
+        }
+
+        LatticeValue value = sc->values[phi->args[i]];
+        if (value.state == LAT_TOP)
+        {
+            continue;
+        }
+        if (value.state == LAT_BOTTOM ||
+            (result.state == LAT_CONST && result.value != value.value))
+        {
+            return (LatticeValue){.state = LAT_BOTTOM};
+        }
+        result = value;
+    }
+    return result;
+}
+
+// 命令の評価
+static void visit(Sccp *sc, const IrBlock *block, const IrIns *ins)
+{
+    const LatticeValue bottom = {.state = LAT_BOTTOM};
+
+    switch (ins->op)
+    {
+    case IR_IMM:
+        lower_value(sc, ins->dst, (LatticeValue){.state = LAT_CONST, .value = ins->imm});
+        return;
+    case IR_COPY:
+        lower_value(sc, ins->dst, sc->values[ins->a]);
+        return;
+    case IR_PHI:
+        lower_value(sc, ins->dst, eval_phi(sc, block, ins));
+        return;
+    case IR_NEG:
+    {
+        LatticeValue a = sc->values[ins->a];
+        if (a.state == LAT_CONST)
+        {
+            a.value = (int64_t)(0 - (uint64_t)a.value);
+        }
+        lower_value(sc, ins->dst, a);
+        return;
+    }
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE:
+    {
+        LatticeValue a = sc->values[ins->a];
+        LatticeValue b = sc->values[ins->b];
+        if (a.state == LAT_TOP || b.state == LAT_TOP)
+        {
+            return;
+        }
+        int64_t value;
+        if (a.state == LAT_CONST && b.state == LAT_CONST && eval_binary(ins->op, a.value, b.value, &value))
+        {
+            lower_value(sc, ins->dst, (LatticeValue){.state = LAT_CONST, .value = value});
+        }
+        else
+        {
+            lower_value(sc, ins->dst, bottom);
+        }
+        return;
+    }
+    case IR_JMP:
+        mark_edge(sc, block, 0);
+        return;
+    case IR_BR:
+    {
+        LatticeValue condition = sc->values[ins->a];
+        if (condition.state == LAT_CONST)
+        {
+            mark_edge(sc, block, condition.value != 0 ? 0 : 1);
+        }
+        else if (condition.state == LAT_BOTTOM)
+        {
+            mark_edge(sc, block, 0);
+            mark_edge(sc, block, 1);
+        }
+        return;
+    }
+    case IR_RET:
+    case IR_STORE:
+        return;
+    default:
+        // 引数・メモリの読み出し・呼び出し・アドレスは定数として扱わない
+        lower_value(sc, ins->dst, bottom);
+        return;
+    }
+}
+
+// 辺と値の作業リストが空になるまで伝播する
+static void propagate(Sccp *sc)
+{
+    IrFunc *ir = sc->ir;
+
+    // 入口のブロック
+    sc->executable[0] = true;
+    for (int i = 0; i < ir->blocks[0]->len; i++)
+    {
+        visit(sc, ir->blocks[0], &ir->blocks[0]->ins[i]);
+    }
+
+    while (sc->num_edge_work > 0 || sc->num_value_work > 0)
+    {
+        while (sc->num_edge_work > 0)
+        {
+            int edge = sc->edge_work[--sc->num_edge_work];
+            IrBlock *block = ir->blocks[edge / 2]->succs[edge % 2];
+            if (!sc->executable[block->id])
+            {
+                // 初めて実行されるブロックはすべての命令を評価する
+                sc->executable[block->id] = true;
+                for (int i = 0; i < block->len; i++)
+                {
+                    visit(sc, block, &block->ins[i]);
+                }
+            }
+            else
+            {
+                // 新しく通る辺が増えたのでphiだけ評価し直す
+                for (int i = 0; i < block->len && block->ins[i].op == IR_PHI; i++)
+                {
+                    visit(sc, block, &block->ins[i]);
+                }
+            }
+        }
+
+        if (sc->num_value_work > 0)
+        {
+            int v = sc->value_work[--sc->num_value_work];
+            for (int i = 0; i < sc->num_uses[v]; i++)
+            {
+                const IrUse *use = &sc->uses[v][i];
+                if (sc->executable[use->block->id])
+                {
+                    visit(sc, use->block, use->ins);
+                }
+            }
+        }
+    }
+}
+
+// 伝播の結果で書き換える
+// 定数になった値は即値の命令にし、通らない辺を取り除く
+static void rewrite(Sccp *sc)
+{
+    IrFunc *ir = sc->ir;
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        IrBlock *block = ir->blocks[b];
+        if (!sc->executable[b])
+        {
+            continue;
+        }
+
+        for (int i = 0; i < block->len; i++)
+        {
+            IrIns *ins = &block->ins[i];
+            // phiはブロックの先頭に並んでいる必要があるので置き換えない
+            // （先行ブロックからの移動で定数が入る）
+            if (ins->dst == IR_NONE || ins->op == IR_IMM || ins->op == IR_PHI)
+            {
+                continue;
+            }
+            LatticeValue value = sc->values[ins->dst];
+            if (value.state == LAT_CONST && value.value >= INT32_MIN && value.value <= INT32_MAX)
+            {
+                *ins = (IrIns){.op = IR_IMM, .type = ins->type, .dst = ins->dst, .a = IR_NONE, .b = IR_NONE,
+                               .imm = (int)value.value};
+            }
+        }
+
+        // 条件分岐で片方の辺しか通らないなら無条件分岐にする
+        // 条件が最後まで決まらなかった（未定の値による）場合は、どちらへ進んでもよい
+        IrIns *last = &block->ins[block->len - 1];
+        if (last->op == IR_BR)
+        {
+            bool taken[2] = {sc->edge_executable[b * 2], sc->edge_executable[b * 2 + 1]};
+            if (!taken[0] || !taken[1])
+            {
+                int removed = taken[0] || !taken[1] ? 1 : 0;
+                *last = (IrIns){.op = IR_JMP, .dst = IR_NONE, .a = IR_NONE, .b = IR_NONE};
+                ir_remove_edge(block, removed);
+            }
+        }
+    }
+
+    ir_remove_unreachable(ir);
+
+    // 先行ブロックが一つになったphiはコピーにする
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        IrBlock *block = ir->blocks[b];
+        for (int i = 0; i < block->len && block->ins[i].op == IR_PHI; i++)
+        {
+            IrIns *phi = &block->ins[i];
+            if (phi->num_args == 1)
+            {
+                *phi = (IrIns){.op = IR_COPY, .type = phi->type, .dst = phi->dst, .a = phi->args[0], .b = IR_NONE};
+            }
+        }
+    }
+}
+
+// 命令に副作用（メモリへの書き込み・呼び出し・制御の移動）があるか
+static bool has_side_effect(const IrIns *ins)
+{
+    return ins->op == IR_STORE || ins->op == IR_CALL || ins->op == IR_JMP || ins->op == IR_BR ||
+           ins->op == IR_RET;
+}
+
+// 生きている値に印を付ける
+static void mark_live(void *ctx, int *v)
+{
+    bool *live = ctx;
+    live[*v] = true;
+}
+
+// 結果を使われない命令の削除
+// 副作用のある命令から使う値をたどり、たどれなかった命令を取り除く
+static void remove_dead(IrFunc *ir)
+{
+    bool *live = sccp_alloc((ir->num_vregs + 1) * sizeof(bool));
+    IrIns **defs = sccp_alloc((ir->num_vregs + 1) * sizeof(IrIns *));
+    IrIns **work = sccp_alloc((ir->num_vregs + 1) * sizeof(IrIns *));
+    int num_work = 0;
+
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        IrBlock *block = ir->blocks[b];
+        for (int i = 0; i < block->len; i++)
+        {
+            IrIns *ins = &block->ins[i];
+            if (ins->dst != IR_NONE)
+            {
+                defs[ins->dst] = ins;
+            }
+        }
+    }
+
+    // 副作用のある命令が使う値から、定義をたどる
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        IrBlock *block = ir->blocks[b];
+        for (int i = 0; i < block->len; i++)
+        {
+            if (has_side_effect(&block->ins[i]))
+            {
+                for_each_operand(&block->ins[i], mark_live, live);
+            }
+        }
+    }
+    for (int v = 0; v < ir->num_vregs; v++)
+    {
+        if (live[v] && defs[v] != NULL)
+        {
+            work[num_work++] = defs[v];
+        }
+    }
+    while (num_work > 0)
+    {
+        IrIns *ins = work[--num_work];
+
+        // 新しく生きているとわかった値の定義を作業リストへ
+        int operands[2] = {ins->a, ins->b};
+        for (int k = 0; k < 2; k++)
+        {
+            int v = operands[k];
+            if (v != IR_NONE && !live[v])
+            {
+                live[v] = true;
+                if (defs[v] != NULL)
+                {
+                    work[num_work++] = defs[v];
+                }
+            }
+        }
+        if (ins->op == IR_PHI || ins->op == IR_CALL)
+        {
+            for (int k = 0; k < ins->num_args; k++)
+            {
+                int v = ins->args[k];
+                if (!live[v])
+                {
+                    live[v] = true;
+                    if (defs[v] != NULL)
+                    {
+                        work[num_work++] = defs[v];
+                    }
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        IrBlock *block = ir->blocks[b];
+        int kept = 0;
+        for (int i = 0; i < block->len; i++)
+        {
+            const IrIns *ins = &block->ins[i];
+            if (!has_side_effect(ins) && ins->dst != IR_NONE && !live[ins->dst])
+            {
+                continue;
+            }
+            block->ins[kept++] = *ins;
+        }
+        block->len = kept;
+    }
+}
+
+// 条件付き定数伝播
+// SSA形式のIRに対して行ない、定数の置き換え・通らない辺と不要な命令の削除まで行なう
+void ir_sccp(IrFunc *ir)
+{
+    Sccp sc = {.ir = ir};
+    sc.values = sccp_alloc((ir->num_vregs + 1) * sizeof(LatticeValue));
+    sc.executable = sccp_alloc((ir->num_blocks + 1) * sizeof(bool));
+    sc.edge_executable = sccp_alloc((ir->num_blocks + 1) * 2 * sizeof(bool));
+    sc.edge_work = sccp_alloc((ir->num_blocks + 1) * 2 * sizeof(int));
+    build_uses(&sc);
+
+    // 値は未定→定数→不定と高々二度しか変わらないので、作業リストは仮想レジスタ数の2倍で足りる
+    sc.value_work = sccp_alloc((ir->num_vregs * 2 + 1) * sizeof(int));
+
+    propagate(&sc);
+    rewrite(&sc);
+    remove_dead(ir);
+}
@@ -1,6 +1,10 @@
 #ifndef SHCC_H_
 #define SHCC_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
 #define NUMOF(ary) (sizeof(ary) / sizeof((ary)[0]))
 
 // トークンの型を表す値
@@ -22,6 +26,7 @@ typedef enum
     TK_ADDR = '&',
     TK_DEREF = '*',
     TK_STMT = ';',
+    TK_COMMA = ',',
 
     TK_NUM = 0x100, // 整数
     TK_IDENT,       // 識別子
@@ -80,31 +85,109 @@ typedef enum
     ND_MOD_ASSIGN,  // %=
     ND_ADDR,        // &
     ND_DEREF,       // *
+    ND_NEG,         // 単項- （定数畳み込みで0-xから作る）
 
 } NodeType_t;
 
+// アリーナ（フェーズごとに一括解放するメモリ領域）の種類
+typedef enum
+{
+    ARENA_NONE = -1, // アリーナを使わない（malloc/free）
+    ARENA_TOKEN,     // トークン列
+    ARENA_NODE,      // 抽象構文木、変数・関数情報、識別子
+    ARENA_CODEGEN,   // コード生成の作業領域
+    NUM_ARENAS,
+} ArenaKind_t;
+
+// 時間計測の区間
+typedef enum
+{
+    PHASE_TOKENIZE,
+    PHASE_PARSE,
+    PHASE_SCOPE_LOOKUP, // 識別子の変数の解決（parseのサブフェーズ）
+    PHASE_FOLD, // 定数畳み込み
+    PHASE_CODEGEN,
+    PHASE_EMIT, // アセンブリ・オブジェクトファイルの書き出し、JITの配置
+    NUM_PHASES,
+} Phase_t;
+
+// 計測する件数
+typedef enum
+{
+    COUNT_TOKENS,
+    COUNT_NODES,
+    COUNT_OUTPUT_BYTES,
+    NUM_COUNTERS,
+} Counter_t;
+
+// メモリ使用量の分類
+typedef enum
+{
+    MEM_TOKENS,  // トークン列
+    MEM_NODES,   // 抽象構文木のノードプール
+    MEM_VECTORS, // Vector
+    MEM_MAPS,    // Map
+    MEM_STRINGS, // 識別子名などの文字列
+    MEM_SYMBOLS, // インターンした識別子（Symbol）
+    MEM_CODEGEN, // 命令列、出力バッファ
+    NUM_MEM_CATEGORIES,
+} MemCategory_t;
+
+// スレッド間で受け渡すアリーナのブロック列
+typedef struct ArenaBlock *ArenaBlocks;
+
 // ノード用ベクター
 typedef struct Vector
 {
     void **data;
     int capacity;
     int len;
+    ArenaKind_t arena; // 確保先のアリーナ
 } Vector;
 
+// 可変長のバイト列
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+    ArenaKind_t arena; // 確保先のアリーナ
+} Buffer;
+
 // 連想配列用マップ
+// オープンアドレス法のハッシュテーブル
 typedef struct
 {
-    Vector *keys;
-    Vector *vals;
+    const char **keys; // NULLなら空きスロット
+    void **vals;
+    int capacity;      // スロット数（2のべき乗）
+    int len;           // 登録済みのキー数
+    ArenaKind_t arena; // 確保先のアリーナ
 } Map;
 
-// トークンの型
+// インターン済みの識別子
+// 同じ綴りの識別子は一つのSymbolを共有する
+typedef struct Symbol
+{
+    const char *name; // 識別子名
+    int len;          // 識別子名の長さ
+    int id;           // 識別子の通し番号
+    Vector *bindings; // 有効な変数の番号（Ast.variables上の位置を(void *)(intptr_t)で格納）のスタック、末尾が最も内側のスコープ
+} Symbol;
+
+// トークン列
+// トークンごとの構造体ではなく、要素ごとの配列で持つ
+// トークン文字列はコピーせず、ソースコード上の位置と長さで表す
 typedef struct
 {
-    TokenType_t ty; // トークンの型
-    int value;      // TK_NUMなら数値
-    char *input;    // トークン文字列
-} Token;
+    const char *source; // ソースコード
+    uint16_t *types;    // トークンの型(TokenType_t)
+    int *offsets;       // トークン文字列のソースコード先頭からの位置
+    int *lengths;       // トークン文字列の長さ
+    int *values;        // TK_NUMなら数値、TK_IDENTなら識別子の通し番号
+    int len;
+    int capacity;
+} TokenList;
 
 // 変数の型
 typedef enum
@@ -120,52 +203,497 @@ typedef struct VariableInfo
     const char *name;    // 変数名
     int offset;          // RBPからのオフセット
     bool is_global;      // グローバル変数か
+    int scope_depth;     // 宣言されたスコープの深さ
 } VariableInfo;
 
+// ノード番号
+// 抽象構文木のノードはすべてAst.nodesに並べ、ポインタではなく番号で参照する
+typedef uint32_t NodeId;
+
+// 空のノード番号（Ast.nodes[0]は使わない）
+#define NODE_NONE 0
+
 // 関数
 typedef struct FuncInfo
 {
-    const char *name;  // 関数名
-    struct Node *body; // ND_FUNCDEFの定義となるブロック
-    Vector *args;      // 引数
-    int stack_size;    // この関数が最大で使用するスタックサイズ
+    const char *name; // 関数名
+    NodeId body;      // ND_FUNCDEFの定義となるブロック
+    uint32_t args;    // 引数のAst.lists上の位置（呼び出しなら式のノード、定義なら仮引数の変数番号）
+    int num_args;     // 引数の数
+    int stack_size;   // この関数が最大で使用するスタックサイズ
+    uint64_t hash;    // 定義のトークン列と見えるグローバル変数のハッシュ（キャッシュ有効時のみ）
 } FuncInfo;
 
 // 抽象構文木ノード
+// ノードの種類ごとに使うフィールドが異なるので共用体で持つ
 typedef struct Node
 {
-    NodeType_t ty;
-    struct Node *lhs;         // 二項演算子の左辺、または単項演算子の被演算子
-    struct Node *rhs;         // 二項演算子の右辺
-    int value;                // ND_NUMの場合の数値
-    Vector *block_stmts;      // ND_BLOCKを構成する式群
-    struct Node *condition;   // if / for / while の条件式
-    struct Node *then;        // if / for / while で条件を満たすときに実行される文
-    struct Node *elsethen;    // if-else で条件を満たさないときに実行される文
-    struct Node *initializer; // for の初期化処理
-    struct Node *loopexpr;    // for のループ終了時の処理
-    FuncInfo *func;           // 関数情報
-    VariableInfo *variable;   // 型情報
+    uint16_t ty; // NodeType_t
+    union
+    {
+        // 二項演算子 / 単項演算子(lhsのみ) / return(lhsのみ)
+        struct
+        {
+            NodeId lhs; // 二項演算子の左辺、または単項演算子の被演算子
+            NodeId rhs; // 二項演算子の右辺
+        };
+        // ND_NUM
+        int value; // 数値
+        // ND_VARIABLE / ND_VARDEF
+        uint32_t variable; // 変数番号
+        // ND_CALL / ND_FUNCDEF
+        uint32_t func; // 関数番号
+        // ND_BLOCK
+        struct
+        {
+            uint32_t stmts; // ブロックを構成する文のAst.lists上の位置
+            int num_stmts;  // 文の数
+        };
+        // ND_IF / ND_FOR / ND_WHILE
+        struct
+        {
+            NodeId condition; // 条件式
+            NodeId then;      // 条件を満たすときに実行される文
+            union
+            {
+                NodeId elsethen;   // if-else で条件を満たさないときに実行される文
+                uint32_t for_exprs; // for の [初期化処理, ループ終了時の処理] のAst.lists上の位置
+            };
+        };
+    };
 } Node;
 
+_Static_assert(sizeof(Node) == 16, "Nodeは16バイトに収めること");
+
+// 抽象構文木
+// ノード・変数・関数をそれぞれ連続した配列に持ち、番号で参照する
+typedef struct
+{
+    Node *nodes; // ノード
+    int num_nodes;
+    int node_capacity;
+
+    NodeId *lists; // ブロックの文や関数の引数などの可変長のノード列
+    int num_lists;
+    int list_capacity;
+
+    VariableInfo *variables; // 変数
+    int num_variables;
+    int variable_capacity;
+
+    FuncInfo *funcs; // 関数
+    int num_funcs;
+    int func_capacity;
+
+    uint32_t decls; // トップレベルの定義のAst.lists上の位置
+    int num_decls;  // トップレベルの定義の数
+} Ast;
+
+// ノードの取得
+static inline Node *ast_node(const Ast *ast, NodeId id)
+{
+    return &ast->nodes[id];
+}
+
+// ノード列の取得
+static inline NodeId *ast_list(const Ast *ast, uint32_t pos)
+{
+    return &ast->lists[pos];
+}
+
+// 変数情報の取得
+static inline VariableInfo *ast_variable(const Ast *ast, uint32_t id)
+{
+    return &ast->variables[id];
+}
+
+// 関数情報の取得
+static inline FuncInfo *ast_func(const Ast *ast, uint32_t id)
+{
+    return &ast->funcs[id];
+}
+
+// レジスタ
+// 並びはx86-64の命令エンコードでのレジスタ番号順
+typedef enum
+{
+    REG_RAX,
+    REG_RCX,
+    REG_RDX,
+    REG_RBX,
+    REG_RSP,
+    REG_RBP,
+    REG_RSI,
+    REG_RDI,
+    REG_R8,
+    REG_R9,
+    REG_R10,
+    REG_R11,
+    REG_R12,
+    REG_R13,
+    REG_R14,
+    REG_R15,
+    REG_AL, // setcc用の8bitレジスタ
+    NUM_REGS,
+} Register_t;
+
+// レジスタの集合
+#define REG_BIT(reg) (1u << (reg))
+
+// 関数呼び出しで壊れるレジスタ
+#define CALLER_SAVED (REG_BIT(REG_RAX) | REG_BIT(REG_RCX) | REG_BIT(REG_RDX) | REG_BIT(REG_RSI) | REG_BIT(REG_RDI) | \
+                      REG_BIT(REG_R8) | REG_BIT(REG_R9) | REG_BIT(REG_R10) | REG_BIT(REG_R11))
+
+// 引数に使うレジスタの集合
+#define ARG_REGS (REG_BIT(REG_RDI) | REG_BIT(REG_RSI) | REG_BIT(REG_RDX) | REG_BIT(REG_RCX) | REG_BIT(REG_R8) | REG_BIT(REG_R9))
+
+// 8bitレジスタを含む64bitレジスタ
+static inline int full_reg(int reg)
+{
+    return reg == REG_AL ? REG_RAX : reg;
+}
+
+// 命令
+typedef enum
+{
+    OP_PUSH,
+    OP_POP,
+    OP_MOV,
+    OP_MOVZB,
+    OP_LEA,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_NEG,
+    OP_CMP,
+    OP_SETE,
+    OP_SETNE,
+    OP_SETL,
+    OP_SETLE,
+    OP_SETG,
+    OP_SETGE,
+    OP_JMP,
+    OP_JE,
+    OP_JNE,
+    OP_JL,
+    OP_JLE,
+    OP_JG,
+    OP_JGE,
+    OP_CALL,
+    OP_LEAVE,
+    OP_RET,
+    OP_NOP,
+    OP_LABEL,   // ローカルラベル定義（疑似命令）
+    OP_COMMENT, // コメント（疑似命令）
+    NUM_OPS,
+} Opcode_t;
+
+// オペランドの種類
+typedef enum
+{
+    OPD_NONE,
+    OPD_REG,   // レジスタ
+    OPD_IMM,   // 即値
+    OPD_MEM,   // [ベースレジスタ+変位]
+    OPD_SYM,   // シンボル（呼び出し先、またはRIP相対のアドレス）
+    OPD_LABEL, // ローカルラベル
+    OPD_VREG,  // 仮想レジスタ（レジスタ割り当て前のみ、番号はimm）
+    OPD_VMEM,  // [仮想レジスタ]（レジスタ割り当て前のみ、番号はimm）
+} OperandKind_t;
+
+// オペランド
+typedef struct
+{
+    uint8_t kind;    // OperandKind_t
+    uint8_t reg;     // OPD_REG / OPD_MEMのレジスタ(Register_t)
+    int32_t imm;     // OPD_IMMの値、OPD_MEMの変位、OPD_LABELのラベル番号
+    const char *sym; // OPD_SYMのシンボル名、OPD_LABELのラベル名の接頭辞、OP_COMMENTの文字列（変数の配置なら変数名）
+} Operand;
+
+// 命令
+typedef struct
+{
+    uint16_t op; // Opcode_t
+    Operand dst;
+    Operand src;
+} Ins;
+
+// 関数一つ分の命令列
+typedef struct
+{
+    const char *name; // 関数名
+    Ins *ins;         // 命令列
+    int len;
+    int capacity;
+} AsmFunc;
+
+// IR（三番地コード）の命令
+typedef enum
+{
+    IR_IMM,    // dst = imm
+    IR_COPY,   // dst = a
+    IR_PHI,    // dst = 通ってきた先行ブロックに対応するargs（immは元の変数の仮想レジスタ）
+    IR_PARAM,  // dst = imm番目の引数
+    IR_ADD,    // dst = a + b
+    IR_SUB,    // dst = a - b
+    IR_MUL,    // dst = a * b
+    IR_DIV,    // dst = a / b（符号なし）
+    IR_MOD,    // dst = a % b（符号なし）
+    IR_NEG,    // dst = -a
+    IR_EQ,     // dst = a == b
+    IR_NE,     // dst = a != b
+    IR_LT,     // dst = a < b
+    IR_LE,     // dst = a <= b
+    IR_GT,     // dst = a > b
+    IR_GE,     // dst = a >= b
+    IR_LOCAL,  // dst = スタック上のローカル変数のアドレス（immはRBPからのオフセット）
+    IR_GLOBAL, // dst = グローバル変数symのアドレス
+    IR_LOAD,   // dst = [a]
+    IR_STORE,  // [a] = b
+    IR_CALL,   // dst = sym(args...)
+    IR_JMP,    // succs[0]へ
+    IR_BR,     // aが0以外ならsuccs[0]へ、0ならsuccs[1]へ
+    IR_RET,    // aを返す（aがなければ戻り値は不定）
+    NUM_IR_OPS,
+} IrOp_t;
+
+// IRの値の型
+typedef enum
+{
+    IRT_VOID, // 値を持たない
+    IRT_I64,  // 64bit整数
+    IRT_BOOL, // 比較結果（0か1）
+    IRT_PTR,  // アドレス
+} IrType_t;
+
+// IRの仮想レジスタがないことを表す値
+#define IR_NONE (-1)
+
+// IRの命令一つ
+typedef struct
+{
+    uint8_t op;      // IrOp_t
+    uint8_t type;    // 結果の型（IrType_t）
+    int dst;         // 結果の仮想レジスタ
+    int a;           // 1番目のオペランドの仮想レジスタ
+    int b;           // 2番目のオペランドの仮想レジスタ
+    int imm;         // IR_IMMの値、IR_PARAMの引数番号、IR_LOCALのオフセット
+    const char *sym; // IR_GLOBALの変数名、IR_CALLの関数名
+    int *args;       // IR_CALLの引数、IR_PHIの先行ブロックごとの値の仮想レジスタ
+    int num_args;
+} IrIns;
+
+// 基本ブロック
+// 最後の命令は必ずIR_JMP/IR_BR/IR_RETのいずれか
+typedef struct IrBlock
+{
+    int id; // 出力順の番号
+    IrIns *ins;
+    int len;
+    int capacity;
+    struct IrBlock *succs[2]; // 後続ブロック（IR_JMPは1つ、IR_BRは2つ）
+    int num_succs;
+    struct IrBlock **preds; // 先行ブロック
+    int num_preds;
+    int pred_capacity;
+} IrBlock;
+
+// 関数一つ分のIR
+// ブロック0が入口で、ブロックの並びがそのまま出力順になる
+typedef struct
+{
+    const char *name;
+    IrBlock **blocks;
+    int num_blocks;
+    int block_capacity;
+    int num_vregs;  // 仮想レジスタの数
+    int num_vars;   // 変数を置いた仮想レジスタの数（0から順に振る、SSA形式なら0）
+    int num_args;   // 引数の数
+    int stack_size; // スタックに置くローカル変数が使う大きさ
+} IrFunc;
+
+// 仮想レジスタを使う命令列（レジスタ割り当て前の関数）
+// OP_RETは関数エピローグを含む復帰を表す
+typedef struct
+{
+    Ins *ins;
+    int len;
+    int capacity;
+    int num_vregs;  // 仮想レジスタの数
+    int num_args;   // 引数の数（関数の先頭で引数レジスタが値を持つ）
+    int stack_size; // スタックに置くローカル変数が使う大きさ
+} LirFunc;
+
+// 出力するプログラム全体
+typedef struct
+{
+    Vector *funcs;   // 関数(AsmFunc)
+    Vector *globals; // グローバル変数名(const char *)
+} AsmProgram;
+
+// 関数単位のコンパイル結果のキャッシュ
+typedef struct FuncCache FuncCache;
+
+// 再配置の種類
+typedef enum
+{
+    RELOC_PC32 = 2,  // R_X86_64_PC32
+    RELOC_PLT32 = 4, // R_X86_64_PLT32
+} RelocType_t;
+
+// 再配置情報
+typedef struct
+{
+    uint32_t offset;  // .text先頭からの位置
+    const char *sym;  // 参照するシンボル
+    RelocType_t type; // 再配置の種類
+    int32_t addend;   // 加数
+} Reloc;
+
+void *arena_alloc(ArenaKind_t kind, size_t size);
+void *arena_realloc(ArenaKind_t kind, void *ptr, size_t old_size, size_t new_size);
+char *arena_strndup(ArenaKind_t kind, const char *str, int len);
+void arena_reset(ArenaKind_t kind);
+void arena_reset_all(void);
+void arena_release_all(void);
+ArenaBlocks arena_detach(ArenaKind_t kind);
+void arena_attach(ArenaKind_t kind, ArenaBlocks blocks);
+size_t arena_used(ArenaKind_t kind);
+
 Vector *new_vector(void);
+Vector *new_vector_in(ArenaKind_t arena);
 void vec_push(Vector *vec, void *elem);
 
+Buffer *new_buffer_in(ArenaKind_t arena);
+void buf_push(Buffer *buf, const void *data, size_t len);
+void buf_push_byte(Buffer *buf, uint8_t value);
+void buf_push_u16(Buffer *buf, uint16_t value);
+void buf_push_u32(Buffer *buf, uint32_t value);
+void buf_push_u64(Buffer *buf, uint64_t value);
+void buf_align(Buffer *buf, size_t align, uint8_t fill);
+
 Map *new_map(void);
+Map *new_map_in(ArenaKind_t arena);
 void map_put(Map *map, const char *key, void *val);
 void map_puti(Map *map, const char *key, int val);
 void *map_get(const Map *map, const char *key);
+void *map_getn(const Map *map, const char *key, int len);
 int map_geti(const Map *map, const char *key);
 
-Vector *tokenize(char *p);
+Symbol *intern(const char *str, int len);
+Symbol *symbol_at(int id);
+int symbol_count(void);
+void intern_reset(void);
+
+TokenList *tokenize(const char *source);
+
+Ast *program(TokenList *token_list);
+
+// パース結果のスナップショット
+void snapshot_write(const char *path, const TokenList *tokens, const Ast *ast);
+Ast *snapshot_load(const char *path, TokenList **tokens);
+
+void fold_constants(Ast *ast);
+
+void gen_asm(const Ast *ast, int jobs, int opt_level);
+
+// IR
+IrFunc *ir_build(const Ast *ast, const FuncInfo *func);
+void ir_remove_edge(IrBlock *from, int succ);
+void ir_remove_unreachable(IrFunc *ir);
+void ir_to_ssa(IrFunc *ir);
+void ir_sccp(IrFunc *ir);
+void ir_optimize(IrFunc *ir);
+
+// レジスタ割り当て
+LirFunc *lower_func(const IrFunc *ir);
+void regalloc_emit(const LirFunc *lir);
+
+// 命令列の作成
+AsmFunc *emit_new_function(const char *name);
+void emit_select_function(AsmFunc *func);
+void emit_function(const char *name);
+void emit_global_variable(const char *name);
+void emit_comment(const char *comment);
+void emit_comment_var(const char *name, int disp);
+void emit_ins(Opcode_t op);
+void emit_ins_r(Opcode_t op, Register_t reg);
+void emit_ins_i(Opcode_t op, int imm);
+void emit_ins_rr(Opcode_t op, Register_t dst, Register_t src);
+void emit_ins_ri(Opcode_t op, Register_t dst, int imm);
+void emit_ins_rm(Opcode_t op, Register_t dst, Register_t base, int disp);
+void emit_ins_mr(Opcode_t op, Register_t base, int disp, Register_t src);
+void emit_ins_rsym(Opcode_t op, Register_t dst, const char *sym);
+void emit_ins_sym(Opcode_t op, const char *sym);
+void emit_ins_label(Opcode_t op, const char *prefix, int no);
+void emit_ins_opd(Opcode_t op, Operand dst, Operand src);
+void emit_label(const char *prefix, int no);
+void emit_use_instructions(Ins *ins, int len);
+char *label_key(const Operand *label);
+const AsmProgram *emit_program(void);
+void emit_write(const char *path);
+void emit_write_object(const char *path);
+void emit_write_bytes(const char *path, void *data, size_t len);
+const Buffer *emit_output(void);
+void emit_reset(void);
+
+// 覗き穴最適化
+void peephole_optimize(AsmFunc *func);
+void peephole_stats_print(void);
+
+// キャッシュ
+#define HASH_INIT 14695981039346656037ull
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len);
+void cache_init(const char *dir);
+bool cache_enabled(void);
+void cache_set_unit(const char *unit);
+FuncCache *cache_open_funcs(void);
+bool cache_load_func(const FuncCache *cache, uint64_t key, const char *name);
+void cache_add_func(FuncCache *cache, uint64_t key, const AsmFunc *func, bool hit);
+void cache_close_funcs(FuncCache *cache);
+uint64_t cache_func_key(uint64_t func_hash, int opt_level);
+uint64_t cache_unit_key(const char *source, const char *options);
+bool cache_load_unit(uint64_t key, const char *ext, const char *path);
+void cache_store_unit(uint64_t key, const char *ext);
+void cache_stats_print(void);
+
+// 機械語出力
+void encode_func(const AsmFunc *func, Buffer *code, Vector *relocs);
+void write_object(const AsmProgram *prog, Buffer *out);
+
+// 一括コンパイル
+char *read_file(const char *path);
+void batch_read_manifest(Vector *inputs, const char *path);
+int compile_batch(const Vector *inputs, int jobs, bool needs_object, int opt_level);
+_Noreturn void compile_error(const char *fmt, ...);
+
+// ケース表のテスト
+int run_test_cases(const char *path, int jobs);
+
+// 時間計測
+void time_report_enable(void);
+void phase_begin(Phase_t phase);
+void phase_end(Phase_t phase);
+void report_count(Counter_t counter, long n);
+void time_report_merge_thread(void);
+void time_report_print(bool json);
 
-Vector *program(Vector *token_list);
+// メモリ使用量
+void mem_count(MemCategory_t category, size_t bytes, int objects);
+void mem_footprint(long delta);
+void mem_report_merge_thread(void);
+void mem_report_totals(MemCategory_t category, size_t *bytes, long *objects);
+void mem_report_print(bool json);
 
-void gen_asm(Vector *code);
+// JIT実行
+void jit_load_library(const char *path);
+int jit_run(const AsmProgram *prog);
 
 // ダンプ関係
 void initialize_dump_env(void);
-void dump_token_list(Vector *token_list);
-void dump_node_list(Vector *code);
+void dump_token_list(TokenList *token_list);
+void dump_node_list(const Ast *ast);
+void dump_ir(const Ast *ast, int opt_level);
 
 #endif // ifndef SHCC_H_
\ No newline at end of file
@@ -0,0 +1,597 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shcc.h"
+
+// スナップショットの先頭に置く識別子
+#define SNAPSHOT_MAGIC "SHCS"
+
+// スナップショットの形式の版
+// Ast・TokenListの形を変えたら上げること
+#define SNAPSHOT_VERSION 2
+
+// パース結果（トークン列と抽象構文木）のスナップショット
+//
+// 各領域は8バイト境界に置き、メモリ上の配列の形のまま並べる
+// 読み込み時はファイルをmmapし、ノードやノード列はコピーせずにそのまま使う
+// 文字列へのポインタ（変数名・関数名）だけは文字列表上の位置+1として保存し、読み込み時にポインタへ直す
+// （MAP_PRIVATEなので書き換えるのは変数・関数の領域のページだけで、ファイルは変わらない）
+// 読み込み時は各領域がファイルに収まっていることに加え、トークンの位置と、
+// 宣言からたどれるノードが参照する番号（子ノード・ノード列・変数・関数）も検査する
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t node_size;     // sizeof(Node)
+    uint32_t variable_size; // sizeof(VariableInfo)
+    uint32_t func_size;     // sizeof(FuncInfo)
+
+    uint32_t source_len; // ソースコードの長さ（NUL終端を除く）
+    uint32_t num_tokens;
+    uint32_t strtab_len; // 文字列表の長さ
+    uint32_t num_nodes;
+    uint32_t num_lists;
+    uint32_t num_variables;
+    uint32_t num_funcs;
+    uint32_t decls;
+    uint32_t num_decls;
+
+    // 各領域のファイル先頭からの位置
+    uint64_t source;
+    uint64_t types;
+    uint64_t offsets;
+    uint64_t lengths;
+    uint64_t values;
+    uint64_t strtab;
+    uint64_t nodes;
+    uint64_t lists;
+    uint64_t variables;
+    uint64_t funcs;
+} SnapshotHeader;
+
+// スナップショットのエラー
+static void error(const char *path, const char *msg)
+{
+    fprintf(stderr, "%s: %s\n", path, msg);
+
+    exit(1);
+}
+
+// 領域を8バイト境界に置いて追加し、位置を返す
+static uint64_t push_section(Buffer *buf, const void *data, size_t len)
+{
+    buf_align(buf, 8, 0);
+    uint64_t pos = buf->len;
+    buf_push(buf, data, len);
+
+    return pos;
+}
+
+// 文字列を文字列表へ登録し、位置+1を返す（NULLなら0）
+static uint32_t strtab_add(Map *map, Buffer *strtab, const char *str)
+{
+    if (str == NULL)
+    {
+        return 0;
+    }
+
+    int pos = map_geti(map, str);
+    if (pos == 0)
+    {
+        pos = strtab->len + 1;
+        buf_push(strtab, str, strlen(str) + 1);
+        map_puti(map, str, pos);
+    }
+
+    return pos;
+}
+
+// パース結果をスナップショットとして書き出す
+// トークン列のアリーナを捨てる前に呼ぶこと
+void snapshot_write(const char *path, const TokenList *tokens, const Ast *ast)
+{
+    SnapshotHeader header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .node_size = sizeof(Node),
+        .variable_size = sizeof(VariableInfo),
+        .func_size = sizeof(FuncInfo),
+        .source_len = strlen(tokens->source),
+        .num_tokens = tokens->len,
+        .num_nodes = ast->num_nodes,
+        .num_lists = ast->num_lists,
+        .num_variables = ast->num_variables,
+        .num_funcs = ast->num_funcs,
+        .decls = ast->decls,
+        .num_decls = ast->num_decls,
+    };
+
+    // 変数名・関数名の文字列表
+    Map *map = new_map_in(ARENA_NODE);
+    Buffer *strtab = new_buffer_in(ARENA_NODE);
+
+    // 名前を文字列表上の位置に置き換えた変数・関数
+    // 構造体の詰め物に不定な値が残らないよう、ゼロで埋めてから項目を設定する
+    VariableInfo *variables = arena_alloc(ARENA_NODE, (ast->num_variables + 1) * sizeof(VariableInfo));
+    memset(variables, 0, (ast->num_variables + 1) * sizeof(VariableInfo));
+    for (int i = 0; i < ast->num_variables; i++)
+    {
+        const VariableInfo *v = ast_variable(ast, i);
+        variables[i].type = v->type;
+        variables[i].name = (const char *)(uintptr_t)strtab_add(map, strtab, v->name);
+        variables[i].offset = v->offset;
+        variables[i].is_global = v->is_global;
+        variables[i].scope_depth = v->scope_depth;
+    }
+    FuncInfo *funcs = arena_alloc(ARENA_NODE, (ast->num_funcs + 1) * sizeof(FuncInfo));
+    memset(funcs, 0, (ast->num_funcs + 1) * sizeof(FuncInfo));
+    for (int i = 0; i < ast->num_funcs; i++)
+    {
+        const FuncInfo *f = ast_func(ast, i);
+        funcs[i].name = (const char *)(uintptr_t)strtab_add(map, strtab, f->name);
+        funcs[i].body = f->body;
+        funcs[i].args = f->args;
+        funcs[i].num_args = f->num_args;
+        funcs[i].stack_size = f->stack_size;
+        funcs[i].hash = f->hash;
+    }
+    header.strtab_len = strtab->len;
+
+    Buffer *buf = new_buffer_in(ARENA_NODE);
+    buf_push(buf, &header, sizeof(header));
+    header.source = push_section(buf, tokens->source, header.source_len + 1);
+    header.types = push_section(buf, tokens->types, tokens->len * sizeof(*tokens->types));
+    header.offsets = push_section(buf, tokens->offsets, tokens->len * sizeof(*tokens->offsets));
+    header.lengths = push_section(buf, tokens->lengths, tokens->len * sizeof(*tokens->lengths));
+    header.values = push_section(buf, tokens->values, tokens->len * sizeof(*tokens->values));
+    header.strtab = push_section(buf, strtab->data, strtab->len);
+    header.nodes = push_section(buf, ast->nodes, ast->num_nodes * sizeof(Node));
+    header.lists = push_section(buf, ast->lists, ast->num_lists * sizeof(NodeId));
+    header.variables = push_section(buf, variables, ast->num_variables * sizeof(VariableInfo));
+    header.funcs = push_section(buf, funcs, ast->num_funcs * sizeof(FuncInfo));
+    memcpy(buf->data, &header, sizeof(header));
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL || fwrite(buf->data, 1, buf->len, fp) != buf->len || fclose(fp) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+// 領域がファイルに収まっているか
+static bool in_file(size_t file_size, uint64_t pos, uint64_t count, size_t elem_size)
+{
+    return pos % 8 == 0 && pos <= file_size && count <= (file_size - pos) / elem_size;
+}
+
+// 文字列表上の位置+1をポインタへ直す
+static const char *resolve_name(const char *path, const char *strtab, uint32_t strtab_len, const char *name)
+{
+    uintptr_t pos = (uintptr_t)name;
+    if (pos == 0 || pos - 1 >= strtab_len)
+    {
+        error(path, "スナップショットの名前が不正です");
+    }
+
+    return strtab + pos - 1;
+}
+
+// 読み込んだ抽象構文木の検査状態
+typedef struct
+{
+    const char *path;
+    const Ast *ast;
+    uint8_t *state; // ノードごとのNODE_UNSEEN / NODE_VISITING / NODE_CHECKED
+    int *owner;     // ノードごとの、検査した関数の番号+1（関数の外では0）
+    int func;       // 検査中の関数の番号+1（関数の外では0）
+    int stack_size; // 検査中の関数のスタックサイズ（関数の外では0）
+} Checker;
+
+// ノードの検査状態
+enum
+{
+    NODE_UNSEEN,
+    NODE_VISITING, // 子孫を検査中（ここへ戻ってきたら循環している）
+    NODE_CHECKED,
+};
+
+// 壊れているスナップショットのエラー
+static void corrupt(const Checker *c)
+{
+    error(c->path, "スナップショットが壊れています");
+}
+
+// ノード列の範囲の検査
+static void check_list(const Checker *c, uint32_t pos, int len)
+{
+    if (len < 0 || (uint64_t)pos + len > (uint64_t)c->ast->num_lists)
+    {
+        corrupt(c);
+    }
+}
+
+// 変数番号の検査
+// ローカル変数の位置は検査中の関数のスタックに収まっていること
+static void check_variable(const Checker *c, uint32_t id)
+{
+    if (id >= (uint32_t)c->ast->num_variables)
+    {
+        corrupt(c);
+    }
+
+    const VariableInfo *v = ast_variable(c->ast, id);
+    if (!v->is_global && (v->offset < 0 || v->offset % 8 != 0 || v->offset >= c->stack_size))
+    {
+        corrupt(c);
+    }
+}
+
+// 関数番号の検査
+static const FuncInfo *check_func(const Checker *c, uint32_t id)
+{
+    if (id >= (uint32_t)c->ast->num_funcs)
+    {
+        corrupt(c);
+    }
+
+    const FuncInfo *f = ast_func(c->ast, id);
+    if (f->num_args < 0 || f->num_args > 6 || f->stack_size < 0 || f->stack_size % 8 != 0)
+    {
+        corrupt(c);
+    }
+    check_list(c, f->args, f->num_args);
+
+    return f;
+}
+
+static void check_node(Checker *c, NodeId id);
+
+// 式になるノードの種類か
+static bool is_expr(int ty)
+{
+    switch (ty)
+    {
+    case ND_NUM:
+    case ND_VARIABLE:
+    case ND_CALL:
+    case ND_ASSIGN:
+    case ND_ADDR:
+    case ND_DEREF:
+    case ND_NEG:
+    case ND_PLUS:
+    case ND_MINUS:
+    case ND_MUL:
+    case ND_DIV:
+    case ND_MOD:
+    case ND_LESS:
+    case ND_GREATER:
+    case ND_EQ:
+    case ND_NEQ:
+    case ND_LESS_EQ:
+    case ND_GREATER_EQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 文になるノードの種類か（式文を含む）
+static bool is_stmt(int ty)
+{
+    switch (ty)
+    {
+    case ND_VARDEF:
+    case ND_BLOCK:
+    case ND_RETURN:
+    case ND_IF:
+    case ND_FOR:
+    case ND_WHILE:
+    case ND_STMT:
+        return true;
+    default:
+        return is_expr(ty);
+    }
+}
+
+// 式の子ノードの検査
+// optionalなら省略（NODE_NONE）してよい
+static void check_expr(Checker *c, NodeId id, bool optional)
+{
+    if (id == NODE_NONE && optional)
+    {
+        return;
+    }
+    if (id == NODE_NONE || id >= (uint32_t)c->ast->num_nodes || !is_expr(ast_node(c->ast, id)->ty))
+    {
+        corrupt(c);
+    }
+    check_node(c, id);
+}
+
+// 文の子ノードの検査
+static void check_stmt(Checker *c, NodeId id, bool optional)
+{
+    if (id == NODE_NONE && optional)
+    {
+        return;
+    }
+    if (id == NODE_NONE || id >= (uint32_t)c->ast->num_nodes || !is_stmt(ast_node(c->ast, id)->ty))
+    {
+        corrupt(c);
+    }
+    check_node(c, id);
+}
+
+// 変数を指す子ノード（代入の左辺・アドレス演算子の被演算子）の検査
+// コード生成はこれらを変数としてしか扱えないので、変数以外なら壊れているものとみなす
+static void check_variable_ref(Checker *c, NodeId id)
+{
+    check_expr(c, id, false);
+    if (ast_node(c->ast, id)->ty != ND_VARIABLE)
+    {
+        corrupt(c);
+    }
+}
+
+// ノードと、その子孫の検査
+// 同じノードを複数の親から指すことはあるが（複合代入の左辺）、循環していないこと
+// 変数の位置は関数ごとに検査するので、別の関数のノードを指していないこと
+static void check_node(Checker *c, NodeId id)
+{
+    const Ast *ast = c->ast;
+    if (c->state[id] == NODE_VISITING || (c->state[id] == NODE_CHECKED && c->owner[id] != c->func))
+    {
+        corrupt(c);
+    }
+    if (c->state[id] == NODE_CHECKED)
+    {
+        return;
+    }
+    c->state[id] = NODE_VISITING;
+    c->owner[id] = c->func;
+
+    const Node *node = ast_node(ast, id);
+    switch (node->ty)
+    {
+    case ND_NUM:
+    case ND_STMT:
+        break;
+    case ND_VARIABLE:
+    case ND_VARDEF:
+        check_variable(c, node->variable);
+        break;
+    case ND_CALL:
+    {
+        const FuncInfo *f = check_func(c, node->func);
+        for (int i = 0; i < f->num_args; i++)
+        {
+            check_expr(c, ast_list(ast, f->args)[i], false);
+        }
+        break;
+    }
+    case ND_FUNCDEF:
+    {
+        const FuncInfo *f = check_func(c, node->func);
+        if (f->body == NODE_NONE || f->body >= (uint32_t)ast->num_nodes || ast_node(ast, f->body)->ty != ND_BLOCK)
+        {
+            corrupt(c);
+        }
+        int outer_func = c->func;
+        int outer_stack_size = c->stack_size;
+        c->func = id + 1;
+        c->stack_size = f->stack_size;
+        for (int i = 0; i < f->num_args; i++)
+        {
+            check_variable(c, ast_list(ast, f->args)[i]);
+        }
+        check_node(c, f->body);
+        c->func = outer_func;
+        c->stack_size = outer_stack_size;
+        break;
+    }
+    case ND_BLOCK:
+        check_list(c, node->stmts, node->num_stmts);
+        for (int i = 0; i < node->num_stmts; i++)
+        {
+            check_stmt(c, ast_list(ast, node->stmts)[i], false);
+        }
+        break;
+    case ND_IF:
+        check_expr(c, node->condition, false);
+        check_stmt(c, node->then, false);
+        check_stmt(c, node->elsethen, true);
+        break;
+    case ND_FOR:
+        check_list(c, node->for_exprs, 2);
+        check_expr(c, ast_list(ast, node->for_exprs)[0], true);
+        check_expr(c, ast_list(ast, node->for_exprs)[1], true);
+        check_expr(c, node->condition, true);
+        check_stmt(c, node->then, false);
+        break;
+    case ND_WHILE:
+        check_expr(c, node->condition, false);
+        check_stmt(c, node->then, false);
+        break;
+    case ND_ASSIGN:
+        check_variable_ref(c, node->lhs);
+        check_expr(c, node->rhs, false);
+        break;
+    case ND_ADDR:
+        check_variable_ref(c, node->lhs);
+        break;
+    case ND_RETURN:
+    case ND_DEREF:
+    case ND_NEG:
+        // 右辺は使わないが、二項演算子と同じくたどる処理があるので空であること
+        check_expr(c, node->lhs, false);
+        if (node->rhs != NODE_NONE)
+        {
+            corrupt(c);
+        }
+        break;
+    default:
+        // 二項演算子（is_exprで種類は確かめてある）
+        check_expr(c, node->lhs, false);
+        check_expr(c, node->rhs, false);
+        break;
+    }
+
+    c->state[id] = NODE_CHECKED;
+}
+
+// トークン列の検査
+// 種類が範囲内で、元の文字列がソースコードに収まっていること
+static void check_tokens(const char *path, const TokenList *tl, uint32_t source_len)
+{
+    for (int i = 0; i < tl->len; i++)
+    {
+        if (tl->types[i] > TK_EOF || tl->offsets[i] < 0 || tl->lengths[i] < 0 ||
+            (uint64_t)tl->offsets[i] + tl->lengths[i] > source_len)
+        {
+            error(path, "スナップショットが壊れています");
+        }
+    }
+}
+
+// 宣言からたどれるすべてのノードの検査
+// 宣言はグローバル変数か関数の定義であること
+static void check_ast(const char *path, const Ast *ast)
+{
+    Checker c = {
+        .path = path,
+        .ast = ast,
+        .state = arena_alloc(ARENA_NODE, ast->num_nodes),
+        .owner = arena_alloc(ARENA_NODE, ast->num_nodes * sizeof(int)),
+    };
+    memset(c.state, NODE_UNSEEN, ast->num_nodes);
+
+    for (int i = 0; i < ast->num_decls; i++)
+    {
+        NodeId decl = ast_list(ast, ast->decls)[i];
+        if (decl == NODE_NONE || decl >= (uint32_t)ast->num_nodes)
+        {
+            corrupt(&c);
+        }
+        const Node *node = ast_node(ast, decl);
+        if (node->ty != ND_FUNCDEF &&
+            (node->ty != ND_VARDEF || node->variable >= (uint32_t)ast->num_variables ||
+             !ast_variable(ast, node->variable)->is_global))
+        {
+            corrupt(&c);
+        }
+        check_node(&c, decl);
+    }
+}
+
+// スナップショットを読み込む
+// ファイルはmmapしたまま解放しない（ノードなどはマップした領域を直接指す）
+Ast *snapshot_load(const char *path, TokenList **tokens)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    size_t size = st.st_size;
+    if (size < sizeof(SnapshotHeader))
+    {
+        error(path, "スナップショットではありません");
+    }
+
+    uint8_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    const SnapshotHeader *h = (const SnapshotHeader *)data;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, 4) != 0)
+    {
+        error(path, "スナップショットではありません");
+    }
+    if (h->version != SNAPSHOT_VERSION || h->node_size != sizeof(Node) ||
+        h->variable_size != sizeof(VariableInfo) || h->func_size != sizeof(FuncInfo))
+    {
+        error(path, "スナップショットの版が異なります");
+    }
+    if (!in_file(size, h->source, h->source_len + 1ull, 1) ||
+        !in_file(size, h->types, h->num_tokens, sizeof(uint16_t)) ||
+        !in_file(size, h->offsets, h->num_tokens, sizeof(int)) ||
+        !in_file(size, h->lengths, h->num_tokens, sizeof(int)) ||
+        !in_file(size, h->values, h->num_tokens, sizeof(int)) ||
+        !in_file(size, h->strtab, h->strtab_len, 1) ||
+        !in_file(size, h->nodes, h->num_nodes, sizeof(Node)) ||
+        !in_file(size, h->lists, h->num_lists, sizeof(NodeId)) ||
+        !in_file(size, h->variables, h->num_variables, sizeof(VariableInfo)) ||
+        !in_file(size, h->funcs, h->num_funcs, sizeof(FuncInfo)) ||
+        h->num_nodes == 0 || (uint64_t)h->decls + h->num_decls > h->num_lists)
+    {
+        error(path, "スナップショットが壊れています");
+    }
+
+    // 文字列はすべてNUL終端であること
+    const char *source = (const char *)data + h->source;
+    const char *strtab = (const char *)data + h->strtab;
+    if (source[h->source_len] != '\0' || (h->strtab_len > 0 && strtab[h->strtab_len - 1] != '\0'))
+    {
+        error(path, "スナップショットが壊れています");
+    }
+
+    TokenList *tl = arena_alloc(ARENA_TOKEN, sizeof(TokenList));
+    tl->source = source;
+    tl->types = (uint16_t *)(data + h->types);
+    tl->offsets = (int *)(data + h->offsets);
+    tl->lengths = (int *)(data + h->lengths);
+    tl->values = (int *)(data + h->values);
+    tl->len = h->num_tokens;
+    tl->capacity = h->num_tokens;
+    check_tokens(path, tl, h->source_len);
+    *tokens = tl;
+
+    Ast *ast = arena_alloc(ARENA_NODE, sizeof(Ast));
+    mem_count(MEM_NODES, sizeof(Ast), 1);
+    ast->nodes = (Node *)(data + h->nodes);
+    ast->num_nodes = ast->node_capacity = h->num_nodes;
+    ast->lists = (NodeId *)(data + h->lists);
+    ast->num_lists = ast->list_capacity = h->num_lists;
+    ast->variables = (VariableInfo *)(data + h->variables);
+    ast->num_variables = ast->variable_capacity = h->num_variables;
+    ast->funcs = (FuncInfo *)(data + h->funcs);
+    ast->num_funcs = ast->func_capacity = h->num_funcs;
+    ast->decls = h->decls;
+    ast->num_decls = h->num_decls;
+
+    for (int i = 0; i < ast->num_variables; i++)
+    {
+        VariableInfo *v = ast_variable(ast, i);
+        v->name = resolve_name(path, strtab, h->strtab_len, v->name);
+        // boolとして読む前に、0か1であることを確かめる
+        uint8_t is_global;
+        memcpy(&is_global, &v->is_global, sizeof(is_global));
+        if (is_global > 1)
+        {
+            error(path, "スナップショットが壊れています");
+        }
+    }
+    for (int i = 0; i < ast->num_funcs; i++)
+    {
+        FuncInfo *f = ast_func(ast, i);
+        f->name = resolve_name(path, strtab, h->strtab_len, f->name);
+    }
+    check_ast(path, ast);
+
+    return ast;
+}
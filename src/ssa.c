@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "shcc.h"
+
+// SSA形式への変換
+//
+// 変数の仮想レジスタ（0からnum_vars-1）を、定義ごとに新しい仮想レジスタへ付け替える
+// 支配木と支配辺境からphiを置き、支配木をたどって名前を付け替える
+// 変数へのコピーは命令を残さず、コピー元の値をそのまま変数の値とする
+
+// 変換の作業状態
+typedef struct
+{
+    IrFunc *ir;
+    int *rpo;            // 逆後順のブロック番号
+    int *rpo_index;      // ブロックごとの逆後順での位置
+    int *idom;           // ブロックごとの直接支配ブロック（入口は自身）
+    int **children;      // 支配木の子
+    int *num_children;
+    int **frontiers;     // ブロックごとの支配辺境
+    int *num_frontiers;
+    int *frontier_capacity;
+    int **stacks;        // 変数ごとの現在の名前のスタック
+    int *stack_len;
+    int *pushed;         // 名前を積んだ変数の履歴（ブロックを出るときに戻す）
+    int num_pushed;
+} SsaBuilder;
+
+// 作業領域の確保
+static void *ssa_alloc(size_t size)
+{
+    void *p = arena_alloc(ARENA_CODEGEN, size);
+    memset(p, 0, size);
+    mem_count(MEM_CODEGEN, size, 1);
+    return p;
+}
+
+// 後順でブロックを並べる
+static void post_order(const IrBlock *block, bool *visited, int *order, int *len)
+{
+    visited[block->id] = true;
+    for (int i = 0; i < block->num_succs; i++)
+    {
+        if (!visited[block->succs[i]->id])
+        {
+            post_order(block->succs[i], visited, order, len);
+        }
+    }
+    order[(*len)++] = block->id;
+}
+
+// 二つのブロックを共に支配するブロックのうち最も近いもの
+static int intersect(const SsaBuilder *sb, int a, int b)
+{
+    while (a != b)
+    {
+        while (sb->rpo_index[a] > sb->rpo_index[b])
+        {
+            a = sb->idom[a];
+        }
+        while (sb->rpo_index[b] > sb->rpo_index[a])
+        {
+            b = sb->idom[b];
+        }
+    }
+    return a;
+}
+
+// 支配木の作成
+// 逆後順で直接支配ブロックを更新し、変わらなくなるまで繰り返す
+static void build_dominators(SsaBuilder *sb)
+{
+    IrFunc *ir = sb->ir;
+    int n = ir->num_blocks;
+
+    bool *visited = ssa_alloc((n + 1) * sizeof(bool));
+    int *order = ssa_alloc((n + 1) * sizeof(int));
+    int len = 0;
+    post_order(ir->blocks[0], visited, order, &len);
+    assert(len == n);
+
+    sb->rpo = ssa_alloc((n + 1) * sizeof(int));
+    sb->rpo_index = ssa_alloc((n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++)
+    {
+        sb->rpo[i] = order[n - 1 - i];
+        sb->rpo_index[sb->rpo[i]] = i;
+    }
+
+    sb->idom = ssa_alloc((n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++)
+    {
+        sb->idom[i] = -1;
+    }
+    sb->idom[0] = 0;
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (int i = 1; i < n; i++)
+        {
+            const IrBlock *block = ir->blocks[sb->rpo[i]];
+            int idom = -1;
+            for (int j = 0; j < block->num_preds; j++)
+            {
+                int pred = block->preds[j]->id;
+                if (sb->idom[pred] < 0)
+                {
+                    continue;
+                }
+                idom = idom < 0 ? pred : intersect(sb, pred, idom);
+            }
+            if (sb->idom[block->id] != idom)
+            {
+                sb->idom[block->id] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    sb->children = ssa_alloc((n + 1) * sizeof(int *));
+    sb->num_children = ssa_alloc((n + 1) * sizeof(int));
+    for (int b = 1; b < n; b++)
+    {
+        sb->num_children[sb->idom[b]]++;
+    }
+    for (int b = 0; b < n; b++)
+    {
+        sb->children[b] = ssa_alloc((sb->num_children[b] + 1) * sizeof(int));
+        sb->num_children[b] = 0;
+    }
+    for (int b = 1; b < n; b++)
+    {
+        int parent = sb->idom[b];
+        sb->children[parent][sb->num_children[parent]++] = b;
+    }
+}
+
+// 支配辺境へブロックを加える
+static void add_frontier(SsaBuilder *sb, int block, int frontier)
+{
+    int n = sb->num_frontiers[block];
+
+    // 同じ合流ブロックについては続けて加えるので、直前と比べれば重複はなくなる
+    if (n > 0 && sb->frontiers[block][n - 1] == frontier)
+    {
+        return;
+    }
+    if (n == sb->frontier_capacity[block])
+    {
+        int capacity = n == 0 ? 4 : n * 2;
+        sb->frontiers[block] = arena_realloc(ARENA_CODEGEN, sb->frontiers[block], n * sizeof(int), capacity * sizeof(int));
+        mem_count(MEM_CODEGEN, (capacity - n) * sizeof(int), 0);
+        sb->frontier_capacity[block] = capacity;
+    }
+    sb->frontiers[block][sb->num_frontiers[block]++] = frontier;
+}
+
+// 支配辺境の算出
+// 合流するブロックから、各先行ブロックを直接支配ブロックまでさかのぼる
+static void build_frontiers(SsaBuilder *sb)
+{
+    IrFunc *ir = sb->ir;
+    int n = ir->num_blocks;
+    sb->frontiers = ssa_alloc((n + 1) * sizeof(int *));
+    sb->num_frontiers = ssa_alloc((n + 1) * sizeof(int));
+    sb->frontier_capacity = ssa_alloc((n + 1) * sizeof(int));
+
+    for (int b = 0; b < n; b++)
+    {
+        const IrBlock *block = ir->blocks[b];
+        if (block->num_preds < 2)
+        {
+            continue;
+        }
+        for (int j = 0; j < block->num_preds; j++)
+        {
+            for (int runner = block->preds[j]->id; runner != sb->idom[b]; runner = sb->idom[runner])
+            {
+                add_frontier(sb, runner, b);
+            }
+        }
+    }
+}
+
+// ブロックの先頭にphiを置く
+static void insert_phi(IrBlock *block, int var)
+{
+    if (block->len == block->capacity)
+    {
+        int capacity = block->capacity == 0 ? 8 : block->capacity * 2;
+        block->ins = arena_realloc(ARENA_CODEGEN, block->ins,
+                                   block->capacity * sizeof(IrIns), capacity * sizeof(IrIns));
+        mem_count(MEM_CODEGEN, (capacity - block->capacity) * sizeof(IrIns), 0);
+        block->capacity = capacity;
+    }
+    memmove(&block->ins[1], &block->ins[0], block->len * sizeof(IrIns));
+    block->len++;
+
+    int *args = ssa_alloc((block->num_preds + 1) * sizeof(int));
+    for (int i = 0; i < block->num_preds; i++)
+    {
+        args[i] = IR_NONE;
+    }
+    block->ins[0] = (IrIns){.op = IR_PHI, .type = IRT_I64, .dst = var, .a = IR_NONE, .b = IR_NONE,
+                            .imm = var, .args = args, .num_args = block->num_preds};
+}
+
+// phiの配置
+// 変数を定義するブロックの支配辺境へ、変わらなくなるまで繰り返し置く
+static void place_phis(SsaBuilder *sb)
+{
+    IrFunc *ir = sb->ir;
+    int n = ir->num_blocks;
+
+    // 変数ごとの定義のあるブロック（同じブロックは続けて現れる）
+    int *num_def_blocks = ssa_alloc((ir->num_vars + 1) * sizeof(int));
+    int **def_blocks = ssa_alloc((ir->num_vars + 1) * sizeof(int *));
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int b = 0; b < n; b++)
+        {
+            const IrBlock *block = ir->blocks[b];
+            for (int i = 0; i < block->len; i++)
+            {
+                int var = block->ins[i].dst;
+                if (var == IR_NONE || var >= ir->num_vars)
+                {
+                    continue;
+                }
+                int count = num_def_blocks[var];
+                if (pass == 0)
+                {
+                    num_def_blocks[var]++;
+                }
+                else if (count == 0 || def_blocks[var][count - 1] != b)
+                {
+                    def_blocks[var][num_def_blocks[var]++] = b;
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            for (int var = 0; var < ir->num_vars; var++)
+            {
+                def_blocks[var] = ssa_alloc((num_def_blocks[var] + 1) * sizeof(int));
+                num_def_blocks[var] = 0;
+            }
+        }
+    }
+
+    // 変数ごとに、phiを置いた・作業リストに入れたブロックを変数の番号+1で記録する
+    int *has_phi = ssa_alloc((n + 1) * sizeof(int));
+    int *queued = ssa_alloc((n + 1) * sizeof(int));
+    int *work = ssa_alloc((n + 1) * sizeof(int));
+    for (int var = 0; var < ir->num_vars; var++)
+    {
+        int mark = var + 1;
+        int len = 0;
+        for (int i = 0; i < num_def_blocks[var]; i++)
+        {
+            int b = def_blocks[var][i];
+            work[len++] = b;
+            queued[b] = mark;
+        }
+
+        while (len > 0)
+        {
+            int b = work[--len];
+            for (int i = 0; i < sb->num_frontiers[b]; i++)
+            {
+                int d = sb->frontiers[b][i];
+                if (has_phi[d] == mark)
+                {
+                    continue;
+                }
+                insert_phi(ir->blocks[d], var);
+                has_phi[d] = mark;
+                if (queued[d] != mark)
+                {
+                    queued[d] = mark;
+                    work[len++] = d;
+                }
+            }
+        }
+    }
+}
+
+// 変数の現在の名前
+static int current_name(const SsaBuilder *sb, int v)
+{
+    if (v == IR_NONE || v >= sb->ir->num_vars)
+    {
+        return v;
+    }
+
+    assert(sb->stack_len[v] > 0);
+    return sb->stacks[v][sb->stack_len[v] - 1];
+}
+
+// 変数に新しい名前を付ける
+static void push_name(SsaBuilder *sb, int var, int name)
+{
+    sb->stacks[var][sb->stack_len[var]++] = name;
+    sb->pushed[sb->num_pushed++] = var;
+}
+
+// 名前の付け替え
+// 支配木を前順にたどり、ブロックを出るときに付けた名前を戻す
+static void rename_block(SsaBuilder *sb, IrBlock *block)
+{
+    IrFunc *ir = sb->ir;
+    int num_pushed = sb->num_pushed;
+
+    int kept = 0;
+    for (int i = 0; i < block->len; i++)
+    {
+        IrIns ins = block->ins[i];
+        if (ins.op != IR_PHI)
+        {
+            ins.a = current_name(sb, ins.a);
+            ins.b = current_name(sb, ins.b);
+            if (ins.op == IR_CALL)
+            {
+                for (int j = 0; j < ins.num_args; j++)
+                {
+                    ins.args[j] = current_name(sb, ins.args[j]);
+                }
+            }
+        }
+
+        if (ins.dst != IR_NONE && ins.dst < ir->num_vars)
+        {
+            int var = ins.dst;
+            if (ins.op == IR_COPY)
+            {
+                // コピーは取り除き、以降はコピー元を変数の値とする
+                push_name(sb, var, ins.a);
+                continue;
+            }
+            ins.dst = ir->num_vregs++;
+            push_name(sb, var, ins.dst);
+        }
+        block->ins[kept++] = ins;
+    }
+    block->len = kept;
+
+    // 後続ブロックのphiへ、このブロックから通っていく値を入れる
+    for (int s = 0; s < block->num_succs; s++)
+    {
+        IrBlock *succ = block->succs[s];
+        for (int i = 0; i < succ->len && succ->ins[i].op == IR_PHI; i++)
+        {
+            IrIns *phi = &succ->ins[i];
+            for (int j = 0; j < succ->num_preds; j++)
+            {
+                if (succ->preds[j] == block)
+                {
+                    phi->args[j] = current_name(sb, phi->imm);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < sb->num_children[block->id]; i++)
+    {
+        rename_block(sb, ir->blocks[sb->children[block->id][i]]);
+    }
+
+    while (sb->num_pushed > num_pushed)
+    {
+        sb->stack_len[sb->pushed[--sb->num_pushed]]--;
+    }
+}
+
+// 変数を入口で初期化する
+// 初期化されていない変数を読んでも、どの経路でも名前が決まるようにする
+static void define_vars_at_entry(IrFunc *ir)
+{
+    IrBlock *entry = ir->blocks[0];
+    int num_new = ir->num_vars;
+    if (entry->len + num_new > entry->capacity)
+    {
+        int capacity = entry->len + num_new;
+        entry->ins = arena_realloc(ARENA_CODEGEN, entry->ins,
+                                   entry->capacity * sizeof(IrIns), capacity * sizeof(IrIns));
+        mem_count(MEM_CODEGEN, (capacity - entry->capacity) * sizeof(IrIns), 0);
+        entry->capacity = capacity;
+    }
+    memmove(&entry->ins[num_new], &entry->ins[0], entry->len * sizeof(IrIns));
+    entry->len += num_new;
+
+    for (int var = 0; var < num_new; var++)
+    {
+        entry->ins[var] = (IrIns){.op = IR_IMM, .type = IRT_I64, .dst = var, .a = IR_NONE, .b = IR_NONE};
+    }
+}
+
+// IRをSSA形式にする
+// 変換後はすべての仮想レジスタが一度だけ定義される
+void ir_to_ssa(IrFunc *ir)
+{
+    ir_remove_unreachable(ir);
+    if (ir->num_vars == 0)
+    {
+        return;
+    }
+
+    define_vars_at_entry(ir);
+
+    SsaBuilder sb = {.ir = ir};
+    build_dominators(&sb);
+    build_frontiers(&sb);
+    place_phis(&sb);
+
+    // 一つの変数の名前は、定義の数を超えて積まれることはない
+    int *num_defs = ssa_alloc((ir->num_vars + 1) * sizeof(int));
+    int total_defs = 0;
+    for (int b = 0; b < ir->num_blocks; b++)
+    {
+        const IrBlock *block = ir->blocks[b];
+        for (int i = 0; i < block->len; i++)
+        {
+            if (block->ins[i].dst != IR_NONE && block->ins[i].dst < ir->num_vars)
+            {
+                num_defs[block->ins[i].dst]++;
+                total_defs++;
+            }
+        }
+    }
+    sb.stacks = ssa_alloc((ir->num_vars + 1) * sizeof(int *));
+    sb.stack_len = ssa_alloc((ir->num_vars + 1) * sizeof(int));
+    sb.pushed = ssa_alloc((total_defs + 1) * sizeof(int));
+    for (int var = 0; var < ir->num_vars; var++)
+    {
+        sb.stacks[var] = ssa_alloc((num_defs[var] + 1) * sizeof(int));
+    }
+
+    rename_block(&sb, ir->blocks[0]);
+    ir->num_vars = 0;
+}
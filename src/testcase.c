@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "shcc.h"
+
+// 各ケースを実行する最適化レベルの上限（0からこのレベルまですべてで実行する）
+#define MAX_OPT_LEVEL 1
+
+// テストケース
+typedef struct
+{
+    int line;           // ケース表での行番号
+    int expected;       // 予想される終了コード
+    const char *source; // ソースコード
+} TestCase;
+
+// テストケースの作業キュー
+typedef struct
+{
+    const Vector *cases; // TestCase
+    atomic_int next;     // 次に実行するケース
+    atomic_int failures; // 失敗したケースの数
+} TestQueue;
+
+// ケース表の読み込み
+// 1行に1ケースで「<予想される終了コード> <ソースコード>」の形式
+// #で始まる行と空行は無視する
+static Vector *read_cases(const char *path)
+{
+    Vector *cases = new_vector();
+    // ソースコードは読み込んだ内容を直接指すので解放しない
+    char *p = read_file(path);
+
+    for (int line = 1; *p != '\0'; line++)
+    {
+        char *text = p;
+        p += strcspn(p, "\n");
+        if (*p != '\0')
+        {
+            *p++ = '\0';
+        }
+
+        if (*text == '\0' || *text == '#')
+        {
+            continue;
+        }
+
+        char *source;
+        long expected = strtol(text, &source, 10);
+        if (source == text || *source != ' ')
+        {
+            fprintf(stderr, "%s:%d: テストケースの形式が正しくありません\n", path, line);
+            exit(1);
+        }
+
+        TestCase *tc = calloc(1, sizeof(TestCase));
+        tc->line = line;
+        tc->expected = expected;
+        tc->source = source + 1;
+        vec_push(cases, tc);
+    }
+
+    return cases;
+}
+
+// テストケース一つのコンパイルと実行
+// 終了コードと同じく下位8bitを返す
+static int run_case(const TestCase *tc, int opt_level)
+{
+    phase_begin(PHASE_TOKENIZE);
+    TokenList *tokens = tokenize(tc->source);
+    phase_end(PHASE_TOKENIZE);
+    phase_begin(PHASE_PARSE);
+    Ast *ast = program(tokens);
+    phase_end(PHASE_PARSE);
+    report_count(COUNT_TOKENS, tokens->len);
+    report_count(COUNT_NODES, ast->num_nodes);
+    arena_reset(ARENA_TOKEN);
+    phase_begin(PHASE_FOLD);
+    fold_constants(ast);
+    phase_end(PHASE_FOLD);
+
+    phase_begin(PHASE_CODEGEN);
+    gen_asm(ast, 1, opt_level);
+    phase_end(PHASE_CODEGEN);
+    int status = jit_run(emit_program());
+
+    arena_reset_all();
+
+    return status & 0xff;
+}
+
+// ワーカースレッド
+// キューからケースを取り出してなくなるまで実行する
+static void *test_worker(void *arg)
+{
+    TestQueue *queue = arg;
+
+    for (;;)
+    {
+        int i = atomic_fetch_add(&queue->next, 1);
+        if (i >= queue->cases->len)
+        {
+            break;
+        }
+
+        const TestCase *tc = queue->cases->data[i];
+        for (int opt_level = 0; opt_level <= MAX_OPT_LEVEL; opt_level++)
+        {
+            int actual = run_case(tc, opt_level);
+            if (actual != tc->expected)
+            {
+                printf("*** '%s'\n*** %d expected, but got %d (L%d, -O%d)\n",
+                       tc->source, tc->expected, actual, tc->line, opt_level);
+                atomic_fetch_add(&queue->failures, 1);
+                break;
+            }
+        }
+    }
+
+    arena_release_all();
+    mem_report_merge_thread();
+    time_report_merge_thread();
+
+    return NULL;
+}
+
+// ケース表のテストをプロセス内で並列に実行する
+// 外部関数はjit_load_libraryで読み込んだライブラリから解決する
+// 失敗したケースの数を返す
+int run_test_cases(const char *path, int jobs)
+{
+    TestQueue queue = {.cases = read_cases(path)};
+
+    int num_threads = jobs < queue.cases->len ? jobs : queue.cases->len;
+    if (num_threads <= 1)
+    {
+        test_worker(&queue);
+    }
+    else
+    {
+        pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+        for (int i = 0; i < num_threads; i++)
+        {
+            if (pthread_create(&threads[i], NULL, test_worker, &queue) != 0)
+            {
+                fprintf(stderr, "スレッドを作成できません\n");
+                exit(1);
+            }
+        }
+        for (int i = 0; i < num_threads; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+    }
+
+    int failures = atomic_load(&queue.failures);
+    if (failures == 0)
+    {
+        printf("    %d cases OK\n", queue.cases->len);
+    }
+    else
+    {
+        printf("    %d of %d cases failed\n", failures, queue.cases->len);
+    }
+
+    return failures;
+}
@@ -7,16 +7,54 @@
 
 #include "shcc.h"
 
-// vectorにtokenを追加
-static void vec_push_token(Vector *vec, TokenType_t ty, int value, char *input)
+// トークン列の配列を拡張する
+static void *grow_array(void *array, int capacity, int new_capacity, size_t size)
 {
-    Token *tk = (Token *)calloc(1, sizeof(Token));
+    mem_count(MEM_TOKENS, (new_capacity - capacity) * size, 0);
 
-    tk->ty = ty;
-    tk->value = value;
-    tk->input = input;
+    return arena_realloc(ARENA_TOKEN, array, capacity * size, new_capacity * size);
+}
+
+// トークン列の作成
+// 要素数の初期値はソースコード長からの見積もり
+static TokenList *new_token_list(const char *source)
+{
+    TokenList *tl = arena_alloc(ARENA_TOKEN, sizeof(TokenList));
+    int capacity = (int)(strlen(source) / 4) + 16;
+
+    tl->source = source;
+    tl->types = arena_alloc(ARENA_TOKEN, capacity * sizeof(*tl->types));
+    tl->offsets = arena_alloc(ARENA_TOKEN, capacity * sizeof(*tl->offsets));
+    tl->lengths = arena_alloc(ARENA_TOKEN, capacity * sizeof(*tl->lengths));
+    tl->values = arena_alloc(ARENA_TOKEN, capacity * sizeof(*tl->values));
+    tl->capacity = capacity;
+    tl->len = 0;
 
-    vec_push(vec, tk);
+    size_t element_size = sizeof(*tl->types) + sizeof(*tl->offsets) + sizeof(*tl->lengths) + sizeof(*tl->values);
+    mem_count(MEM_TOKENS, sizeof(TokenList) + capacity * element_size, 1);
+
+    return tl;
+}
+
+// トークン列にtokenを追加
+// 空きがなければ2倍に拡張する
+static void push_token(TokenList *tl, TokenType_t ty, const char *p, int len, int value)
+{
+    if (tl->capacity == tl->len)
+    {
+        int capacity = tl->capacity * 2;
+        tl->types = grow_array(tl->types, tl->capacity, capacity, sizeof(*tl->types));
+        tl->offsets = grow_array(tl->offsets, tl->capacity, capacity, sizeof(*tl->offsets));
+        tl->lengths = grow_array(tl->lengths, tl->capacity, capacity, sizeof(*tl->lengths));
+        tl->values = grow_array(tl->values, tl->capacity, capacity, sizeof(*tl->values));
+        tl->capacity = capacity;
+    }
+
+    int i = tl->len++;
+    tl->types[i] = (uint16_t)ty;
+    tl->offsets[i] = (int)(p - tl->source);
+    tl->lengths[i] = len;
+    tl->values[i] = value;
 }
 
 // 識別子の先頭になり得る文字か？
@@ -33,78 +71,100 @@ static bool is_idnet_char(char ch)
     return is_idnet_head_char(ch) || isdigit(ch);
 }
 
-// 演算子のマップを生成・取得
-static Map *get_operator_list(void)
+// 演算子DFA: 1文字目による遷移
+// TK_INVALIDなら非受理
+static const TokenType_t operator_1st[128] = {
+    ['+'] = TK_PLUS,
+    ['-'] = TK_MINUS,
+    ['*'] = TK_MUL, // TK_DEREFと同値
+    ['/'] = TK_DIV,
+    ['%'] = TK_MOD,
+    ['('] = TK_PROPEN,
+    [')'] = TK_PRCLOSE,
+    ['='] = TK_ASSIGN,
+    ['<'] = TK_LESS,
+    ['>'] = TK_GREATER,
+    ['{'] = TK_BRACE_OPEN,
+    ['}'] = TK_BRACE_CLOSE,
+    ['&'] = TK_ADDR,
+    [';'] = TK_STMT,
+    [','] = TK_COMMA,
+};
+
+// 演算子DFA: 1文字目の後に'='が続いたときの遷移
+// 2文字の演算子はすべて'='で終わるので、2文字目の遷移はこれだけでよい
+static const TokenType_t operator_2nd_eq[128] = {
+    ['='] = TK_EQ,
+    ['!'] = TK_NEQ,
+    ['<'] = TK_LESS_EQ,
+    ['>'] = TK_GREATER_EQ,
+    ['+'] = TK_ADD_ASSIGN,
+    ['-'] = TK_SUB_ASSIGN,
+    ['*'] = TK_MUL_ASSIGN,
+    ['/'] = TK_DIV_ASSIGN,
+    ['%'] = TK_MOD_ASSIGN,
+};
+
+// 予約語
+typedef struct
+{
+    const char *word;
+    int len;
+    TokenType_t ty;
+} ReservedWord;
+
+// 予約語の完全ハッシュ表
+// 添字はreserved_word_hash()の値で、予約語同士は衝突しない
+static const ReservedWord reserved_words[8] = {
+    [2] = {"return", 6, TK_RETURN},
+    [3] = {"while", 5, TK_WHILE},
+    [4] = {"if", 2, TK_IF},
+    [5] = {"int", 3, TK_INT},
+    [6] = {"else", 4, TK_ELSE},
+    [7] = {"for", 3, TK_FOR},
+};
+
+// 予約語の完全ハッシュ関数
+// 先頭文字と長さだけで予約語を一意に振り分けられる
+static int reserved_word_hash(const char *p, int len)
 {
-    Map *operator_list = new_map();
-
-    map_puti(operator_list, "==", TK_EQ);
-    map_puti(operator_list, "!=", TK_NEQ);
-    map_puti(operator_list, "<=", TK_LESS_EQ);
-    map_puti(operator_list, ">=", TK_GREATER_EQ);
-    map_puti(operator_list, "+=", TK_ADD_ASSIGN);
-    map_puti(operator_list, "-=", TK_SUB_ASSIGN);
-    map_puti(operator_list, "*=", TK_MUL_ASSIGN);
-    map_puti(operator_list, "/=", TK_DIV_ASSIGN);
-    map_puti(operator_list, "%=", TK_MOD_ASSIGN);
-
-    map_puti(operator_list, "+", TK_PLUS);
-    map_puti(operator_list, "-", TK_MINUS);
-    map_puti(operator_list, "*", TK_MUL);
-    map_puti(operator_list, "/", TK_DIV);
-    map_puti(operator_list, "%", TK_MOD);
-    map_puti(operator_list, "(", TK_PROPEN);
-    map_puti(operator_list, ")", TK_PRCLOSE);
-    map_puti(operator_list, "=", TK_ASSIGN);
-    map_puti(operator_list, "<", TK_LESS);
-    map_puti(operator_list, ">", TK_GREATER);
-    map_puti(operator_list, "{", TK_BRACE_OPEN);
-    map_puti(operator_list, "}", TK_BRACE_CLOSE);
-    map_puti(operator_list, "&", TK_ADDR);
-    map_puti(operator_list, "*", TK_DEREF);
-    map_puti(operator_list, ";", TK_STMT);
-
-    return operator_list;
+    return ((unsigned char)p[0] * 2 + len) & 7;
 }
 
-// 予約後のマップを生成・取得
-static Map *get_reserved_words(void)
+// 予約語を探す
+// 予約語でなければTK_INVALID
+static const ReservedWord *find_reserved_word(const char *p, int len)
 {
-    Map *reserved_words = new_map();
+    const ReservedWord *rw = &reserved_words[reserved_word_hash(p, len)];
 
-    map_puti(reserved_words, "int", TK_INT);
-    map_puti(reserved_words, "return", TK_RETURN);
-    map_puti(reserved_words, "if", TK_IF);
-    map_puti(reserved_words, "else", TK_ELSE);
-    map_puti(reserved_words, "for", TK_FOR);
-    map_puti(reserved_words, "while", TK_WHILE);
+    if (rw->len == len && memcmp(rw->word, p, len) == 0)
+    {
+        return rw;
+    }
 
-    return reserved_words;
+    return NULL;
 }
 
 // オペレータのトークナイズ
-static int consume_operator(Vector *tk, const Map *operator_list, const char *p)
+static int consume_operator(TokenList *tl, const char *p)
 {
-    const int MAX_OPERATOR_LENGTH = 2;
-
-    char *operator=(char *) calloc(MAX_OPERATOR_LENGTH + 1, sizeof(char));
-    strncpy(operator, p, MAX_OPERATOR_LENGTH);
+    unsigned char ch = (unsigned char)p[0];
+    if (ch >= NUMOF(operator_1st))
+    {
+        return 0;
+    }
 
-    for (int i = MAX_OPERATOR_LENGTH; i > 0; i--)
+    // 2文字の演算子を優先する
+    if (p[1] == '=' && operator_2nd_eq[ch] != TK_INVALID)
     {
-        // 探索したい長さのオペレータではない
-        if (operator[i - 1] == '\0')
-        {
-            continue;
-        }
-        operator[i] = '\0';
+        push_token(tl, operator_2nd_eq[ch], p, 2, 0);
+        return 2;
+    }
 
-        TokenType_t ty = (TokenType_t)map_geti(operator_list, operator);
-        if (ty != TK_INVALID)
-        {
-            vec_push_token(tk, ty, 0, operator);
-            return i;
-        }
+    if (operator_1st[ch] != TK_INVALID)
+    {
+        push_token(tl, operator_1st[ch], p, 1, 0);
+        return 1;
     }
 
     // operatorが見つからなかった
@@ -131,7 +191,7 @@ static int get_ident_length(const char *p)
 
 // 識別子をトークナイズ
 // 変数も予約語もここで処理する
-static int consume_ident(Vector *tk, const Map *rwords, const char *p)
+static int consume_ident(TokenList *tl, const char *p)
 {
     // キーワード文字列を抜き出す
     int len = get_ident_length(p);
@@ -140,30 +200,29 @@ static int consume_ident(Vector *tk, const Map *rwords, const char *p)
         return 0;
     }
 
-    char *name = (char *)calloc(len + 1, sizeof(char));
-    strncpy(name, p, len);
-    name[len] = '\0';
-
     // 抜き出した文字列の識別子を調べる
-    TokenType_t ty = (TokenType_t)map_geti(rwords, name);
-    if (ty == TK_INVALID)
+    const ReservedWord *rw = find_reserved_word(p, len);
+    if (rw != NULL)
     {
-        // 予約後ではないので、変数
-        ty = TK_IDENT;
+        push_token(tl, rw->ty, p, len, 0);
+        return len;
     }
 
-    vec_push_token(tk, ty, 0, name);
+    // 予約後ではないので、変数
+    // 同じ識別子は一度だけ文字列化して使い回し、トークンにはその番号を持たせる
+    Symbol *sym = intern(p, len);
+    push_token(tl, TK_IDENT, p, len, sym->id);
 
     return len;
 }
 
 // トークナイズの実行
 // 出力はしない
-Vector *tokenize(char *p)
+// トークン文字列はソースコードを直接参照するので、sourceはトークン列より長く生存すること
+TokenList *tokenize(const char *source)
 {
-    Vector *tk = new_vector();
-    Map *operators = get_operator_list();
-    Map *rwords = get_reserved_words();
+    TokenList *tk = new_token_list(source);
+    const char *p = source;
 
     while (*p)
     {
@@ -175,7 +234,7 @@ Vector *tokenize(char *p)
         }
 
         // 演算子
-        int operator_length = consume_operator(tk, operators, p);
+        int operator_length = consume_operator(tk, p);
         if (operator_length != 0)
         {
             p += operator_length;
@@ -184,7 +243,7 @@ Vector *tokenize(char *p)
 
         // 識別子
         // 変数も予約後もここで
-        int ident_length = consume_ident(tk, rwords, p);
+        int ident_length = consume_ident(tk, p);
         if (ident_length != 0)
         {
             p += ident_length;
@@ -194,16 +253,17 @@ Vector *tokenize(char *p)
         // number
         if (isdigit(*p))
         {
-            char *bp = p;
-            vec_push_token(tk, TK_NUM, strtol(p, &p, 10), bp);
+            char *end;
+            int value = (int)strtol(p, &end, 10);
+            push_token(tk, TK_NUM, p, (int)(end - p), value);
+            p = end;
             continue;
         }
 
-        fprintf(stderr, "トークナイズできません： %s\n", p);
-        exit(1);
+        compile_error("トークナイズできません： %s", p);
     }
 
-    vec_push_token(tk, TK_EOF, 0, p);
+    push_token(tk, TK_EOF, p, 0, 0);
 
     return tk;
 }
@@ -6,6 +6,10 @@ cd `dirname $0`
 if [ ! -e "exfunc.o" ]; then
 	gcc -c "exfunc.c"
 fi
+# -runで使う共有ライブラリ版
+if [ ! -e "exfunc.so" ]; then
+	gcc -shared -fPIC -o "exfunc.so" "exfunc.c"
+fi
 
 # テスト用のメソッド
 # 第2引数をソースコードとしてコンパイラへ入力・実行し第1引数の予測結果と比較します。
@@ -20,147 +24,180 @@ try() {
 	./testout
 	actual="$?"
 
+	if [ "$actual" != "$expected" ]; then
+		echo "*** '$input'"
+		echo "*** $expected expected, but got $actual (L$BASH_LINENO)"
+		exit 1
+	fi
+
+	# アセンブラを介さずに出力したオブジェクトファイルでも同じ結果になること
+	../bin/shcc -c -o testout.o "$input"
+	gcc -o testout testout.o exfunc.o
+	./testout
+	actual="$?"
+
+	if [ "$actual" != "$expected" ]; then
+		echo "*** '$input' (-c)"
+		echo "*** $expected expected, but got $actual (L$BASH_LINENO)"
+		exit 1
+	fi
+
+	# レジスタ割り当て（-O1）をしても同じ結果になること（IRのダンプはコメントとして出力される）
+	../bin/shcc -O1 -dumpir "$input" > testout.s
+	gcc -o testout testout.s exfunc.o
+	./testout
+	actual="$?"
+
+	if [ "$actual" != "$expected" ]; then
+		echo "*** '$input' (-O1)"
+		echo "*** $expected expected, but got $actual (L$BASH_LINENO)"
+		exit 1
+	fi
+
+	# メモリ上で直接実行しても同じ結果になること
+	../bin/shcc -run -runlib ./exfunc.so "$input"
+	actual="$?"
+
 	if [ "$actual" = "$expected" ]; then
 		echo "$input => $actual"
 	else
-		echo "*** '$input'"
+		echo "*** '$input' (-run)"
 		echo "*** $expected expected, but got $actual (L$BASH_LINENO)"
 		exit 1
 	fi
 }
 
+# テストケース表のすべてのケースを実行
+while IFS= read -r line; do
+	# コメントと空行は読み飛ばす
+	if [ -z "$line" ] || [ "${line:0:1}" = "#" ]; then
+		continue
+	fi
+	try "${line%% *}" "${line#* }"
+done < cases.txt
+
+# 関数が多いとコード生成は並列に行なわれるが、出力は逐次の場合と一致すること
+many_funcs=''
+for i in $(seq 0 63); do
+	many_funcs+="int f$i(int a){if(a<$i) return a+$i; else return a;} "
+done
+many_funcs+='int main(){return f42(1);}'
+try 43 "$many_funcs"
+../bin/shcc -j 1 "$many_funcs" > testout_j1.s
+../bin/shcc -j 4 "$many_funcs" > testout.s
+if ! cmp -s testout_j1.s testout.s; then
+	echo "*** parallel codegen output differs from serial output"
+	exit 1
+fi
+
+# 関数のキャッシュを使っても出力は変わらず、変更した関数だけが作り直されること
+rm -rf cache
+../bin/shcc -cache cache -j 4 -o testout.s "$many_funcs"
+../bin/shcc -cache cache -j 4 -o testout_j1.s "$many_funcs"
+if ! cmp -s testout_j1.s testout.s; then
+	echo "*** cached codegen output differs from uncached output"
+	exit 1
+fi
+../bin/shcc -j 1 "${many_funcs/a+42/a+99}" > testout_j1.s
+../bin/shcc -cache cache -j 4 -o testout.s "${many_funcs/a+42/a+99}"
+if ! cmp -s testout_j1.s testout.s; then
+	echo "*** cached codegen output is stale after an edit"
+	exit 1
+fi
+# 最適化レベルが違えばキャッシュの命令列は使わないこと
+../bin/shcc -O1 "${many_funcs/a+42/a+99}" > testout_j1.s
+../bin/shcc -cache cache -O1 -o testout.s "${many_funcs/a+42/a+99}"
+if ! cmp -s testout_j1.s testout.s; then
+	echo "*** cached codegen output is reused across optimization levels"
+	exit 1
+fi
 
-try 0 'int main(){0;}'
-try 42 'int main(){42;}'
-
-try 42 'int main(){40+2;}'
-try 21 'int main(){5+20-4;}'
-try 0 'int main(){0+0-0;}'
-
-try 21 'int main(){5 + 20 - 4;}'
-try 42 'int main(){10+ 10 +22;}'
-
-try 15 'int main(){3*5;}'
-try 20 'int main(){60/3;}'
-try 22 'int main(){4+6*3;}'
-try 22 'int main(){6*3+4;}'
-try 12 'int main(){(2+1)*4;}'
-try 12 'int main(){4*(2+1);}'
-
-try 47 'int main(){5+6*7;}'
-try 15 'int main(){5*(9-6);}'
-try 4 'int main(){(3+5)/2;}'
-
-try 10 'int main(){int a; a=10;}'
-try 22 'int main(){int a; a=10; int b; b=12 ;int c; c=a+b; print_int(a); print_int(b); print_int(c); return c;}'
-try 22 'int main(){int a; a=10; int b; b=12 ;int c; c=a+b;}'
-try 22 'int main(){int a; a=20; a=10; int b; b=12 ;int c; c=a+b;}'
-try 128 'int main(){int a; a=20;a=10;int z; z=12;int y; y=30;int x; x=22;z*a+y-x;}'
-
-try 128 'int main(){int a; a=20;a=10;int z; z=12;int y; y=30;int x; x=22;return z*a+y-x;}'
-try 12 'int main(){int a; a=20;a=10;int z; z=12;int y; y=30;int x; x=22;z*a+y-x; return z;}'
-try 20 'int main(){int a; a=20;return a;a=10;int z; z=12;int y; y=30;int x; x=22;z*a+y-x;}'
-try 20 'int main(){int a; a=20;return a;a=10;return a;int z; z=12;int y; y=30;int x; x=22;z*a+y-x;}'
-
-try 8 'int main(){int a;int b;int c;int d;a=b=c=d=2; return a+b+c+d;}'
-
-try 10 'int main(){int abc; abc=10; return abc;}'
-try 10 'int main(){int zyx; zyx=10; return zyx;}'
-try 10 'int main(){int foobar; foobar=10; return foobar;}'
-try 10 'int main(){int a123; a123=10; return a123;}'
-try 10 'int main(){int a1; a1=2; int a2; a2=3; int a3; a3=4; int a4; a4=5; int a5; a5=6; int a6; a6=7; int a7; a7=8; int a8; a8=9; int a9; a9=10; int a10; a10=11; int a11; a11=12; int a12; a12=13; int a13; a13=14; int a14; a14=15; int a15; a15=16; int a16; a16=17; int a17; a17=18; int a18; a18=19; int a19; a19=20; int a20; a20=21; int a21; a21=22; int a22; a22=23; int a23; a23=24; int a24; a24=25; int a25; a25=26; int a26; a26=27; int a27; a27=28; int a28; a28=29; int a29; a29=30; int a30; a30=31; return a9;}'
-try 0 'int main(){return 1==2;}'
-try 1 'int main(){return 1==1;}'
-try 0 'int main(){return 10!=10;}'
-try 1 'int main(){return 10!=20;}'
-try 1 'int main(){int foo; foo=10==10; return foo;}'
-try 0 'int main(){int foo; foo=10!=10; return foo;}'
-
-try 42 'int main(){exfunc1();return 42;}'
-try 21 'int main(){exfunc2(42);return 21;}'
-try 42 'int main(){exfunc2(1+2);return 42;}'
-try 42 'int main(){exfunc3(42 21);return 42;}'
-try 21 'int main(){exfunc3(21+21 15+6);return 21;}'
-try 42 'int main(){int a; a=21;int b; b=42;exfunc3(a b);return 42;}'
-try 21 'int main(){int a; a=21;int b; b=42;exfunc3(a+b b);return 21;}'
-
-try 42 'int main(){return exfunc4();}'
-try 42 'int main(){int a; a=exfunc4();return a;}'
-try 42 'int main(){int a; a=exfunc4();int b; b=exfunc4();return a;}'
-try 42 'int main(){int a; a=exfunc4();int b; b=exfunc4();return b;}'
-
-try 42 'int main(){return exfunc5(40 2);}'
-try 21 'int main(){int a; a=11;int b; b=10; return exfunc5(a b);}'
-try 42 'int main(){return exfunc5(20+20 1+1);}'
-try 42 'int main(){int a; a=exfunc5(20 1);int b; b=21; return a + b;}'
-try 42 'int main(){int a; a=exfunc5(20 1);int b; b=exfunc5(20 1); int c; c=exfunc5(a b); return c;}'
-try 42 'int main(){int a; a=exfunc5(20 1);int b; b=exfunc5(20 1); int c; return c=exfunc5(a b);}'
-
-try 0 'int main(){return 20 < 10;}'
-try 1 'int main(){return 20 < 30;}'
-try 0 'int main(){return 20 <= 10;}'
-try 1 'int main(){return 20 <= 30;}'
-try 1 'int main(){return 20 <= 20;}'
-
-try 1 'int main(){return 20 > 10;}'
-try 0 'int main(){return 20 > 30;}'
-try 1 'int main(){return 20 >= 10;}'
-try 0 'int main(){return 20 >= 30;}'
-try 1 'int main(){return 20 >= 20;}'
-
-try 3 'int main(){return 7 % 4;}'
-try 3 'int main(){return (3+4) % 4;}'
-try 0 'int main(){return 10 % 10;}'
-
-try 30 'int main(){int a; a=10;{int b; b=20;}int c; c=30; return c;}'
-try 20 'int main(){int a; a=10;{int a; a=20; return a;}int c; c=30; return a;}'
-
-try 20 'int foo(){;} int main(){int a; a=20; foo(); return a;}'
-try 20 'int foo(){int a; a=10;} int main(){int a; a=20; return a;}'
-try 20 'int foo(){int a; a=10;} int main(){foo(); return 20;}'
-try 20 'int foo(){int a; a=10;} int main(){int a; a=20; foo();return a;}'
-try 10 'int foo(){int a; a=10; return a;} int main(){int a; a=20; a=foo();return a;}'
-
-try 40 'int foo(int a){print_int(a); return a*2;} int main(){return foo(20);}'
-try 40 'int foo(int a){return a*2;} int main(){int a; a=20; int b; b=foo(a);return b;}'
-try 85 'int foo(int a int b int c){return a+b+c;} int main(){int a; a=20; int b; b=40; int c; c=10; int d; d=foo(a*2 b c/2);return d;}'
-
-try 42 'int main(){{} {;} ; return 42;}'
-
-try 5 'int main(){int a; a=-5; int b; b=+10; return a+b;}'
-
-try 42 'int main(){if(1) return 42; return 0;}'
-try 42 'int main(){if(0) return 0; return 42;}'
-try 42 'int main(){if(0) return 0; else return 42; return 1;}'
-try 42 'int main(){if(0) {return 0;} else {return 42;} return 1;}'
-try 42 'int main(){if(0) {return 0;} else if (0) {return 0;} else { if (1) return 42;} return 1;}'
-
-# 5!=120
-try 120 'int fact(int n) { if (n==0) {return 1;} else { return fact(n-1) * n;}}int main() {int f; f=fact(5); return f;}'
-
-try 42 'int main(){int i; for(i=0; i < 42; i=i + 1) {;} return i;}'
-try 42 'int main(){int i; i=0; for(; i < 42; i=i + 1) {;} return i;}'
-try 42 'int main(){int i; for(i=0; ; i=i + 1) {if (i == 42) {return i;}} return 0;}'
-try 42 'int main(){int i; for(i=0; i < 42; ) {i+=1;} return i;}'
-
-try 42 'int main(){int i; i=0; while (i<42) {i+=1;} return i;}'
-try 42 'int main(){int i; i=0; while (i) {i+=1; return 0;} return 42;}'
-try 42 'int main(){int i; i=1; while (i) {i+=1; return 42;} return 0;}'
-try 42 'int main(){int i; i=0; while (1) {i+=1; if (i>=42) {return i;}} return 0;}'
-
-try 42 'int main(){int a; a=10; int b; b=3; a+=b; return a + 29;}'
-try 42 'int main(){int a; a=10; int b; b=3; a-=b; return a + 35;}'
-try 42 'int main(){int a; a=10; int b; b=3; a*=b; return a + 12;}'
-try 42 'int main(){int a; a=10; int b; b=3; a/=b; return a + 39;}'
-try 42 'int main(){int a; a=10; int b; b=3; a%=b; return a + 41;}'
-
-try 42 'int main(){int a; a=42;int b; b=&a; return *b;}'
-# 変数は8Bアラインされている(というか8Bしかない)
-# dは&bを指しているはず(配列がないので気持ち悪いがこんな感じのテストになる)
-try 42 'int main(){int a; a=41; int b; b=42; int c; c=43; int d; d=&a-8; return *d;}'
-
-try 42 'int g1; int g2; int g3; int main(){g1=2; g2=10; g3=22; return g1*g2+g3;}'
-try 42 'int g1; int foo(){return 42;} int g2; int g3; int main(){g1=2; g2=10; g3=22; return g1*g2+g3;}'
+# 同じソースコードの再コンパイルは翻訳単位のキャッシュから出力されること
+../bin/shcc -j 1 "${many_funcs/a+42/a+99}" > testout_j1.s
+../bin/shcc -cache cache -cachestats -o testout.s "${many_funcs/a+42/a+99}" 2> testout.txt
+if ! cmp -s testout_j1.s testout.s || ! grep -q "translation unit *1 *0" testout.txt; then
+	echo "*** translation unit cache did not hit"
+	cat testout.txt
+	exit 1
+fi
+rm -rf cache testout.txt
+
+# スナップショットから読み込んだパース結果の出力は、ソースコードからの出力と一致すること
+../bin/shcc -snapshot testout.snap "$many_funcs"
+../bin/shcc -loadsnapshot testout.snap > testout.s
+../bin/shcc "$many_funcs" > testout_j1.s
+if ! cmp -s testout_j1.s testout.s; then
+	echo "*** output from snapshot differs from output from source"
+	exit 1
+fi
+rm -f testout.snap
+
+# 引数の区切りのカンマは引数の間にだけ書けること（先頭・末尾・連続はコンパイルエラー）
+for input in 'int f(, int a){return a;} int main(){return f(1);}' \
+	'int f(int a,){return a;} int main(){return f(1);}' \
+	'int f(int a,, int b){return a;} int main(){return f(1, 2);}' \
+	'int f(int a){return a;} int main(){return f(,1);}' \
+	'int f(int a, int b){return a;} int main(){return f(1, 2,);}' \
+	'int f(int a, int b){return a;} int main(){return f(1 2, );}' \
+	'int f(int a, int b){return a;} int main(){return f(1,, 2);}'; do
+	if ../bin/shcc "$input" > testout.s 2> /dev/null; then
+		echo "*** '$input'"
+		echo "*** misplaced comma was accepted"
+		exit 1
+	fi
+done
+
+# 一括コンパイルでは入力ファイルごとに出力ファイルが作られること
+mkdir -p batch
+for i in $(seq 1 8); do
+	echo "int main(){return $i*5;}" > batch/unit$i.c
+done
+ls batch/unit*.c > batch/manifest.txt
+../bin/shcc -ftime-report -batch -j 4 @batch/manifest.txt 2> testout.txt
+# 時間計測には全ワーカースレッドの分が集計されること
+if ! grep -q "^  tokens  *96 " testout.txt; then
+	echo "*** batch time report does not cover all inputs"
+	cat testout.txt
+	exit 1
+fi
+rm -f testout.txt
+for i in $(seq 1 8); do
+	gcc -o testout batch/unit$i.s
+	./testout
+	actual="$?"
+	if [ "$actual" != "$((i * 5))" ]; then
+		echo "*** batch/unit$i.c"
+		echo "*** $((i * 5)) expected, but got $actual"
+		exit 1
+	fi
+done
+
+# エラーになる入力があっても、残りの入力はコンパイルされ、失敗した数を出力して異常終了すること
+rm -f batch/unit*.s
+echo 'int main(){return x;}' > batch/unit3.c
+for j in 1 4; do
+	if ../bin/shcc -batch -j $j @batch/manifest.txt 2> testout.txt; then
+		echo "*** batch with a failing input exited successfully (-j $j)"
+		exit 1
+	fi
+	if ! grep -q "^batch/unit3.c: " testout.txt || ! grep -q "8個中1個" testout.txt; then
+		echo "*** batch error does not name the failing input (-j $j)"
+		cat testout.txt
+		exit 1
+	fi
+	for i in 1 2 4 5 6 7 8; do
+		if [ ! -e batch/unit$i.s ]; then
+			echo "*** batch/unit$i.s was not written (-j $j)"
+			exit 1
+		fi
+	done
+	if [ -e batch/unit3.s ]; then
+		echo "*** batch/unit3.s was written for a failing input (-j $j)"
+		exit 1
+	fi
+	rm -f batch/unit*.s
+done
+rm -rf batch testout.txt
 
 echo OK
 
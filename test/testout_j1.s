@@ -0,0 +1,1618 @@
+.intel_syntax noprefix
+# body start
+
+.text
+.global f0
+f0:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 0
+  jge .Lf0.else0
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf0.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f1
+f1:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 1
+  jge .Lf1.else0
+  mov rax, [rbp-8]
+  add rax, 1
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf1.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f2
+f2:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 2
+  jge .Lf2.else0
+  mov rax, [rbp-8]
+  add rax, 2
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf2.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f3
+f3:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 3
+  jge .Lf3.else0
+  mov rax, [rbp-8]
+  add rax, 3
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf3.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f4
+f4:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 4
+  jge .Lf4.else0
+  mov rax, [rbp-8]
+  add rax, 4
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf4.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f5
+f5:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 5
+  jge .Lf5.else0
+  mov rax, [rbp-8]
+  add rax, 5
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf5.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f6
+f6:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 6
+  jge .Lf6.else0
+  mov rax, [rbp-8]
+  add rax, 6
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf6.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f7
+f7:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 7
+  jge .Lf7.else0
+  mov rax, [rbp-8]
+  add rax, 7
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf7.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f8
+f8:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 8
+  jge .Lf8.else0
+  mov rax, [rbp-8]
+  add rax, 8
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf8.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f9
+f9:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 9
+  jge .Lf9.else0
+  mov rax, [rbp-8]
+  add rax, 9
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf9.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f10
+f10:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 10
+  jge .Lf10.else0
+  mov rax, [rbp-8]
+  add rax, 10
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf10.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f11
+f11:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 11
+  jge .Lf11.else0
+  mov rax, [rbp-8]
+  add rax, 11
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf11.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f12
+f12:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 12
+  jge .Lf12.else0
+  mov rax, [rbp-8]
+  add rax, 12
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf12.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f13
+f13:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 13
+  jge .Lf13.else0
+  mov rax, [rbp-8]
+  add rax, 13
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf13.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f14
+f14:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 14
+  jge .Lf14.else0
+  mov rax, [rbp-8]
+  add rax, 14
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf14.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f15
+f15:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 15
+  jge .Lf15.else0
+  mov rax, [rbp-8]
+  add rax, 15
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf15.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f16
+f16:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 16
+  jge .Lf16.else0
+  mov rax, [rbp-8]
+  add rax, 16
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf16.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f17
+f17:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 17
+  jge .Lf17.else0
+  mov rax, [rbp-8]
+  add rax, 17
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf17.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f18
+f18:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 18
+  jge .Lf18.else0
+  mov rax, [rbp-8]
+  add rax, 18
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf18.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f19
+f19:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 19
+  jge .Lf19.else0
+  mov rax, [rbp-8]
+  add rax, 19
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf19.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f20
+f20:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 20
+  jge .Lf20.else0
+  mov rax, [rbp-8]
+  add rax, 20
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf20.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f21
+f21:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 21
+  jge .Lf21.else0
+  mov rax, [rbp-8]
+  add rax, 21
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf21.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f22
+f22:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 22
+  jge .Lf22.else0
+  mov rax, [rbp-8]
+  add rax, 22
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf22.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f23
+f23:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 23
+  jge .Lf23.else0
+  mov rax, [rbp-8]
+  add rax, 23
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf23.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f24
+f24:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 24
+  jge .Lf24.else0
+  mov rax, [rbp-8]
+  add rax, 24
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf24.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f25
+f25:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 25
+  jge .Lf25.else0
+  mov rax, [rbp-8]
+  add rax, 25
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf25.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f26
+f26:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 26
+  jge .Lf26.else0
+  mov rax, [rbp-8]
+  add rax, 26
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf26.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f27
+f27:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 27
+  jge .Lf27.else0
+  mov rax, [rbp-8]
+  add rax, 27
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf27.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f28
+f28:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 28
+  jge .Lf28.else0
+  mov rax, [rbp-8]
+  add rax, 28
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf28.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f29
+f29:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 29
+  jge .Lf29.else0
+  mov rax, [rbp-8]
+  add rax, 29
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf29.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f30
+f30:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 30
+  jge .Lf30.else0
+  mov rax, [rbp-8]
+  add rax, 30
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf30.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f31
+f31:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 31
+  jge .Lf31.else0
+  mov rax, [rbp-8]
+  add rax, 31
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf31.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f32
+f32:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 32
+  jge .Lf32.else0
+  mov rax, [rbp-8]
+  add rax, 32
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf32.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f33
+f33:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 33
+  jge .Lf33.else0
+  mov rax, [rbp-8]
+  add rax, 33
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf33.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f34
+f34:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 34
+  jge .Lf34.else0
+  mov rax, [rbp-8]
+  add rax, 34
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf34.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f35
+f35:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 35
+  jge .Lf35.else0
+  mov rax, [rbp-8]
+  add rax, 35
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf35.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f36
+f36:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 36
+  jge .Lf36.else0
+  mov rax, [rbp-8]
+  add rax, 36
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf36.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f37
+f37:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 37
+  jge .Lf37.else0
+  mov rax, [rbp-8]
+  add rax, 37
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf37.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f38
+f38:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 38
+  jge .Lf38.else0
+  mov rax, [rbp-8]
+  add rax, 38
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf38.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f39
+f39:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 39
+  jge .Lf39.else0
+  mov rax, [rbp-8]
+  add rax, 39
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf39.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f40
+f40:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 40
+  jge .Lf40.else0
+  mov rax, [rbp-8]
+  add rax, 40
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf40.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f41
+f41:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 41
+  jge .Lf41.else0
+  mov rax, [rbp-8]
+  add rax, 41
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf41.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f42
+f42:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 42
+  jge .Lf42.else0
+  mov rax, [rbp-8]
+  add rax, 42
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf42.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f43
+f43:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 43
+  jge .Lf43.else0
+  mov rax, [rbp-8]
+  add rax, 43
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf43.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f44
+f44:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 44
+  jge .Lf44.else0
+  mov rax, [rbp-8]
+  add rax, 44
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf44.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f45
+f45:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 45
+  jge .Lf45.else0
+  mov rax, [rbp-8]
+  add rax, 45
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf45.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f46
+f46:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 46
+  jge .Lf46.else0
+  mov rax, [rbp-8]
+  add rax, 46
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf46.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f47
+f47:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 47
+  jge .Lf47.else0
+  mov rax, [rbp-8]
+  add rax, 47
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf47.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f48
+f48:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 48
+  jge .Lf48.else0
+  mov rax, [rbp-8]
+  add rax, 48
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf48.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f49
+f49:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 49
+  jge .Lf49.else0
+  mov rax, [rbp-8]
+  add rax, 49
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf49.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f50
+f50:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 50
+  jge .Lf50.else0
+  mov rax, [rbp-8]
+  add rax, 50
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf50.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f51
+f51:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 51
+  jge .Lf51.else0
+  mov rax, [rbp-8]
+  add rax, 51
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf51.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f52
+f52:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 52
+  jge .Lf52.else0
+  mov rax, [rbp-8]
+  add rax, 52
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf52.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f53
+f53:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 53
+  jge .Lf53.else0
+  mov rax, [rbp-8]
+  add rax, 53
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf53.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f54
+f54:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 54
+  jge .Lf54.else0
+  mov rax, [rbp-8]
+  add rax, 54
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf54.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f55
+f55:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 55
+  jge .Lf55.else0
+  mov rax, [rbp-8]
+  add rax, 55
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf55.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f56
+f56:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 56
+  jge .Lf56.else0
+  mov rax, [rbp-8]
+  add rax, 56
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf56.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f57
+f57:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 57
+  jge .Lf57.else0
+  mov rax, [rbp-8]
+  add rax, 57
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf57.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f58
+f58:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 58
+  jge .Lf58.else0
+  mov rax, [rbp-8]
+  add rax, 58
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf58.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f59
+f59:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 59
+  jge .Lf59.else0
+  mov rax, [rbp-8]
+  add rax, 59
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf59.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f60
+f60:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 60
+  jge .Lf60.else0
+  mov rax, [rbp-8]
+  add rax, 60
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf60.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f61
+f61:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 61
+  jge .Lf61.else0
+  mov rax, [rbp-8]
+  add rax, 61
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf61.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f62
+f62:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 62
+  jge .Lf62.else0
+  mov rax, [rbp-8]
+  add rax, 62
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf62.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global f63
+f63:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  mov [rbp-8], rdi
+  sub rsp, 16
+  # function prologue end
+  mov rax, [rbp-8]
+  cmp rax, 63
+  jge .Lf63.else0
+  mov rax, [rbp-8]
+  add rax, 63
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+.Lf63.else0:
+  mov rax, [rbp-8]
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+
+.text
+.global main
+main:
+  # function prologue begin
+  push rbp
+  mov rbp, rsp
+  sub rsp, 16
+  # function prologue end
+  mov rax, 1
+  mov rdi, 1
+  call f42
+  # function epilog begin
+  leave
+  ret
+  # function epilog end
+# body end